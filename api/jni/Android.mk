@@ -15,6 +15,15 @@ LOCAL_SHARED_LIBRARIES := usb-1.0
 
 LOCAL_SRC_FILES := \
   $(USBUART_PATH)/src/core.cpp												\
+  $(USBUART_PATH)/src/crc.cpp												\
+  $(USBUART_PATH)/src/timer.cpp												\
+  $(USBUART_PATH)/src/statspage.cpp											\
+  $(USBUART_PATH)/src/capture.cpp											\
+  $(USBUART_PATH)/src/faults.cpp											\
+  $(USBUART_PATH)/src/replay.cpp											\
+  $(USBUART_PATH)/src/simulator.cpp											\
+  $(USBUART_PATH)/src/loopback.cpp											\
+  $(USBUART_PATH)/src/framing.cpp											\
   $(USBUART_PATH)/src/generic.cpp											\
   $(USBUART_PATH)/src/ch34x.cpp												\
   $(USBUART_PATH)/src/ftdi.cpp												\
@@ -26,31 +26,44 @@ namespace usbuart {
 Log log;
 
 
+#if USBUART_LOG_LEVEL >= 1
 void Log::e(const char *tag, const char *fmt, ...) noexcept {
 	va_list args;
 	va_start(args, fmt);
 	__android_log_vprint(ANDROID_LOG_ERROR,tag, fmt, args);
 	va_end(args);
 }
+#endif
 
+#if USBUART_LOG_LEVEL >= 2
 void Log::w(const char *tag, const char *fmt, ...) noexcept {
 	va_list args;
 	va_start(args, fmt);
 	__android_log_vprint(ANDROID_LOG_WARN, tag, fmt, args);
 	va_end(args);
 }
+#endif
 
+#if USBUART_LOG_LEVEL >= 3
 void Log::i(const char *tag, const char *fmt, ...) noexcept {
 	va_list args;
 	va_start(args, fmt);
 	__android_log_vprint(ANDROID_LOG_INFO, tag, fmt, args);
 	va_end(args);
 }
+#endif
 
+#if USBUART_LOG_LEVEL >= 4
 void Log::d(const char *tag, const char *fmt, ...) noexcept {
 	va_list args;
 	va_start(args, fmt);
 	__android_log_vprint(ANDROID_LOG_DEBUG, tag, fmt, args);
 	va_end(args);
 }
+#endif
+
+/* android log is not blocking, asynchronous mode is not needed */
+bool Log::async(bool) noexcept {
+	return false;
+}
 } /* namespace usbuart */
@@ -0,0 +1,391 @@
+/** @brief End-to-end benchmark of USBUART Library on loopback devices
+ *  @file  usbuart-bench.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: usbuart-bench [-t ms] [-b baudrate] [-n channels] [-s sizes]
+ *                      [-l samples] [-m bytes] [-v]
+ *	-t	duration of each throughput run, ms (default 1000)
+ *	-b	line baud rate of the loopbacks (default 12000000)
+ *	-n	maximal number of channels, runs are made for 1, 2, 4 ... n
+ *		channels (default 512)
+ *	-s	comma separated transfer sizes (default 64,512,4096)
+ *	-l	number of round trips measured for latency (default 2000)
+ *	-m	round trip message size (default 8)
+ *	-v	library debug logging to stderr
+ *
+ * For every transfer size the suite attaches pipes to in-process loopback
+ * devices and measures:
+ *	- sustained TX/RX throughput, aggregate and per channel, with every
+ *	  channel keeping a window of bytes in flight, so that the loopback
+ *	  FIFO never overruns and the event loop is the bottleneck;
+ *	- CPU time of the event loop thread and of the process per MB echoed;
+ *	- write to read round trip latency percentiles on a single channel.
+ * Results are written to stdout as JSON, progress to stderr.				*/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "usbuart.h"
+
+using namespace usbuart;
+
+namespace {
+
+struct options {
+	unsigned duration = 1000;		/* ms								*/
+	baudrate_t baudrate = 12000000;
+	unsigned channels = 512;
+	std::vector<unsigned> sizes { 64, 512, 4096 };
+	unsigned samples = 2000;
+	unsigned message = 8;
+	bool verbose = false;
+};
+
+struct throughput {
+	unsigned channels;
+	double tx;						/* B/s, aggregate					*/
+	double rx;
+	double rx_min;					/* B/s, per channel					*/
+	double rx_max;
+	double loop_cpu;				/* ms per MB						*/
+	double process_cpu;
+	uint32_t line_errors;
+	uint32_t dropped;
+};
+
+struct latency {
+	unsigned samples;
+	double p50, p90, p99, p999, max; /* us								*/
+};
+
+static constexpr unsigned window_limit = 8192; /* half of loopback fifo	*/
+
+static inline uint64_t clock_ns(clockid_t id) noexcept {
+	timespec ts;
+	clock_gettime(id, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t now_ns() noexcept {
+	return clock_ns(CLOCK_MONOTONIC);
+}
+
+static uint64_t process_cpu_ns() noexcept {
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+static void setnonblock(int fd) noexcept {
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/** runs the event loop on its own thread, measures its CPU time			*/
+class loop_thread {
+public:
+	loop_thread(context& c) noexcept
+	  : ctx(c), running(true), worker([this]() { run(); }) {
+		pthread_getcpuclockid(worker.native_handle(), &cpu);
+	}
+	~loop_thread() noexcept {
+		running = false;
+		worker.join();
+	}
+	uint64_t cputime() const noexcept { return clock_ns(cpu); }
+private:
+	void run() noexcept {
+		while( running ) ctx.loop(10);
+	}
+	context& ctx;
+	std::atomic<bool> running;
+	std::thread worker;
+	clockid_t cpu;
+};
+
+/** set of channels piped to loopbacks									*/
+class bench_set {
+public:
+	bench_set(context& c, device_addr addr, const eia_tia_232_info& pi,
+			unsigned count) noexcept : ctx(c) {
+		for(unsigned i = 0; i < count; ++i) {
+			channel ch;
+			int res = ctx.pipe(addr, ch, pi);
+			if( res ) {
+				fprintf(stderr, "pipe #%u failed with error %d\n", i, -res);
+				break;
+			}
+			setnonblock(ch.fd_read);
+			setnonblock(ch.fd_write);
+			chs.push_back(ch);
+		}
+	}
+	~bench_set() noexcept {
+		for(auto& ch : chs) ctx.close(ch);
+		usleep(50000); /* let the loop thread dispose the channels		*/
+		for(auto& ch : chs) {
+			::close(ch.fd_read);
+			::close(ch.fd_write);
+		}
+	}
+	unsigned size() const noexcept { return chs.size(); }
+	void errors(uint32_t& line_errors, uint32_t& dropped) noexcept {
+		line_errors = dropped = 0;
+		for(auto& ch : chs) {
+			channel_stats cs;
+			if( ctx.stats(ch, cs) ) continue;
+			line_errors += cs.line_errors;
+			dropped += cs.dropped;
+		}
+	}
+	context& ctx;
+	std::vector<channel> chs;
+};
+
+class bench {
+public:
+	bench(const options& o, context& c) noexcept : opt(o), ctx(c) {
+		memset(pattern, 0x55, sizeof(pattern));
+	}
+
+	throughput run(device_addr addr, unsigned count, unsigned chunk,
+			loop_thread& loop) noexcept {
+		const eia_tia_232_info pi {opt.baudrate,8,none,one,none_};
+		bench_set set(ctx, addr, pi, count);
+		const unsigned n = set.size();
+		const unsigned window = std::min(4 * chunk, window_limit);
+		std::vector<pollfd> fds(2 * n);
+		std::vector<uint64_t> tx(n), rx(n);
+		std::vector<long> inflight(n);
+		throughput r {};
+		r.channels = n;
+		if( n == 0 ) return r;
+		const uint64_t warmup = now_ns() + opt.duration * 200000ull;
+		const uint64_t until = warmup + opt.duration * 1000000ull;
+		uint64_t started = 0, loop_cpu = 0, proc_cpu = 0;
+		for(uint64_t now = now_ns(); now < until; now = now_ns()) {
+			if( started == 0 && now >= warmup ) {
+				started = now;
+				loop_cpu = loop.cputime();
+				proc_cpu = process_cpu_ns();
+				std::fill(tx.begin(), tx.end(), 0);
+				std::fill(rx.begin(), rx.end(), 0);
+			}
+			for(unsigned i = 0; i < n; ++i) {
+				fds[2*i]   = { set.chs[i].fd_read, POLLIN, 0 };
+				fds[2*i+1] = { set.chs[i].fd_write,
+					(short) (inflight[i] < window ? POLLOUT : 0), 0 };
+			}
+			if( poll(fds.data(), fds.size(), 10) <= 0 ) continue;
+			for(unsigned i = 0; i < n; ++i) {
+				if( fds[2*i].revents & POLLIN ) {
+					ssize_t res = read(set.chs[i].fd_read, buffer,
+						sizeof(buffer));
+					if( res > 0 ) {
+						rx[i] += res;
+						inflight[i] -= res;
+					}
+				}
+				if( fds[2*i+1].revents & POLLOUT ) {
+					ssize_t res = write(set.chs[i].fd_write, pattern,
+						window - inflight[i]);
+					if( res > 0 ) {
+						tx[i] += res;
+						inflight[i] += res;
+					}
+				}
+			}
+		}
+		const double elapsed = (now_ns() - started) / 1e9;
+		loop_cpu = loop.cputime() - loop_cpu;
+		proc_cpu = process_cpu_ns() - proc_cpu;
+		uint64_t txsum = 0, rxsum = 0, rxmin = UINT64_MAX, rxmax = 0;
+		for(unsigned i = 0; i < n; ++i) {
+			txsum += tx[i];
+			rxsum += rx[i];
+			rxmin = std::min(rxmin, rx[i]);
+			rxmax = std::max(rxmax, rx[i]);
+		}
+		const double mb = rxsum / 1048576.;
+		r.tx = txsum / elapsed;
+		r.rx = rxsum / elapsed;
+		r.rx_min = rxmin / elapsed;
+		r.rx_max = rxmax / elapsed;
+		r.loop_cpu = mb > 0 ? loop_cpu / 1e6 / mb : 0;
+		r.process_cpu = mb > 0 ? proc_cpu / 1e6 / mb : 0;
+		set.errors(r.line_errors, r.dropped);
+		return r;
+	}
+
+	latency roundtrip(device_addr addr) noexcept {
+		const eia_tia_232_info pi {opt.baudrate,8,none,one,none_};
+		bench_set set(ctx, addr, pi, 1);
+		latency r {};
+		if( set.size() == 0 ) return r;
+		const channel ch = set.chs[0];
+		const unsigned size = std::min<unsigned>(opt.message, sizeof(buffer));
+		std::vector<uint64_t> samples;
+		samples.reserve(opt.samples);
+		pollfd fd { ch.fd_read, POLLIN, 0 };
+		for(unsigned i = 0; i < opt.samples; ++i) {
+			const uint64_t start = now_ns();
+			if( write(ch.fd_write, pattern, size) != (ssize_t) size ) break;
+			unsigned received = 0;
+			while( received < size && poll(&fd, 1, 1000) > 0 ) {
+				ssize_t res = read(ch.fd_read, buffer, size - received);
+				if( res > 0 ) received += res;
+			}
+			if( received < size ) {
+				fprintf(stderr, "round trip #%u timed out\n", i);
+				break;
+			}
+			samples.push_back(now_ns() - start);
+		}
+		if( samples.empty() ) return r;
+		std::sort(samples.begin(), samples.end());
+		auto pct = [&samples](double p) {
+			return samples[(std::size_t) (p * (samples.size() - 1))] / 1e3;
+		};
+		r.samples = samples.size();
+		r.p50  = pct(0.50);
+		r.p90  = pct(0.90);
+		r.p99  = pct(0.99);
+		r.p999 = pct(0.999);
+		r.max  = samples.back() / 1e3;
+		return r;
+	}
+private:
+	const options& opt;
+	context& ctx;
+	char pattern[window_limit];
+	char buffer[window_limit];
+};
+
+static bool parse(int argc, char** argv, options& opt) noexcept {
+	int c;
+	while( (c = getopt(argc, argv, "t:b:n:s:l:m:v")) != -1 ) {
+		switch( c ) {
+		case 't': opt.duration = strtoul(optarg, nullptr, 10); break;
+		case 'b': opt.baudrate = strtoul(optarg, nullptr, 10); break;
+		case 'n': opt.channels = strtoul(optarg, nullptr, 10); break;
+		case 'l': opt.samples  = strtoul(optarg, nullptr, 10); break;
+		case 'm': opt.message  = strtoul(optarg, nullptr, 10); break;
+		case 'v': opt.verbose  = true; break;
+		case 's':
+			opt.sizes.clear();
+			for(char* s = optarg; *s; ) {
+				opt.sizes.push_back(strtoul(s, &s, 10));
+				if( *s == ',' ) ++s;
+				else if( *s ) return false;
+			}
+			break;
+		default:
+			return false;
+		}
+	}
+	return opt.duration && opt.baudrate && opt.channels && opt.sizes.size()
+		&& opt.message;
+}
+
+/** raises limit of open files to fit the channels, returns channels that fit */
+static unsigned fit(unsigned channels) noexcept {
+	static constexpr unsigned fds_per_channel = 4;
+	static constexpr unsigned reserve = 64;
+	rlimit rl;
+	if( getrlimit(RLIMIT_NOFILE, &rl) ) return channels;
+	const rlim_t need = channels * fds_per_channel + reserve;
+	if( rl.rlim_cur < need ) {
+		rl.rlim_cur = std::min(need, rl.rlim_max);
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if( rl.rlim_cur >= need ) return channels;
+	return (rl.rlim_cur - reserve) / fds_per_channel;
+}
+
+}
+
+int main(int argc, char** argv) {
+	options opt;
+	if( ! parse(argc, argv, opt) ) {
+		fprintf(stderr, "Usage: usbuart-bench [-t ms] [-b baudrate] "
+			"[-n channels] [-s sizes] [-l samples] [-m bytes] [-v]\n");
+		return 1;
+	}
+	const unsigned channels = fit(opt.channels);
+	if( channels < opt.channels )
+		fprintf(stderr, "open files limit allows %u channels only\n",
+			channels);
+
+	signal(SIGPIPE, SIG_IGN);
+	context::setloglevel(opt.verbose ? loglevel_t::debug : loglevel_t::error);
+	context ctx;
+	bench b(opt, ctx);
+	loop_thread loop(ctx);
+
+	printf("{\n\t\"device\": \"loopback\",\n\t\"baudrate\": %u,\n"
+		"\t\"duration_ms\": %u,\n\t\"message\": %u,\n\t\"configs\": [",
+		opt.baudrate, opt.duration, opt.message);
+	const char* sep = "";
+	for(unsigned chunk : opt.sizes) {
+		device_addr addr;
+		if( int res = ctx.loopback(addr, 0, chunk) ) {
+			fprintf(stderr, "transfer size %u rejected with error %d\n",
+				chunk, -res);
+			continue;
+		}
+		printf("%s\n\t{\n\t\t\"transfer_size\": %u,\n\t\t\"throughput\": [",
+			sep, chunk);
+		sep = ",";
+		const char* rsep = "";
+		for(unsigned n = 1; n <= channels; n *= 2) {
+			fprintf(stderr, "transfer size %u, %u channel(s)\n", chunk, n);
+			const throughput r = b.run(addr, n, chunk, loop);
+			printf("%s\n\t\t\t{ \"channels\": %u, \"tx_Bps\": %.0f, "
+				"\"rx_Bps\": %.0f, \"rx_per_channel_Bps\": { \"min\": %.0f, "
+				"\"mean\": %.0f, \"max\": %.0f }, \"loop_cpu_ms_per_MB\": %.3f, "
+				"\"process_cpu_ms_per_MB\": %.3f, \"line_errors\": %u, "
+				"\"dropped\": %u }", rsep, r.channels, r.tx, r.rx, r.rx_min,
+				r.channels ? r.rx / r.channels : 0, r.rx_max, r.loop_cpu,
+				r.process_cpu, r.line_errors, r.dropped);
+			rsep = ",";
+			if( r.channels < n ) break;
+		}
+		fprintf(stderr, "transfer size %u, round trip latency\n", chunk);
+		const latency l = b.roundtrip(addr);
+		printf("\n\t\t],\n\t\t\"latency_us\": { \"samples\": %u, "
+			"\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+			"\"max\": %.1f }\n\t}", l.samples, l.p50, l.p90, l.p99, l.p999,
+			l.max);
+	}
+	printf("\n\t]\n}\n");
+	return 0;
+}
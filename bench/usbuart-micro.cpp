@@ -0,0 +1,350 @@
+/** @brief Microbenchmarks of USBUART Library per transfer and per attach paths
+ *  @file  usbuart-micro.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: usbuart-micro [-t ms] [-n channels] [-f filter] [-v]
+ *	-t	time budget of each case, ms (default 200)
+ *	-n	maximal number of channels for find and poll cases, runs are
+ *		made for 16, 128 ... n channels (default 512)
+ *	-f	run only cases which names contain the filter
+ *	-v	library debug logging to stderr
+ *
+ * Cases:
+ *	ftdi.read_callback	status bytes stripping of a completed bulk-in
+ *						transfer, including a copy of the buffer (see the
+ *						memcpy case for its cost)
+ *	ftdi.divisors		compute_divisors over standard baud rates
+ *	factory.create		driver lookup in the registered factories by
+ *						VID/PID and construction of the driver
+ *	backend.find		lookup of the last attached channel
+ *	backend.poll		poll_events with no fd ready and with every pipe
+ *						ready
+ *	rwlock.shared		shared_lock/shared_unlock by concurrent readers,
+ *						std::mutex is measured for reference
+ *
+ * The library sources are compiled in, to reach the internals; devices
+ * are provided by the chip emulator, channels are piped to loopbacks.
+ * Results are written to stdout as JSON, progress to stderr.				*/
+
+#include "core.cpp"
+#include "ftdi.cpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "usbemu.h"
+
+using namespace usbuart;
+
+namespace {
+
+struct options {
+	unsigned duration = 200;		/* ms, per case						*/
+	unsigned channels = 512;
+	const char* filter = nullptr;
+	bool verbose = false;
+};
+
+static options opt;
+static volatile unsigned sink;		/* defeats dead code elimination	*/
+static bool first = true;
+
+static inline uint64_t now_ns() noexcept {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool selected(const char* name) noexcept {
+	return opt.filter == nullptr || strstr(name, opt.filter) != nullptr;
+}
+
+static void report(const char* name, double ns, uint64_t iterations,
+		unsigned threads = 1) noexcept {
+	printf("%s\n    {\"name\":\"%s\",\"ns\":%.1f,\"iterations\":%llu,"
+		"\"threads\":%u}", first ? "" : ",", name, ns,
+		(unsigned long long) iterations, threads);
+	fprintf(stderr, "%-36s %12.1f ns\n", name, ns);
+	first = false;
+}
+
+template<typename F>
+static uint64_t run(F& op, uint64_t n) {
+	const uint64_t start = now_ns();
+	for(uint64_t i = 0; i < n; ++i) op();
+	return now_ns() - start;
+}
+
+/** calibrates number of iterations to 1/8 of the budget, reports median
+ *  ns per operation of five runs										*/
+template<typename F>
+static void measure(const char* name, F op) {
+	if( ! selected(name) ) return;
+	static constexpr unsigned runs = 5;
+	const uint64_t budget = opt.duration * 1000000ull;
+	uint64_t n = 1;
+	while( run(op, n) < budget / (runs + 3) ) n *= 2;
+	double sample[runs];
+	for(auto& s : sample) s = (double) run(op, n) / n;
+	std::sort(sample, sample + runs);
+	report(name, sample[runs / 2], n * runs);
+}
+
+/** opens emulated chip of the given model								*/
+static libusb_device_handle* open(context::backend& b, const char* model) {
+	const int addr = usbemu_plug(model);
+	if( addr < 0 ) {
+		fprintf(stderr, "usbemu_plug(%s) failed with %d\n", model, addr);
+		exit(EXIT_FAILURE);
+	}
+	libusb_device* dev = b.find([addr](libusb_device* d) -> bool {
+		return libusb_get_device_address(d) == addr;
+	});
+	libusb_device_handle* handle = nullptr;
+	if( dev == nullptr || libusb_open(dev, &handle) ) {
+		fprintf(stderr, "%s not found\n", model);
+		exit(EXIT_FAILURE);
+	}
+	libusb_unref_device(dev);
+	return handle;
+}
+
+/** fills buffer with packets of the given size, each led by status bytes	*/
+static void packetize(std::vector<uint8_t>& buf, unsigned packet) noexcept {
+	for(unsigned pos = 0; pos < buf.size(); ++pos)
+		buf[pos] = pos % packet == 0 ? 0x01 : pos % packet == 1 ? 0x60 : 0x55;
+}
+
+static void read_callback(context::backend& b, const char* model,
+		unsigned packet) {
+	libusb_device_handle* handle = open(b, model);
+	driver* drv = registrar().create(handle, 0);
+	libusb_transfer* xfer = libusb_alloc_transfer(0);
+	char name[64];
+	for(unsigned len : { 2u, packet, 8 * packet }) {
+		std::vector<uint8_t> tmpl(len), buf(len);
+		packetize(tmpl, packet);
+		xfer->buffer = buf.data();
+		snprintf(name, sizeof(name), "ftdi.read_callback/%s/%u", model, len);
+		measure(name, [&]() {
+			usbuart::size_t pos;
+			memcpy(buf.data(), tmpl.data(), len);
+			xfer->actual_length = len;
+			drv->read_callback(xfer, pos);
+			sink = xfer->actual_length;
+		});
+		snprintf(name, sizeof(name), "memcpy/%u", len);
+		measure(name, [&]() {
+			memcpy(buf.data(), tmpl.data(), len);
+			sink = buf[len - 1];
+		});
+	}
+	xfer->buffer = nullptr;
+	libusb_free_transfer(xfer);
+	delete drv;
+	libusb_close(handle);
+}
+
+static void divisors(context::backend& b, const char* model) {
+	static constexpr baudrate_t rates[] = {
+		300, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400,
+		460800, 921600, 1000000, 2000000, 3000000, 12000000 };
+	libusb_device_handle* handle = open(b, model);
+	driver* drv = registrar().create(handle, 0);
+	const ftdi* chip = dynamic_cast<const ftdi*>(drv);
+	char name[64];
+	snprintf(name, sizeof(name), "ftdi.divisors/%s", model);
+	unsigned i = 0;
+	measure(name, [&]() {
+		uint16_t value, index;
+		chip->compute_divisors(rates[i++ % countof(rates)], value, index);
+		sink = value + index;
+	});
+	delete drv;
+	libusb_close(handle);
+}
+
+static void factory(context::backend& b, const char* model) {
+	libusb_device_handle* handle = open(b, model);
+	char name[64];
+	snprintf(name, sizeof(name), "factory.create/%s", model);
+	measure(name, [&]() {
+		delete registrar().create(handle, 0);
+	});
+	libusb_close(handle);
+}
+
+/** raises the fd limit, each channel takes four descriptors				*/
+static void fit(unsigned channels) noexcept {
+	rlimit rl;
+	if( getrlimit(RLIMIT_NOFILE, &rl) ) return;
+	const rlim_t need = channels * 4 + 64;
+	if( rl.rlim_cur >= need ) return;
+	rl.rlim_cur = std::min(need, rl.rlim_max);
+	setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static void channels(std::vector<channel>& chs) {
+	fit(opt.channels);
+	{
+		context::backend b;
+		device_addr addr;
+		b.loopback(addr, 0, 0);
+		const eia_tia_232_info pi {115200,8,none,one,none_};
+		char name[64];
+		for(unsigned n = 16; chs.size() < opt.channels;
+				n = std::min(n * 8, opt.channels)) {
+			while( chs.size() < n ) {
+				channel ch;
+				if( int res = b.pipe(addr, ch, pi) ) {
+					fprintf(stderr, "pipe #%u failed with error %d\n",
+						(unsigned) chs.size(), -res);
+					return;
+				}
+				chs.push_back(ch);
+			}
+			const channel& last(chs.back());
+			snprintf(name, sizeof(name), "backend.find/%u", n);
+			measure(name, [&]() {
+				sink = b.find(last) != nullptr;
+			});
+
+			snprintf(name, sizeof(name), "backend.poll/idle/%u", n);
+			measure(name, [&]() {
+				sink = b.poll_events(0, timer_queue::never);
+			});
+
+			const vector<pollfd> saved(b.poll_list);
+			for(auto& ch : chs) ::write(ch.fd_write, "U", 1);
+			snprintf(name, sizeof(name), "backend.poll/ready/%u", n);
+			measure(name, [&]() {
+				b.poll_list.assign(saved.begin(), saved.end());
+				sink = b.poll_events(0, timer_queue::never);
+			});
+			b.poll_list.assign(saved.begin(), saved.end());
+			for(auto child : b.child_list) {	/* drain, for the next idle	*/
+				char c;
+				sink = ::read(child->_readfd(), &c, 1);
+			}
+		}
+	}
+	for(auto& ch : chs) {
+		::close(ch.fd_read);
+		::close(ch.fd_write);
+	}
+}
+
+/** every thread takes and releases the lock for the budget, reported is
+ *  average time of a lock/unlock pair as seen by a thread				*/
+template<typename M, typename L, typename U>
+static void contention(const char* kind, unsigned threads, L lock, U unlock) {
+	char name[64];
+	snprintf(name, sizeof(name), "rwlock.%s/%u", kind, threads);
+	if( ! selected(name) ) return;
+	M m;
+	std::atomic<bool> running(true);
+	std::atomic<unsigned> ready(0);
+	std::vector<uint64_t> ops(threads);
+	std::vector<std::thread> pool;
+	for(unsigned t = 0; t < threads; ++t)
+		pool.emplace_back([&, t]() {
+			uint64_t n = 0;
+			++ready;
+			while( ready < threads ) std::this_thread::yield();
+			while( running ) {
+				lock(m);
+				++n;
+				unlock(m);
+			}
+			ops[t] = n;
+		});
+	while( ready < threads ) std::this_thread::yield();
+	const uint64_t start = now_ns();
+	usleep(opt.duration * 1000);
+	running = false;
+	for(auto& t : pool) t.join();
+	const uint64_t elapsed = now_ns() - start;
+	uint64_t total = 0;
+	for(auto n : ops) total += n;
+	report(name, (double) elapsed * threads / total, total, threads);
+}
+
+static void contention() {
+	const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	for(unsigned threads = 1; threads <= std::max(8u, cores); threads *= 2) {
+		contention<rwlock>("shared", threads,
+			[](rwlock& m) { m.shared_lock(); },
+			[](rwlock& m) { m.shared_unlock(); });
+		contention<std::mutex>("mutex", threads,
+			[](std::mutex& m) { m.lock(); },
+			[](std::mutex& m) { m.unlock(); });
+	}
+}
+
+static void usage(const char* self) noexcept {
+	fprintf(stderr, "Usage: %s [-t ms] [-n channels] [-f filter] [-v]\n",
+		self);
+}
+
+}
+
+int main(int argc, char** argv) {
+	int c;
+	while( (c = getopt(argc, argv, "t:n:f:v")) != -1 ) {
+		switch( c ) {
+		case 't': opt.duration = strtoul(optarg, nullptr, 0); break;
+		case 'n': opt.channels = strtoul(optarg, nullptr, 0); break;
+		case 'f': opt.filter = optarg; break;
+		case 'v': opt.verbose = true; break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if( opt.duration == 0 || opt.channels < 16 ) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	context::setloglevel(opt.verbose ? loglevel_t::debug : loglevel_t::error);
+	printf("{\n  \"duration_ms\":%u,\n  \"cases\":[", opt.duration);
+	try {
+		{
+			context::backend b;
+			read_callback(b, "ft232r", 64);
+			read_callback(b, "ft2232h", 512);
+			divisors(b, "ft232r");
+			divisors(b, "ft2232h");
+			for(auto model : { "ft232r", "ft2232h", "pl2303hx", "ch340" })
+				factory(b, model);
+		}
+		std::vector<channel> chs;
+		channels(chs);
+		contention();
+	} catch(usbuart::error_t err) {
+		fprintf(stderr, "failed with error %d\n", +err);
+		return EXIT_FAILURE;
+	}
+	printf("\n  ]\n}\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/** @brief emulator of WCH CH340 chip
+ *  @file  ch34x_chip.cpp
+ *  @addtogroup emu
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cstring>
+#include "emu.hpp"
+
+namespace usbemu {
+
+/**
+ * CH340. The chip is configured by writing pairs of registers, the baud
+ * rate is set with the prescaler (0x12) and divisor (0x13) registers:
+ *	baudrate = 48MHz / ((1 << (12 - 3 * ps - fact)) * (256 - divisor))
+ * where ps and fact are bits 0-1 and bit 2 of the prescaler register.
+ * Line format registers are recorded, but not interpreted,
+ * timing assumes 8N1.
+ */
+class ch34x_chip : public chip {
+public:
+	static constexpr uint8_t reqo = 0x40;
+	static constexpr uint8_t reqi = 0xC0;
+	static constexpr uint8_t get_version = 0x5f;
+	static constexpr uint8_t read_reg = 0x95;
+	static constexpr uint8_t write_reg = 0x9a;
+	static constexpr uint8_t serial_init = 0xa1;
+	static constexpr uint8_t modem_ctrl = 0xa4;
+	static constexpr uint8_t prescaler_reg = 0x12;
+	static constexpr uint8_t divisor_reg = 0x13;
+	static constexpr uint8_t version = 0x27;
+	static constexpr uint32_t clock = 48000000;
+
+	ch34x_chip(const char* model, const libusb_device_descriptor& d,
+		const port_model* models) noexcept
+	  : chip(model, d, models, 1), initialized(false), reported(false) {
+		memset(regs, 0, sizeof(regs));
+		regs[prescaler_reg] = 0x02;		/* 9600							*/
+		regs[divisor_reg] = 0xb2;
+	}
+
+	int control(const libusb_device_handle&, const setup& req,
+			uint8_t* data, uint64_t) noexcept {
+		port& p(ports[0]);
+		if( req.type == reqo ) switch( req.request ) {
+		case serial_init:
+			initialized = true;
+			return 0;
+		case write_reg:
+			write(p, req.value & 0xFF, req.index & 0xFF);
+			write(p, req.value >> 8, req.index >> 8);
+			return 0;
+		case modem_ctrl:
+			p.stats.flowcontrol = req.value & 0xFF;
+			return 0;
+		}
+		if( req.type == reqi && req.length >= 2 ) switch( req.request ) {
+		case get_version:
+			data[0] = version;
+			data[1] = 0;
+			return 2;
+		case read_reg:
+			data[0] = regs[req.value & 0xFF];
+			data[1] = regs[req.value >> 8];
+			return 2;
+		}
+		return stall(p, req);
+	}
+
+	void ready(port& p) noexcept {
+		if( initialized || reported ) return;
+		reported = true;
+		violation(p, "bulk transfer before serial init");
+	}
+
+private:
+	void write(port& p, uint8_t reg, uint8_t val) noexcept {
+		regs[reg] = val;
+		if( reg != prescaler_reg && reg != divisor_reg ) return;
+		const unsigned ps = regs[prescaler_reg] & 0x3;
+		const unsigned fact = (regs[prescaler_reg] >> 2) & 0x1;
+		const uint32_t baudrate = clock /
+			((1u << (12 - 3 * ps - fact)) * (256 - regs[divisor_reg]));
+		if( baudrate > 2000000 )
+			violation(p, "baud rate %u out of range", baudrate);
+		p.configure(baudrate, 8, 0, 0);
+	}
+
+	uint8_t regs[256];
+	bool initialized;
+	bool reported;
+};
+
+chip* ch34x(const char* model) noexcept {
+	static constexpr const port_model ports[] = {
+		{ 0x82, 0x02, 32, 32, 32 }
+	};
+	if( strcmp(model, "ch340") == 0 )
+		return new ch34x_chip("ch340", { 18, LIBUSB_DT_DEVICE, 0x0110, 0xFF,
+			0, 0, 8, 0x1a86, 0x7523, 0x0254, 0, 2, 0, 1 }, ports);
+	return nullptr;
+}
+
+}
@@ -0,0 +1,197 @@
+/** @brief USB-UART chip emulator internals
+ *  @file  emu.hpp
+ *  @addtogroup emu
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef EMU_HPP_
+#define EMU_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <vector>
+#include <libusb.h>
+#include "usbemu.h"
+
+/** Context of the emulated libusb										*/
+struct libusb_context;
+
+/** Emulated device, owned by the bus while plugged and by references	*/
+struct libusb_device;
+
+/** Device handle, tracks interfaces claimed through it					*/
+struct libusb_device_handle {
+	libusb_device* dev;
+	libusb_context* ctx;
+	uint32_t claimed;
+};
+
+namespace usbemu {
+
+static constexpr uint64_t never = UINT64_MAX;
+
+/** returns monotonic time in nanoseconds									*/
+static inline uint64_t nanotime() noexcept {
+	timespec ts;
+	if( clock_gettime(CLOCK_MONOTONIC, &ts) ) return 0;
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+class port;
+
+/** transfer with emulator's private part, allocated by libusb_alloc_transfer
+ *  public part is the last member because it ends with a flexible array	*/
+struct itransfer {
+	libusb_context* ctx;	/* context delivering the completion			*/
+	port* owner;			/* port the transfer is queued to				*/
+	uint64_t deadline;		/* timeout expiration time, or never			*/
+	bool busy;				/* submitted and not yet completed				*/
+	libusb_transfer pub;
+};
+
+static inline itransfer* priv(libusb_transfer* xfer) noexcept {
+	return (itransfer*)((char*)xfer - offsetof(itransfer, pub));
+}
+
+/** control request setup fields											*/
+struct setup {
+	uint8_t  type;
+	uint8_t  request;
+	uint16_t value;
+	uint16_t index;
+	uint16_t length;
+};
+
+/** static properties of a chip port										*/
+struct port_model {
+	uint8_t  ep_in;
+	uint8_t  ep_out;
+	uint16_t mps;		/* max packet size of bulk endpoints				*/
+	uint32_t rxfifo;	/* RX FIFO size, bytes								*/
+	uint32_t txfifo;	/* TX FIFO size, bytes								*/
+};
+
+class chip;
+
+/**
+ * UART port with a loopback plug. Bytes of OUT transfers enter the TX FIFO
+ * as space allows, are transmitted at the line rate and arrive to the RX
+ * FIFO, overrunning it if the host does not read in time. IN transfers are
+ * filled with packets of max packet size, framed by the chip.
+ */
+class port {
+public:
+	port(chip& owner, uint8_t number, const port_model& model) noexcept;
+	/** queues a transfer for the port									*/
+	void submit(itransfer* xfer, uint64_t now) noexcept;
+	/** removes a transfer from the queues, returns false if not found	*/
+	bool cancel(itransfer* xfer) noexcept;
+	/** completes due transfers, returns time of the next event			*/
+	uint64_t process(uint64_t now, std::vector<itransfer*>& done) noexcept;
+	/** completes all queued transfers with the given status				*/
+	void fail(libusb_transfer_status status,
+			std::vector<itransfer*>& done) noexcept;
+	void purge_rx(uint64_t now) noexcept;
+	void purge_tx(uint64_t now) noexcept;
+	/** applies new line settings to the bytes transmitted from now on	*/
+	void configure(uint32_t baudrate, uint8_t databits, uint8_t parity,
+			uint8_t stopbits) noexcept;
+	inline size_t fifo() const noexcept { return rx.size(); }
+	chip& owner;
+	const uint8_t number;
+	const port_model model;
+	usbemu_stats stats;
+	uint64_t last;			/* time of the last IN packet					*/
+	uint64_t since;			/* arrival of the oldest byte in RX FIFO		*/
+	bool overrun;			/* overrun since the last IN packet				*/
+private:
+	struct segment {
+		uint64_t begin;		/* transmission start							*/
+		uint64_t chartime;	/* duration of one character					*/
+		uint32_t count;		/* characters remaining in the segment			*/
+	};
+	void arrive(uint64_t now) noexcept;
+	uint64_t arrival(size_t n) const noexcept;
+	void transmit(const uint8_t* data, size_t size, uint64_t now) noexcept;
+	uint64_t feed(uint64_t now, std::vector<itransfer*>& done) noexcept;
+	uint64_t fill(uint64_t now, std::vector<itransfer*>& done) noexcept;
+	void complete(itransfer* xfer, libusb_transfer_status status,
+			std::vector<itransfer*>& done) noexcept;
+	std::deque<itransfer*> ins;
+	std::deque<itransfer*> outs;
+	std::deque<uint8_t> wire;	/* bytes in TX FIFO or on the line			*/
+	std::deque<segment> segments;
+	std::deque<uint8_t> rx;		/* RX FIFO									*/
+	uint64_t chartime;
+	uint64_t linefree;		/* end of transmission of the last byte		*/
+	uint32_t accepted;		/* bytes accepted from the head OUT transfer	*/
+	bool dropping;			/* the last arrived byte was dropped			*/
+};
+
+/**
+ * Emulated chip, a device with one or more ports. Implementations
+ * validate vendor and class requests of the chip protocol and define
+ * framing of IN packets.
+ */
+class chip {
+public:
+	virtual ~chip() noexcept {}
+	/** handles a control request, returns length of data stage or
+	 *  LIBUSB_ERROR_PIPE to stall the request								*/
+	virtual int control(const libusb_device_handle& handle,
+			const setup& req, uint8_t* data, uint64_t now) noexcept = 0;
+	/** writes packet header, returns its size							*/
+	virtual unsigned header(port&, uint8_t*) noexcept { return 0; }
+	/** returns size of packet header									*/
+	virtual unsigned headsize() const noexcept { return 0; }
+	/** returns time when a packet shorter than max packet may be sent	*/
+	virtual uint64_t flush(const port& p) const noexcept;
+	/** checks if the host may exchange data with the port				*/
+	virtual void ready(port&) noexcept {}
+	/** counts and reports a protocol violation							*/
+	void violation(port& p, const char* fmt, ...) noexcept
+		__attribute__ ((format (printf, 3, 4)));
+	/** creates a chip by model name, returns nullptr if unknown			*/
+	static chip* create(const char* model) noexcept;
+
+	const char* const name;
+	libusb_device_descriptor desc;
+	std::vector<port> ports;
+	uint8_t address;
+protected:
+	chip(const char* model, const libusb_device_descriptor& d,
+		const port_model* models, unsigned count) noexcept;
+	/** returns port addressed by a class request, or nullptr			*/
+	port* interface(const libusb_device_handle& handle, uint16_t index)
+		noexcept;
+	/** stalls a request, counting it as a violation						*/
+	int stall(port& p, const setup& req) noexcept;
+};
+
+/** USB full speed frame duration, ns										*/
+static constexpr uint64_t frame = 1000000;
+
+chip* ftdi(const char* model) noexcept;
+chip* pl2303(const char* model) noexcept;
+chip* ch34x(const char* model) noexcept;
+
+}
+#endif
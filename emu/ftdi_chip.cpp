@@ -0,0 +1,215 @@
+/** @brief emulator of FTDI chips
+ *  @file  ftdi_chip.cpp
+ *  @addtogroup emu
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cstring>
+#include "emu.hpp"
+
+namespace usbemu {
+
+/**
+ * FT232R, FT2232H and FT4232H. Every IN packet starts with two status
+ * bytes, a packet shorter than max packet size is sent when the latency
+ * timer expires, with status bytes only if there is no data.
+ * SIO requests address ports with the low byte of wIndex, 1 for port A,
+ * 2 for port B and so on, 0 is accepted as port A.
+ * See AN232B-04 and AN232B-05 for details.
+ */
+class ftdi_chip : public chip {
+public:
+	enum sio {
+		reset_req			= 0x00,
+		modem_ctrl_req		= 0x01,
+		set_flow_ctrl_req	= 0x02,
+		set_baudrate_req	= 0x03,
+		set_data_req		= 0x04,
+		get_modem_status_req= 0x05,
+		set_latency_req		= 0x09,
+		get_latency_req		= 0x0a,
+		set_bitmode_req		= 0x0b,
+		read_eeprom_req		= 0x90,
+	};
+	static constexpr uint8_t reqo = 0x40; /* vendor, device, OUT			*/
+	static constexpr uint8_t reqi = 0xC0; /* vendor, device, IN				*/
+	static constexpr uint8_t modem_status = 0x31; /* CTS DSR, looped back	*/
+	static constexpr uint8_t line_idle = 0x60;	/* THRE TEMT				*/
+	static constexpr uint8_t default_latency = 16; /* ms					*/
+
+	ftdi_chip(const char* model, const libusb_device_descriptor& d,
+		const port_model* models, unsigned count, bool h) noexcept
+	  : chip(model, d, models, count), hispeed(h) {
+		memset(latency, default_latency, sizeof(latency));
+	}
+
+	int control(const libusb_device_handle& handle, const setup& req,
+			uint8_t* data, uint64_t now) noexcept {
+		port* p = select(handle, req.index);
+		if( p == nullptr ) return stall(ports[0], req);
+		if( req.type == reqo ) switch( req.request ) {
+		case reset_req:
+			switch( req.value ) {
+			case 0: p->purge_rx(now); p->purge_tx(now); return 0;
+			case 1: p->purge_rx(now); return 0;
+			case 2: p->purge_tx(now); return 0;
+			}
+			break;
+		case modem_ctrl_req:
+		case set_bitmode_req:
+			return 0;
+		case set_flow_ctrl_req:
+			p->stats.flowcontrol = req.index >> 8;
+			return 0;
+		case set_baudrate_req:
+			setbaudrate(*p, req.value, req.index);
+			return 0;
+		case set_data_req:
+			setdata(*p, req.value);
+			return 0;
+		case set_latency_req:
+			if( (req.value & 0xFF) == 0 )
+				violation(*p, "zero latency timer");
+			latency[p->number] = req.value ? req.value : 1;
+			return 0;
+		}
+		if( req.type == reqi ) switch( req.request ) {
+		case get_modem_status_req:
+			return reply(data, req.length, modem_status, line_idle);
+		case get_latency_req:
+			return reply(data, req.length, latency[p->number]);
+		case read_eeprom_req:
+			return reply(data, req.length, 0xFF, 0xFF);
+		}
+		return stall(*p, req);
+	}
+
+	unsigned header(port& p, uint8_t* buf) noexcept {
+		buf[0] = modem_status;
+		buf[1] = line_idle | (p.overrun ? 0x02 : 0) | (p.fifo() ? 0x01 : 0);
+		p.overrun = false;
+		return 2;
+	}
+
+	unsigned headsize() const noexcept { return 2; }
+
+	uint64_t flush(const port& p) const noexcept {
+		return p.last + latency[p.number] * 1000000ull;
+	}
+
+private:
+	/* returns port addressed by wIndex of a SIO request					*/
+	port* select(const libusb_device_handle& handle, uint16_t index) noexcept {
+		unsigned num = index & 0xFF;
+		if( num ) --num;
+		if( num >= ports.size() ) return nullptr;
+		if( ! (handle.claimed & (1 << num)) )
+			violation(ports[num], "request for port %c without claiming "
+				"interface %d", 'A' + num, num);
+		return &ports[num];
+	}
+
+	int reply(uint8_t* data, uint16_t length, uint8_t a) noexcept {
+		if( length < 1 ) return 0;
+		data[0] = a;
+		return 1;
+	}
+
+	int reply(uint8_t* data, uint16_t length, uint8_t a, uint8_t b) noexcept {
+		if( length < 2 ) return reply(data, length, a);
+		data[0] = a;
+		data[1] = b;
+		return 2;
+	}
+
+	/* decodes divisor as described in AN232B-05							*/
+	void setbaudrate(port& p, uint16_t value, uint16_t index) noexcept {
+		static constexpr const uint8_t eighths[8] = { 0, 4, 2, 1, 3, 5, 6, 7 };
+		const uint32_t integer = value & 0x3FFF;
+		const uint32_t frac = eighths[(value >> 14) | ((index >> 6) & 4)];
+		const bool hclk = index & 0x0200;
+		if( hclk && ! hispeed )
+			violation(p, "120MHz clock selected on a full speed chip");
+		const uint32_t base = hclk ? 12000000 : 3000000;
+		uint32_t baudrate;
+		if( integer == 0 && frac == 0 )
+			baudrate = base;
+		else if( integer == 1 && frac == 0 )
+			baudrate = base * 2 / 3;
+		else {
+			if( integer < 2 )
+				violation(p, "sub-integer divisor %d+%d/8 is below 2",
+					integer, frac);
+			baudrate = (uint64_t) base * 8 / (integer * 8 + frac);
+		}
+		p.configure(baudrate, p.stats.databits, p.stats.parity,
+				p.stats.stopbits);
+	}
+
+	void setdata(port& p, uint16_t value) noexcept {
+		const uint8_t databits = value & 0xFF;
+		const uint8_t parity = (value >> 8) & 0x7;
+		const uint8_t stopbits = (value >> 11) & 0x3;
+		if( databits != 7 && databits != 8 )
+			violation(p, "unsupported data bits %d", databits);
+		if( parity > 4 )
+			violation(p, "invalid parity %d", parity);
+		if( stopbits > 2 )
+			violation(p, "invalid stop bits %d", stopbits);
+		if( value & (1 << 14) ) return; /* break, line settings retained	*/
+		p.configure(p.stats.baudrate, databits, parity, stopbits);
+	}
+
+	const bool hispeed;
+	uint8_t latency[4];
+};
+
+static constexpr libusb_device_descriptor descriptor(uint16_t pid,
+		uint16_t bcd, uint8_t mps0) {
+	return { 18, LIBUSB_DT_DEVICE, 0x0200, 0, 0, 0, mps0, 0x0403, pid, bcd,
+		1, 2, 3, 1 };
+}
+
+chip* ftdi(const char* model) noexcept {
+	static constexpr const port_model ft232r[] = {
+		{ 0x81, 0x02, 64, 256, 128 }
+	};
+	static constexpr const port_model ft2232h[] = {
+		{ 0x81, 0x02, 512, 4096, 4096 },
+		{ 0x83, 0x04, 512, 4096, 4096 },
+	};
+	static constexpr const port_model ft4232h[] = {
+		{ 0x81, 0x02, 512, 2048, 2048 },
+		{ 0x83, 0x04, 512, 2048, 2048 },
+		{ 0x85, 0x06, 512, 2048, 2048 },
+		{ 0x87, 0x08, 512, 2048, 2048 },
+	};
+	if( strcmp(model, "ft232r") == 0 )
+		return new ftdi_chip("ft232r", descriptor(0x6001, 0x0600, 8),
+			ft232r, 1, false);
+	if( strcmp(model, "ft2232h") == 0 )
+		return new ftdi_chip("ft2232h", descriptor(0x6010, 0x0700, 64),
+			ft2232h, 2, true);
+	if( strcmp(model, "ft4232h") == 0 )
+		return new ftdi_chip("ft4232h", descriptor(0x6011, 0x0800, 64),
+			ft4232h, 4, true);
+	return nullptr;
+}
+
+}
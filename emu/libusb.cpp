@@ -0,0 +1,516 @@
+/** @brief libusb-1.0 API on top of emulated chips
+ *  @file  libusb.cpp
+ *  @addtogroup emu
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "emu.hpp"
+
+using namespace usbemu;
+
+struct libusb_device {
+	chip* emu;
+	libusb_context* ctx;	/* context that listed the device last			*/
+	unsigned refs;
+	uint32_t claimed;		/* interfaces claimed by all handles			*/
+	bool plugged;
+};
+
+/* Completions are delivered by the context's event handler. The context
+ * is polled via an eventfd, signalled on completions and interrupts,
+ * and a timerfd, armed to the next event of the emulated chips, so
+ * libusb_pollfds_handle_timeouts is always true							*/
+struct libusb_context {
+	int events;
+	int timer;
+	libusb_pollfd fds[2];
+	std::vector<itransfer*> done;
+};
+
+namespace usbemu {
+
+/** Emulated bus 1. All emulator state is guarded by the bus lock,
+ *  callbacks are called with the lock released							*/
+class bus {
+public:
+	static constexpr uint8_t number = 1;
+	static bus& instance() noexcept {
+		static bus the_bus;
+		return the_bus;
+	}
+
+	/** processes all ports and schedules the next event				*/
+	void process(uint64_t now) noexcept {
+		uint64_t next = never;
+		std::vector<itransfer*> done;
+		for(auto dev : devices)
+			for(auto& p : dev->emu->ports)
+				next = std::min(next, p.process(now, done));
+		deliver(done);
+		arm(next);
+	}
+
+	/** routes completed transfers to their contexts						*/
+	void deliver(const std::vector<itransfer*>& done) noexcept {
+		for(auto x : done) {
+			x->ctx->done.push_back(x);
+			signal(x->ctx);
+		}
+	}
+
+	static void signal(libusb_context* ctx) noexcept {
+		const uint64_t one = 1;
+		if( write(ctx->events, &one, sizeof(one)) < 0 ) { /* full, ok	*/ }
+	}
+
+	void arm(uint64_t next) noexcept {
+		itimerspec its = {};
+		if( next != never ) {
+			next = std::max<uint64_t>(next, 1);
+			its.it_value.tv_sec  = next / 1000000000u;
+			its.it_value.tv_nsec = next % 1000000000u;
+		}
+		for(auto ctx : contexts)
+			timerfd_settime(ctx->timer, TFD_TIMER_ABSTIME, &its, nullptr);
+	}
+
+	libusb_context* resolve(libusb_context* ctx) const noexcept {
+		return ctx ? ctx : fallback;
+	}
+
+	libusb_device* find(int address) const noexcept {
+		for(auto dev : devices)
+			if( dev->emu->address == address ) return dev;
+		return nullptr;
+	}
+
+	int plug(const char* model) noexcept {
+		chip* emu = chip::create(model);
+		if( emu == nullptr ) return LIBUSB_ERROR_NOT_FOUND;
+		while( find(address) ) address = address % 127 + 1;
+		emu->address = address;
+		address = address % 127 + 1;
+		devices.push_back(new libusb_device { emu, nullptr, 1, 0, true });
+		return emu->address;
+	}
+
+	int unplug(int addr) noexcept {
+		libusb_device* dev = find(addr);
+		if( dev == nullptr ) return LIBUSB_ERROR_NOT_FOUND;
+		std::vector<itransfer*> done;
+		for(auto& p : dev->emu->ports)
+			p.fail(LIBUSB_TRANSFER_NO_DEVICE, done);
+		deliver(done);
+		dev->plugged = false;
+		devices.erase(std::find(devices.begin(), devices.end(), dev));
+		unref(dev);
+		return LIBUSB_SUCCESS;
+	}
+
+	void unref(libusb_device* dev) noexcept {
+		if( --dev->refs ) return;
+		delete dev->emu;
+		delete dev;
+	}
+
+	/** plugs chips listed in USBEMU_DEVICES, once						*/
+	void populate() noexcept {
+		if( populated ) return;
+		populated = true;
+		const char* list = getenv("USBEMU_DEVICES");
+		if( list == nullptr ) return;
+		char model[32];
+		while( *list ) {
+			size_t len = strcspn(list, ",");
+			if( len && len < sizeof(model) ) {
+				memcpy(model, list, len);
+				model[len] = 0;
+				if( plug(model) < 0 )
+					fprintf(stderr, "usbemu: unknown model %s\n", model);
+			}
+			list += len + (list[len] ? 1 : 0);
+		}
+	}
+
+	std::mutex lock;
+	std::vector<libusb_device*> devices;
+	std::vector<libusb_context*> contexts;
+	libusb_context* fallback = nullptr;	/* default context				*/
+private:
+	uint8_t address = 1;
+	bool populated = false;
+};
+
+static port* endpoint(libusb_device_handle* handle, uint8_t ep) noexcept {
+	for(auto& p : handle->dev->emu->ports)
+		if( p.model.ep_in == ep || p.model.ep_out == ep ) return &p;
+	return nullptr;
+}
+
+}
+
+extern "C" {
+
+int usbemu_plug(const char* model) {
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	return b.plug(model);
+}
+
+int usbemu_unplug(int address) {
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	return b.unplug(address);
+}
+
+int usbemu_getstats(int address, int port, usbemu_stats* stats) {
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	libusb_device* dev = b.find(address);
+	if( dev == nullptr ) return LIBUSB_ERROR_NO_DEVICE;
+	if( port < 0 || (size_t) port >= dev->emu->ports.size() || ! stats )
+		return LIBUSB_ERROR_INVALID_PARAM;
+	b.process(nanotime());
+	*stats = dev->emu->ports[port].stats;
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_init(libusb_context **pctx) {
+	libusb_context* ctx = new libusb_context;
+	ctx->events = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ctx->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if( ctx->events < 0 || ctx->timer < 0 ) {
+		if( ctx->events >= 0 ) close(ctx->events);
+		if( ctx->timer >= 0 ) close(ctx->timer);
+		delete ctx;
+		return LIBUSB_ERROR_OTHER;
+	}
+	ctx->fds[0] = { ctx->events, POLLIN };
+	ctx->fds[1] = { ctx->timer, POLLIN };
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	b.populate();
+	b.contexts.push_back(ctx);
+	if( pctx ) *pctx = ctx;
+	else if( b.fallback == nullptr ) b.fallback = ctx;
+	return LIBUSB_SUCCESS;
+}
+
+void libusb_exit(libusb_context *ctx) {
+	bus& b(bus::instance());
+	{
+		std::lock_guard<std::mutex> guard(b.lock);
+		ctx = b.resolve(ctx);
+		if( ctx == nullptr ) return;
+		b.contexts.erase(std::find(b.contexts.begin(), b.contexts.end(), ctx));
+		if( b.fallback == ctx ) b.fallback = nullptr;
+		for(auto dev : b.devices)
+			if( dev->ctx == ctx ) dev->ctx = nullptr;
+	}
+	close(ctx->events);
+	close(ctx->timer);
+	delete ctx;
+}
+
+void libusb_set_debug(libusb_context*, int) {}
+
+const char * libusb_error_name(int code) {
+	switch( code ) {
+	case LIBUSB_SUCCESS:				return "LIBUSB_SUCCESS";
+	case LIBUSB_ERROR_IO:				return "LIBUSB_ERROR_IO";
+	case LIBUSB_ERROR_INVALID_PARAM:	return "LIBUSB_ERROR_INVALID_PARAM";
+	case LIBUSB_ERROR_ACCESS:			return "LIBUSB_ERROR_ACCESS";
+	case LIBUSB_ERROR_NO_DEVICE:		return "LIBUSB_ERROR_NO_DEVICE";
+	case LIBUSB_ERROR_NOT_FOUND:		return "LIBUSB_ERROR_NOT_FOUND";
+	case LIBUSB_ERROR_BUSY:				return "LIBUSB_ERROR_BUSY";
+	case LIBUSB_ERROR_TIMEOUT:			return "LIBUSB_ERROR_TIMEOUT";
+	case LIBUSB_ERROR_OVERFLOW:			return "LIBUSB_ERROR_OVERFLOW";
+	case LIBUSB_ERROR_PIPE:				return "LIBUSB_ERROR_PIPE";
+	case LIBUSB_ERROR_INTERRUPTED:		return "LIBUSB_ERROR_INTERRUPTED";
+	case LIBUSB_ERROR_NO_MEM:			return "LIBUSB_ERROR_NO_MEM";
+	case LIBUSB_ERROR_NOT_SUPPORTED:	return "LIBUSB_ERROR_NOT_SUPPORTED";
+	}
+	/* transfer status codes are passed here as well					*/
+	switch( code ) {
+	case LIBUSB_TRANSFER_ERROR:			return "LIBUSB_TRANSFER_ERROR";
+	case LIBUSB_TRANSFER_TIMED_OUT:		return "LIBUSB_TRANSFER_TIMED_OUT";
+	case LIBUSB_TRANSFER_CANCELLED:		return "LIBUSB_TRANSFER_CANCELLED";
+	case LIBUSB_TRANSFER_STALL:			return "LIBUSB_TRANSFER_STALL";
+	case LIBUSB_TRANSFER_NO_DEVICE:		return "LIBUSB_TRANSFER_NO_DEVICE";
+	case LIBUSB_TRANSFER_OVERFLOW:		return "LIBUSB_TRANSFER_OVERFLOW";
+	}
+	return "**UNKNOWN**";
+}
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list) {
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	ctx = b.resolve(ctx);
+	libusb_device** result = (libusb_device**)
+			calloc(b.devices.size() + 1, sizeof(libusb_device*));
+	if( result == nullptr ) return LIBUSB_ERROR_NO_MEM;
+	size_t n = 0;
+	for(auto dev : b.devices) {
+		dev->ctx = ctx;
+		++dev->refs;
+		result[n++] = dev;
+	}
+	*list = result;
+	return n;
+}
+
+void libusb_free_device_list(libusb_device **list, int unref_devices) {
+	if( list == nullptr ) return;
+	if( unref_devices ) {
+		bus& b(bus::instance());
+		std::lock_guard<std::mutex> guard(b.lock);
+		for(libusb_device** i = list; *i; ++i) b.unref(*i);
+	}
+	free(list);
+}
+
+libusb_device * libusb_ref_device(libusb_device *dev) {
+	std::lock_guard<std::mutex> guard(bus::instance().lock);
+	++dev->refs;
+	return dev;
+}
+
+void libusb_unref_device(libusb_device *dev) {
+	if( dev == nullptr ) return;
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	b.unref(dev);
+}
+
+int libusb_get_device_descriptor(libusb_device *dev,
+		struct libusb_device_descriptor *desc) {
+	*desc = dev->emu->desc;
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_get_max_packet_size(libusb_device *dev, unsigned char ep) {
+	for(auto& p : dev->emu->ports)
+		if( p.model.ep_in == ep || p.model.ep_out == ep ) return p.model.mps;
+	return LIBUSB_ERROR_NOT_FOUND;
+}
+
+uint8_t libusb_get_bus_number(libusb_device*) {
+	return bus::number;
+}
+
+uint8_t libusb_get_device_address(libusb_device *dev) {
+	return dev->emu->address;
+}
+
+int libusb_open(libusb_device *dev, libusb_device_handle **handle) {
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	if( ! dev->plugged ) return LIBUSB_ERROR_NO_DEVICE;
+	libusb_context* ctx = dev->ctx ? dev->ctx : b.fallback;
+	if( ctx == nullptr ) return LIBUSB_ERROR_NOT_FOUND;
+	++dev->refs;
+	*handle = new libusb_device_handle { dev, ctx, 0 };
+	return LIBUSB_SUCCESS;
+}
+
+void libusb_close(libusb_device_handle *handle) {
+	if( handle == nullptr ) return;
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	handle->dev->claimed &= ~handle->claimed;
+	b.unref(handle->dev);
+	delete handle;
+}
+
+libusb_device * libusb_get_device(libusb_device_handle *handle) {
+	return handle->dev;
+}
+
+int libusb_claim_interface(libusb_device_handle *handle, int num) {
+	std::lock_guard<std::mutex> guard(bus::instance().lock);
+	libusb_device* dev = handle->dev;
+	if( ! dev->plugged ) return LIBUSB_ERROR_NO_DEVICE;
+	if( num < 0 || (size_t) num >= dev->emu->ports.size() )
+		return LIBUSB_ERROR_NOT_FOUND;
+	const uint32_t bit = 1 << num;
+	if( handle->claimed & bit ) return LIBUSB_SUCCESS;
+	if( dev->claimed & bit ) return LIBUSB_ERROR_BUSY;
+	handle->claimed |= bit;
+	dev->claimed |= bit;
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_release_interface(libusb_device_handle *handle, int num) {
+	std::lock_guard<std::mutex> guard(bus::instance().lock);
+	const uint32_t bit = num >= 0 && num < 32 ? 1 << num : 0;
+	if( ! (handle->claimed & bit) ) return LIBUSB_ERROR_NOT_FOUND;
+	handle->claimed &= ~bit;
+	handle->dev->claimed &= ~bit;
+	return handle->dev->plugged ? LIBUSB_SUCCESS : LIBUSB_ERROR_NO_DEVICE;
+}
+
+int libusb_kernel_driver_active(libusb_device_handle*, int) {
+	return 0;
+}
+
+int libusb_detach_kernel_driver(libusb_device_handle*, int) {
+	return LIBUSB_ERROR_NOT_FOUND;
+}
+
+int libusb_clear_halt(libusb_device_handle *handle, unsigned char ep) {
+	std::lock_guard<std::mutex> guard(bus::instance().lock);
+	if( ! handle->dev->plugged ) return LIBUSB_ERROR_NO_DEVICE;
+	return endpoint(handle, ep) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+int libusb_control_transfer(libusb_device_handle *handle, uint8_t type,
+		uint8_t request, uint16_t value, uint16_t index, unsigned char *data,
+		uint16_t length, unsigned int) {
+	if( length && data == nullptr ) return LIBUSB_ERROR_INVALID_PARAM;
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	if( ! handle->dev->plugged ) return LIBUSB_ERROR_NO_DEVICE;
+	const uint64_t now = nanotime();
+	const int res = handle->dev->emu->control(*handle,
+			{ type, request, value, index, length }, data, now);
+	b.process(now);
+	return res;
+}
+
+struct libusb_transfer * libusb_alloc_transfer(int iso_packets) {
+	if( iso_packets < 0 ) return nullptr;
+	itransfer* x = (itransfer*) calloc(1, sizeof(itransfer) +
+			iso_packets * sizeof(libusb_iso_packet_descriptor));
+	return x ? &x->pub : nullptr;
+}
+
+void libusb_free_transfer(struct libusb_transfer *xfer) {
+	if( xfer == nullptr ) return;
+	if( xfer->flags & LIBUSB_TRANSFER_FREE_BUFFER ) free(xfer->buffer);
+	free(priv(xfer));
+}
+
+int libusb_submit_transfer(struct libusb_transfer *xfer) {
+	itransfer* x = priv(xfer);
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	libusb_device_handle* handle = xfer->dev_handle;
+	if( x->busy ) return LIBUSB_ERROR_BUSY;
+	if( ! handle->dev->plugged ) return LIBUSB_ERROR_NO_DEVICE;
+	if( xfer->type != LIBUSB_TRANSFER_TYPE_BULK )
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	port* p = endpoint(handle, xfer->endpoint);
+	if( p == nullptr ) return LIBUSB_ERROR_NOT_FOUND;
+	if( ! (handle->claimed & (1 << p->number)) )
+		p->owner.violation(*p, "transfer on unclaimed interface %d",
+				p->number);
+	p->owner.ready(*p);
+	x->ctx = handle->ctx;
+	x->owner = p;
+	x->busy = true;
+	const uint64_t now = nanotime();
+	p->submit(x, now);
+	b.process(now);
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_cancel_transfer(struct libusb_transfer *xfer) {
+	itransfer* x = priv(xfer);
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	if( ! x->busy || ! x->owner->cancel(x) ) return LIBUSB_ERROR_NOT_FOUND;
+	xfer->status = LIBUSB_TRANSFER_CANCELLED;
+	b.deliver({ x });
+	return LIBUSB_SUCCESS;
+}
+
+void libusb_interrupt_event_handler(libusb_context *ctx) {
+	bus& b(bus::instance());
+	std::lock_guard<std::mutex> guard(b.lock);
+	if( (ctx = b.resolve(ctx)) ) bus::signal(ctx);
+}
+
+int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv) {
+	bus& b(bus::instance());
+	{
+		std::lock_guard<std::mutex> guard(b.lock);
+		ctx = b.resolve(ctx);
+		if( ctx == nullptr ) return LIBUSB_ERROR_INVALID_PARAM;
+	}
+	const timespec ts = { tv->tv_sec, tv->tv_usec * 1000 };
+	pollfd fds[2] = { { ctx->events, POLLIN, 0 }, { ctx->timer, POLLIN, 0 } };
+	if( ppoll(fds, 2, &ts, nullptr) < 0 && errno != EINTR )
+		return LIBUSB_ERROR_IO;
+	uint64_t count;
+	if( read(ctx->events, &count, sizeof(count)) < 0 ) { /* not signalled */ }
+	if( read(ctx->timer, &count, sizeof(count)) < 0 ) { /* not expired */ }
+	std::vector<itransfer*> done;
+	{
+		std::lock_guard<std::mutex> guard(b.lock);
+		b.process(nanotime());
+		done.swap(ctx->done);
+		for(auto x : done) x->busy = false;
+	}
+	for(auto x : done) {
+		const bool release = x->pub.flags & LIBUSB_TRANSFER_FREE_TRANSFER;
+		if( x->pub.callback ) x->pub.callback(&x->pub);
+		if( release ) libusb_free_transfer(&x->pub);
+	}
+	return LIBUSB_SUCCESS;
+}
+
+int libusb_handle_events(libusb_context *ctx) {
+	timeval tv = { 60, 0 };
+	return libusb_handle_events_timeout(ctx, &tv);
+}
+
+int libusb_pollfds_handle_timeouts(libusb_context*) {
+	return 1;
+}
+
+int libusb_get_next_timeout(libusb_context*, struct timeval*) {
+	return 0;
+}
+
+const struct libusb_pollfd ** libusb_get_pollfds(libusb_context *ctx) {
+	ctx = bus::instance().resolve(ctx);
+	const libusb_pollfd** list = (const libusb_pollfd**)
+			calloc(3, sizeof(libusb_pollfd*));
+	if( list && ctx ) {
+		list[0] = &ctx->fds[0];
+		list[1] = &ctx->fds[1];
+	}
+	return list;
+}
+
+void libusb_free_pollfds(const struct libusb_pollfd **pollfds) {
+	free(pollfds);
+}
+
+}
@@ -0,0 +1,181 @@
+/** @brief emulator of Prolific PL2303 chips
+ *  @file  pl2303_chip.cpp
+ *  @addtogroup emu
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cstring>
+#include <endian.h>
+#include "emu.hpp"
+
+namespace usbemu {
+
+/**
+ * PL2303 and PL2303HX. Line settings are CDC ACM class requests, the
+ * vendor requests of the initialization sequence are checked step by step
+ * against the sequence of pl2303::probe(), which differs between chip
+ * types only in the last step.
+ */
+class pl2303_chip : public chip {
+public:
+	static constexpr uint8_t vendor_reqo = 0x40;
+	static constexpr uint8_t vendor_reqi = 0xC0;
+	static constexpr uint8_t class_reqo = 0x21;
+	static constexpr uint8_t class_reqi = 0xA1;
+	static constexpr uint8_t vendor_rq = 0x01;
+	static constexpr uint8_t reset_rd_rq = 0x08;
+	static constexpr uint8_t reset_wr_rq = 0x09;
+	static constexpr uint8_t set_line_coding = 0x20;
+	static constexpr uint8_t get_line_coding = 0x21;
+	static constexpr uint8_t set_control_line_state = 0x22;
+	static constexpr uint8_t send_break = 0x23;
+	static constexpr unsigned line_coding_size = 7;
+
+	struct step {
+		uint8_t  type;
+		uint16_t value;
+		uint16_t index;
+	};
+
+	pl2303_chip(const char* model, const libusb_device_descriptor& d,
+		const port_model* models, bool _hx) noexcept
+	  : chip(model, d, models, 1), hx(_hx), next(0) {}
+
+	int control(const libusb_device_handle& handle, const setup& req,
+			uint8_t* data, uint64_t now) noexcept {
+		port& p(ports[0]);
+		if( req.type == vendor_reqo || req.type == vendor_reqi ) {
+			switch( req.request ) {
+			case vendor_rq:
+				probe(p, req);
+				if( req.type == vendor_reqo ) return 0;
+				if( req.length < 1 ) return 0;
+				data[0] = 0;
+				return 1;
+			case reset_rd_rq:
+			case reset_wr_rq:
+				if( req.type != vendor_reqo ) break;
+				if( ! hx )
+					violation(p, "reset request %d on a legacy chip",
+						req.request);
+				if( req.request == reset_rd_rq )
+					p.purge_rx(now);
+				else
+					p.purge_tx(now);
+				return 0;
+			}
+			return stall(p, req);
+		}
+		port* ifc = nullptr;
+		if( req.type == class_reqo || req.type == class_reqi )
+			ifc = interface(handle, req.index);
+		if( ifc == nullptr ) return stall(p, req);
+		if( req.type == class_reqo ) switch( req.request ) {
+		case set_line_coding:
+			if( req.length != line_coding_size ) break;
+			setup(*ifc, data);
+			return line_coding_size;
+		case set_control_line_state:
+		case send_break:
+			return 0;
+		}
+		if( req.type == class_reqi && req.request == get_line_coding &&
+			req.length >= line_coding_size ) {
+			const uint32_t baudrate = htole32(ifc->stats.baudrate);
+			memcpy(data, &baudrate, sizeof(baudrate));
+			data[4] = ifc->stats.stopbits;
+			data[5] = ifc->stats.parity;
+			data[6] = ifc->stats.databits;
+			return line_coding_size;
+		}
+		return stall(*ifc, req);
+	}
+
+private:
+	/* checks a vendor request against the initialization sequence		*/
+	void probe(port& p, const setup& req) noexcept {
+		static constexpr const step sequence[] = {
+			{ vendor_reqi, 0x8484, 0 },
+			{ vendor_reqo, 0x0404, 0 },
+			{ vendor_reqi, 0x8484, 0 },
+			{ vendor_reqi, 0x8383, 0 },
+			{ vendor_reqi, 0x8484, 0 },
+			{ vendor_reqo, 0x0404, 1 },
+			{ vendor_reqi, 0x8484, 0 },
+			{ vendor_reqi, 0x8383, 0 },
+			{ vendor_reqo, 0x0000, 1 },
+			{ vendor_reqo, 0x0001, 0 },
+			{ vendor_reqo, 0x0002, 0 }, /* index is chip specific		*/
+		};
+		static constexpr unsigned last = sizeof(sequence)/sizeof(*sequence)-1;
+		if( next > last ) return;
+		step expected = sequence[next];
+		if( next == last ) expected.index = hx ? 0x44 : 0x24;
+		if( req.type == expected.type && req.value == expected.value &&
+			req.index == expected.index ) {
+			++next;
+			return;
+		}
+		violation(p, "init step %d is %s %04x,%04x, expected %s %04x,%04x",
+			next, req.type == vendor_reqi ? "read" : "write",
+			req.value, req.index,
+			expected.type == vendor_reqi ? "read" : "write",
+			expected.value, expected.index);
+		next = last + 1;
+	}
+
+	void setup(port& p, const uint8_t* data) noexcept {
+		uint32_t baudrate;
+		memcpy(&baudrate, data, sizeof(baudrate));
+		baudrate = le32toh(baudrate);
+		const uint8_t stopbits = data[4];
+		const uint8_t parity = data[5];
+		const uint8_t databits = data[6];
+		const uint32_t limit = hx ? 12000000 : 1228800;
+		if( baudrate == 0 || baudrate > limit )
+			violation(p, "baud rate %u out of range", baudrate);
+		if( databits < 5 || databits > 8 )
+			violation(p, "invalid data bits %d", databits);
+		if( parity > 4 )
+			violation(p, "invalid parity %d", parity);
+		if( stopbits > 2 )
+			violation(p, "invalid stop bits %d", stopbits);
+		p.configure(baudrate, databits, parity, stopbits);
+	}
+
+	const bool hx;
+	unsigned next;	/* next step of the initialization sequence			*/
+};
+
+chip* pl2303(const char* model) noexcept {
+	static constexpr const port_model ports[] = {
+		{ 0x83, 0x02, 64, 256, 256 }
+	};
+	/* USB serial drivers tell the chip type by bDeviceClass and
+	 * bMaxPacketSize0, HX chips report class 0 and 64 byte packets		*/
+	if( strcmp(model, "pl2303") == 0 )
+		return new pl2303_chip("pl2303", { 18, LIBUSB_DT_DEVICE, 0x0110, 0x00,
+			0, 0, 8, 0x067b, 0x2303, 0x0202, 1, 2, 0, 1 }, ports, false);
+	if( strcmp(model, "pl2303hx") == 0 )
+		return new pl2303_chip("pl2303hx", { 18, LIBUSB_DT_DEVICE, 0x0110, 0x00,
+			0, 0, 64, 0x067b, 0x2303, 0x0300, 1, 2, 0, 1 }, ports, true);
+	return nullptr;
+}
+
+}
@@ -0,0 +1,286 @@
+/** @brief emulated UART port with a loopback plug
+ *  @file  port.cpp
+ *  @addtogroup emu
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include "emu.hpp"
+
+namespace usbemu {
+
+port::port(chip& _owner, uint8_t _number, const port_model& _model) noexcept
+  : owner(_owner)
+  , number(_number)
+  , model(_model)
+  , stats()
+  , last(0)
+  , since(0)
+  , overrun(false)
+  , chartime(0)
+  , linefree(0)
+  , accepted(0)
+  , dropping(false) {
+	configure(9600, 8, 0, 0);
+}
+
+void port::configure(uint32_t baudrate, uint8_t databits, uint8_t parity,
+		uint8_t stopbits) noexcept {
+	stats.baudrate = baudrate;
+	stats.databits = databits;
+	stats.parity   = parity;
+	stats.stopbits = stopbits;
+	/* character length in half bits: start, data, parity and stop bits	*/
+	const unsigned halfbits = 2 * (1 + databits + (parity ? 1 : 0)) +
+			(stopbits == 0 ? 2 : stopbits == 1 ? 3 : 4);
+	chartime = baudrate ? halfbits * 500000000ull / baudrate : frame;
+	if( chartime == 0 ) chartime = 1;
+}
+
+void port::submit(itransfer* xfer, uint64_t now) noexcept {
+	libusb_transfer& t(xfer->pub);
+	t.actual_length = 0;
+	xfer->deadline = t.timeout ? now + t.timeout * 1000000ull : never;
+	if( t.endpoint & LIBUSB_ENDPOINT_IN )
+		ins.push_back(xfer);
+	else
+		outs.push_back(xfer);
+}
+
+bool port::cancel(itransfer* xfer) noexcept {
+	auto i = std::find(ins.begin(), ins.end(), xfer);
+	if( i != ins.end() ) {
+		ins.erase(i);
+		return true;
+	}
+	i = std::find(outs.begin(), outs.end(), xfer);
+	if( i == outs.end() ) return false;
+	if( i == outs.begin() ) {
+		xfer->pub.actual_length = accepted;
+		accepted = 0;
+	}
+	outs.erase(i);
+	return true;
+}
+
+void port::complete(itransfer* xfer, libusb_transfer_status status,
+		std::vector<itransfer*>& done) noexcept {
+	xfer->pub.status = status;
+	done.push_back(xfer);
+}
+
+void port::fail(libusb_transfer_status status,
+		std::vector<itransfer*>& done) noexcept {
+	for(auto x : ins) complete(x, status, done);
+	for(auto x : outs) complete(x, status, done);
+	ins.clear();
+	outs.clear();
+	accepted = 0;
+}
+
+void port::purge_rx(uint64_t now) noexcept {
+	arrive(now);
+	rx.clear();
+	overrun = false;
+}
+
+void port::purge_tx(uint64_t now) noexcept {
+	arrive(now);
+	wire.clear();
+	segments.clear();
+	linefree = now;
+}
+
+/* moves bytes transmitted by now from the wire to the RX FIFO			*/
+void port::arrive(uint64_t now) noexcept {
+	while( segments.size() ) {
+		segment& s(segments.front());
+		if( now < s.begin + s.chartime ) break;
+		const uint32_t n = std::min<uint64_t>(s.count,
+				(now - s.begin) / s.chartime);
+		for(uint32_t i = 0; i < n; ++i) {
+			const uint8_t c = wire.front();
+			wire.pop_front();
+			if( rx.size() >= model.rxfifo ) {
+				++stats.dropped;
+				if( ! dropping ) ++stats.overruns;
+				dropping = overrun = true;
+				continue;
+			}
+			dropping = false;
+			if( rx.empty() ) since = s.begin + (i + 1) * s.chartime;
+			rx.push_back(c);
+		}
+		s.begin += n * s.chartime;
+		if( (s.count -= n) == 0 ) segments.pop_front();
+	}
+}
+
+/* returns time when n more bytes arrive, or never						*/
+uint64_t port::arrival(size_t n) const noexcept {
+	for(auto& s : segments) {
+		if( n <= s.count ) return s.begin + n * s.chartime;
+		n -= s.count;
+	}
+	return never;
+}
+
+void port::transmit(const uint8_t* data, size_t size, uint64_t now) noexcept {
+	if( size == 0 ) return;
+	const uint64_t begin = std::max(now, linefree);
+	if( segments.size() && segments.back().chartime == chartime &&
+		segments.back().begin + segments.back().count * chartime == begin )
+		segments.back().count += size;
+	else
+		segments.push_back({ begin, chartime, (uint32_t) size });
+	wire.insert(wire.end(), data, data + size);
+	linefree = begin + size * chartime;
+	stats.tx_bytes += size;
+}
+
+/* moves data of OUT transfers to the TX FIFO, a transfer completes when
+ * its last byte is accepted												*/
+uint64_t port::feed(uint64_t now, std::vector<itransfer*>& done) noexcept {
+	while( outs.size() ) {
+		itransfer* x = outs.front();
+		libusb_transfer& t(x->pub);
+		const size_t room = model.txfifo > wire.size() ?
+				model.txfifo - wire.size() : 0;
+		const size_t n = std::min<size_t>(room, t.length - accepted);
+		transmit(t.buffer + accepted, n, now);
+		accepted += n;
+		if( (int) accepted < t.length && x->deadline > now ) {
+			/* wait until the rest, up to the whole FIFO, fits		*/
+			const size_t want = std::min<size_t>(t.length - accepted,
+					model.txfifo);
+			return std::min(x->deadline,
+					arrival(wire.size() - (model.txfifo - want)));
+		}
+		t.actual_length = accepted;
+		accepted = 0;
+		outs.pop_front();
+		complete(x, t.actual_length < t.length ?
+			LIBUSB_TRANSFER_TIMED_OUT : LIBUSB_TRANSFER_COMPLETED, done);
+	}
+	return never;
+}
+
+/* fills IN transfers with packets, a transfer completes on a short packet,
+ * when it is full, or on overflow										*/
+uint64_t port::fill(uint64_t now, std::vector<itransfer*>& done) noexcept {
+	const size_t payload = model.mps - owner.headsize();
+	while( ins.size() ) {
+		itransfer* x = ins.front();
+		libusb_transfer& t(x->pub);
+		if( rx.size() < payload && now < owner.flush(*this) ) {
+			if( x->deadline > now ) {
+				uint64_t next = std::min(owner.flush(*this),
+						arrival(payload - rx.size()));
+				if( rx.empty() ) next = std::min(next, arrival(1));
+				return std::min(next, x->deadline);
+			}
+			ins.pop_front();
+			complete(x, LIBUSB_TRANSFER_TIMED_OUT, done);
+			continue;
+		}
+		uint8_t head[8];
+		const unsigned h = owner.header(*this, head);
+		const size_t n = std::min(rx.size(), payload);
+		const size_t space = t.length - t.actual_length;
+		const size_t size = std::min(h + n, space);
+		uint8_t* dst = t.buffer + t.actual_length;
+		memcpy(dst, head, std::min<size_t>(h, size));
+		if( size > h ) std::copy_n(rx.begin(), size - h, dst + h);
+		rx.erase(rx.begin(), rx.begin() + n);
+		t.actual_length += size;
+		last = now;
+		if( rx.size() ) since = now;
+		++stats.packets;
+		if( size > h ) stats.rx_bytes += size - h;
+		if( h + n > space ) {
+			++stats.overflows;
+			stats.dropped += n - (size > h ? size - h : 0);
+			ins.pop_front();
+			complete(x, LIBUSB_TRANSFER_OVERFLOW, done);
+			continue;
+		}
+		if( h + n < model.mps || t.actual_length == t.length ) {
+			ins.pop_front();
+			complete(x, LIBUSB_TRANSFER_COMPLETED, done);
+		}
+	}
+	return never;
+}
+
+uint64_t port::process(uint64_t now, std::vector<itransfer*>& done) noexcept {
+	arrive(now);
+	const uint64_t next = feed(now, done);
+	return std::min(next, fill(now, done));
+}
+
+chip::chip(const char* model, const libusb_device_descriptor& d,
+		const port_model* models, unsigned count) noexcept
+  : name(model), desc(d), address(0) {
+	ports.reserve(count);
+	for(unsigned i = 0; i < count; ++i)
+		ports.emplace_back(*this, i, models[i]);
+}
+
+/* chips without a latency timer send data as soon as the host polls,
+ * which is modelled as the start of the next frame						*/
+uint64_t chip::flush(const port& p) const noexcept {
+	return p.fifo() ? (p.since / frame + 1) * frame : never;
+}
+
+void chip::violation(port& p, const char* fmt, ...) noexcept {
+	++p.stats.violations;
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "usbemu: %s %03d/%03d.%d: ", name, 1, address, p.number);
+	vfprintf(stderr, fmt, args);
+	fputc('\n', stderr);
+	va_end(args);
+}
+
+int chip::stall(port& p, const setup& req) noexcept {
+	++p.stats.stalls;
+	violation(p, "unexpected request %02x,%02x,%04x,%04x,%d", req.type,
+			req.request, req.value, req.index, req.length);
+	return LIBUSB_ERROR_PIPE;
+}
+
+port* chip::interface(const libusb_device_handle& handle, uint16_t index)
+		noexcept {
+	const uint8_t num = index & 0xFF;
+	if( num >= ports.size() ) return nullptr;
+	if( ! (handle.claimed & (1 << num)) )
+		violation(ports[num], "request to unclaimed interface %d", num);
+	return &ports[num];
+}
+
+chip* chip::create(const char* model) noexcept {
+	if( chip* c = ftdi(model) ) return c;
+	if( chip* c = pl2303(model) ) return c;
+	return ch34x(model);
+}
+
+}
@@ -0,0 +1,81 @@
+/** @brief Control interface of the USB-UART chip emulator.
+ *  @file usbemu.h
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* libusbemu implements the subset of libusb-1.0 API used by USBUART on top
+ * of emulated USB-UART chips. An application linked with libusbemu instead
+ * of libusb sees the emulated chips on bus 1. Each chip port has a loopback
+ * plug: bytes sent by the host are transmitted at the configured line rate
+ * and received back into the port's RX FIFO.
+ *
+ * Chips may be plugged with usbemu_plug or listed, comma separated, in
+ * USBEMU_DEVICES environment variable, e.g. USBEMU_DEVICES=ft232r,ch340
+ * Supported models: ft232r, ft2232h, ft4232h, pl2303, pl2303hx, ch340
+ *
+ * Vendor and class control requests are validated against the chip
+ * protocol, unexpected requests are stalled, and every deviation is
+ * counted as a violation and reported to stderr.							*/
+
+#ifndef USBEMU_H_
+#define USBEMU_H_
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdint.h>
+#endif
+
+/** Emulated port state and counters										*/
+struct usbemu_stats {
+	uint32_t baudrate;		/**< actual baud rate set by the host			*/
+	uint8_t  databits;		/**< data bits set by the host					*/
+	uint8_t  parity;		/**< parity, as in eia_tia_232_info				*/
+	uint8_t  stopbits;		/**< stop bits, as in eia_tia_232_info			*/
+	uint8_t  flowcontrol;	/**< chip specific flow control bits			*/
+	uint64_t tx_bytes;		/**< bytes accepted from OUT transfers			*/
+	uint64_t rx_bytes;		/**< payload bytes delivered in IN transfers	*/
+	uint64_t dropped;		/**< bytes lost on RX FIFO overrun				*/
+	uint32_t overruns;		/**< RX FIFO overrun events						*/
+	uint32_t packets;		/**< IN packets sent to the host				*/
+	uint32_t overflows;		/**< IN packets exceeding transfer buffer		*/
+	uint32_t stalls;		/**< stalled control requests					*/
+	uint32_t violations;	/**< protocol violations						*/
+};
+
+/** Plugs a new emulated chip.
+ * @param	model - chip model name
+ * @returns device address on bus 1 or a negative libusb error code
+ */
+extern int usbemu_plug(const char* model);
+
+/** Unplugs an emulated chip, its transfers complete with NO_DEVICE.
+ * @returns 0 on success or a negative libusb error code
+ */
+extern int usbemu_unplug(int address);
+
+/** Retrieves state and counters of an emulated chip port.
+ * @returns 0 on success or a negative libusb error code
+ */
+extern int usbemu_getstats(int address, int port, struct usbemu_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -94,6 +94,234 @@ struct device_id {
 	uint8_t  ifc;							/**< Interface number 			*/
 };
 
+/** Receive timestamp options.												*/
+typedef enum timestamp_enum {
+	ts_monotonic = 0,						/**< CLOCK_MONOTONIC only		*/
+	ts_tai		 = 1,						/**< also capture CLOCK_TAI		*/
+	ts_per_byte	 = 2,						/**< interpolate per-byte times	*/
+	ts_exclusive = 4						/**< data is not written to pipe*/
+} timestamp_t;
+
+/** Replay mode flags.														*/
+typedef enum replay_enum {
+	replay_fast	  = 0,					/**< deliver as fast as possible	*/
+	replay_timed  = 1,					/**< keep the captured timing		*/
+	replay_repeat = 2					/**< restart at the end of capture	*/
+} replay_t;
+
+/** Timestamp of a chunk of received data.									*/
+struct rx_timestamp {
+	uint64_t monotonic;				/**< CLOCK_MONOTONIC at completion, ns	*/
+	uint64_t tai;					/**< CLOCK_TAI at completion, ns, or 0	*/
+	uint64_t offset;				/**< chunk offset in the RX byte stream	*/
+	uint32_t length;				/**< chunk length						*/
+	uint32_t byte_time;				/**< character time, ns, or 0			*/
+};
+
+/** Returns interpolated arrival time (CLOCK_MONOTONIC, ns) of i-th byte
+ * in the chunk. The last byte of chunk is assumed to arrive at completion
+ */
+static inline uint64_t usbuart_byte_time(const struct rx_timestamp* ts,
+		uint32_t i) {
+	return ts->monotonic - (uint64_t)(ts->length - 1 - i) * ts->byte_time;
+}
+
+/** Receive callback, called from the event loop on each bulk-in completion
+ * @param	user	- user data passed to onreceive
+ * @param	data	- received data
+ * @param	size	- size of received data
+ * @param	ts		- timestamp of the data
+ */
+typedef void (*receive_cb)(void* user, const uint8_t* data, unsigned size,
+		const struct rx_timestamp* ts);
+
+/** Framing type.															*/
+typedef enum framing_enum {
+	frame_none,							/**< no framing, raw byte stream	*/
+	frame_delimiter,					/**< frames end with delimiter byte	*/
+	frame_slip,							/**< SLIP, RFC 1055					*/
+	frame_cobs,							/**< COBS, zero delimited			*/
+	frame_hdlc,							/**< HDLC-like byte stuffing		*/
+	frame_gap							/**< frames delimited by silence	*/
+} framing_t;
+
+/** Checksum type.															*/
+typedef enum crc_enum {
+	crc_none,							/**< no checksum					*/
+	crc_ccitt,							/**< CRC-16/CCITT-FALSE, big endian	*/
+	crc_modbus,							/**< CRC-16/MODBUS, little endian	*/
+	crc_32								/**< CRC-32, little endian			*/
+} crc_t;
+
+/** Framing parameters.														*/
+struct framing_info {
+	framing_t type;						/**< framing type					*/
+	uint8_t delimiter;					/**< frame_delimiter: last byte		*/
+	uint16_t max_frame;					/**< maximal frame size, 0-default	*/
+	uint16_t gap;						/**< frame_gap: silence in 1/10 of
+												character time, 0-default	*/
+	uint16_t latency;					/**< frame_gap: device latency, us,
+												0-driver default			*/
+};
+
+/** Framing counters.														*/
+struct frame_stats {
+	uint32_t frames;					/**< number of delivered frames		*/
+	uint32_t bad_crc;					/**< number of frames with bad CRC	*/
+	uint32_t dropped;					/**< number of dropped bytes		*/
+};
+
+/** Data path counters of a channel.										*/
+struct channel_stats {
+	uint64_t rx_bytes;					/**< payload bytes received			*/
+	uint64_t tx_bytes;					/**< bytes sent						*/
+	uint32_t rx_transfers;				/**< completed IN transfers			*/
+	uint32_t tx_transfers;				/**< completed OUT transfers		*/
+	uint32_t short_reads;				/**< IN transfers not filled up		*/
+	uint32_t partial_writes;			/**< partially completed OUT		*/
+	uint32_t eagain;					/**< file I/O retried on EAGAIN		*/
+	uint32_t poll_requests;				/**< file registrations for poll	*/
+	uint32_t line_errors;				/**< errors reported by the device	*/
+	uint32_t dropped;					/**< received bytes not delivered	*/
+	uint32_t recoveries;				/**< endpoint halts recovered		*/
+};
+
+/** Faults injected into transfers, see context::inject.					*/
+typedef enum fault_enum {
+	fault_stall,						/**< completion with STALL			*/
+	fault_overflow,						/**< completion with OVERFLOW		*/
+	fault_timeout,						/**< completion with TIMED_OUT		*/
+	fault_error,						/**< completion with ERROR			*/
+	fault_no_device,					/**< completion with NO_DEVICE		*/
+	fault_short_read,					/**< IN completes with fewer bytes	*/
+	fault_partial_write,				/**< OUT completes partially		*/
+	fault_submit						/**< submit fails with ERROR_IO		*/
+} fault_t;
+
+#define USBUART_FAULT_KINDS 8
+
+/** Fault injection plan of a channel.										*/
+struct fault_plan {
+	uint32_t seed;						/**< 0 - evenly spaced faults,
+											otherwise random sequence seed	*/
+	uint32_t rate[USBUART_FAULT_KINDS];	/**< per million, index is fault_t	*/
+};
+
+/** Fault injection counters of a channel.									*/
+struct fault_stats {
+	uint64_t transfers;					/**< successful completions seen	*/
+	uint32_t injected[USBUART_FAULT_KINDS];	/**< index is fault_t			*/
+};
+
+/** Latency histograms of a channel.										*/
+typedef enum latency_enum {
+	lat_rx_deliver,		/**< IN completion to write() of the data to fd		*/
+	lat_tx_pickup,		/**< fd readable to OUT submit						*/
+	lat_tx_complete		/**< OUT submit to OUT completion					*/
+} latency_t;
+
+#define USBUART_HISTOGRAM_BUCKETS 592
+
+/** Log-linear latency histogram, values are in nanoseconds.
+ * Bucket i counts values from usbuart_bucket_low(i) to
+ * usbuart_bucket_low(i+1), the last bucket also counts all larger values.
+ */
+struct latency_histogram {
+	uint64_t count;						/**< number of samples				*/
+	uint64_t sum;						/**< sum of all samples, ns			*/
+	uint32_t buckets[USBUART_HISTOGRAM_BUCKETS];
+};
+
+/** Returns the lowest value counted in i-th bucket of a histogram		*/
+static inline uint64_t usbuart_bucket_low(unsigned i) {
+	return i < 16 ? i : (uint64_t)(16 + i % 16) << (i / 16 - 1);
+}
+
+/** Returns the value below which the given fraction of samples falls,
+ * with precision of the histogram bucket
+ */
+static inline uint64_t usbuart_percentile(const struct latency_histogram* h,
+		double fraction) {
+	uint64_t rank = (uint64_t)(fraction * h->count), seen = 0;
+	unsigned i;
+	for(i = 0; i < USBUART_HISTOGRAM_BUCKETS - 1; ++i)
+		if( (seen += h->buckets[i]) > rank ) break;
+	return usbuart_bucket_low(i + 1);
+}
+
+/** Phases of a channel bring-up.											*/
+typedef enum attach_phase_enum {
+	phase_enumerate,	/**< device list enumeration and matching			*/
+	phase_open,			/**< opening the device								*/
+	phase_probe,		/**< driver probe, interface claim excluded			*/
+	phase_claim,		/**< claiming the interface							*/
+	phase_setup,		/**< line setup control transfers					*/
+	phase_init,			/**< transfer allocation and submission				*/
+	attach_phases
+} attach_phase_t;
+
+/** Bring-up timing of one attach.											*/
+struct attach_timing {
+	uint64_t phase[attach_phases];		/**< time spent in each phase, ns	*/
+};
+
+/** Bring-up timing aggregated over all attaches of the context.			*/
+struct attach_report {
+	uint32_t attaches;					/**< number of attach attempts		*/
+	uint32_t failures;					/**< number of failed attaches		*/
+	uint64_t total[attach_phases];		/**< total time of each phase, ns	*/
+	uint64_t max[attach_phases];		/**< longest time of each phase, ns	*/
+};
+
+/** Frame callback, called from the event loop on each received frame.
+ * Timestamp is of the chunk that carried the first byte of the frame,
+ * its offset and length are of the frame in the RX byte stream.
+ * @param	user	- user data passed to framing
+ * @param	frame	- decoded frame
+ * @param	size	- size of the frame
+ * @param	ts		- timestamp of the frame
+ */
+typedef void (*frame_cb)(void* user, const uint8_t* frame, unsigned size,
+		const struct rx_timestamp* ts);
+
+/** Broadcast completion callback, called once per group member.
+ * @param	user	- user data passed to broadcast
+ * @param	ch		- group member
+ * @param	status	- 0 on success or negative error code
+ * @param	sent	- number of bytes sent to this member
+ */
+typedef void (*broadcast_cb)(void* user, struct channel ch, int status,
+		unsigned sent);
+
+/** Scheduled transmission callback, called from the event loop.
+ * @param	user		- user data passed to send_at
+ * @param	ch			- channel
+ * @param	status		- 0 on success or negative error code
+ * @param	submitted	- CLOCK_MONOTONIC time of submission, ns, 0 if not
+ * @param	completed	- CLOCK_MONOTONIC time of completion, ns, 0 if not
+ */
+typedef void (*schedule_cb)(void* user, struct channel ch, int status,
+		uint64_t submitted, uint64_t completed);
+
+/** Response match specification of a transaction.
+ * The response is complete when the terminator is received or length
+ * bytes are collected, whichever comes first. With no length and no
+ * terminator, the first received chunk completes the response.		*/
+struct match_spec {
+	uint16_t length;					/**< response length, 0-any			*/
+	int16_t terminator;					/**< last byte, -1 - none			*/
+};
+
+/** Transaction completion callback, called from the event loop.
+ * @param	user	- user data passed to transact
+ * @param	ch		- channel
+ * @param	status	- 0 on success or negative error code
+ * @param	data	- response received so far
+ * @param	size	- size of the response
+ */
+typedef void (*transact_cb)(void* user, struct channel ch, int status,
+		const uint8_t* data, unsigned size);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -145,9 +373,149 @@ extern void usbuart_reset(struct channel);
 
 /** Send RS232 break signal to the USB device.							*/
 extern void usbuart_break(struct channel);
+
+/** Send one copy of data to every channel of the group.
+ * @param	group	- array of channels
+ * @param	count	- number of channels in the group
+ * @param	data	- data to send
+ * @param	size	- size of data
+ * @param	cb		- per-member completion callback, may be NULL
+ * @param	user	- user data passed to the callback
+ * @returns number of members the data was queued to or negative error code
+ */
+extern int usbuart_broadcast(const struct channel* group, unsigned count,
+		const void* data, unsigned size, broadcast_cb cb, void* user);
+
 /** Run libusb and async I/O message loops.								*/
 extern int usbuart_loop(int timeout);
 
+/** Open a stream of rx_timestamp records for the channel.
+ * @param	ch		- channel
+ * @param	fd		- destination that accepts file descriptor to read from
+ * @param	flags	- combination of timestamp_t flags
+ * @returns 0 on success or error code
+ */
+extern int usbuart_timestamps(struct channel ch, int* fd, unsigned flags);
+
+/** Set receive callback for the channel, NULL callback removes it.
+ * @param	ch		- channel
+ * @param	cb		- receive callback
+ * @param	user	- user data passed to the callback
+ * @param	flags	- combination of timestamp_t flags
+ * @returns 0 on success or error code
+ */
+extern int usbuart_onreceive(struct channel ch, receive_cb cb, void* user,
+		unsigned flags);
+
+/** Set framing for the channel, frame_none removes framing.
+ * @param	ch		- channel
+ * @param	fi		- framing parameters
+ * @param	cb		- frame callback
+ * @param	user	- user data passed to the callback
+ * @returns 0 on success or error code
+ */
+extern int usbuart_framing(struct channel ch, const struct framing_info* fi,
+		frame_cb cb, void* user);
+
+/** Encode and send a frame to the channel.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_send_frame(struct channel ch, const void* data,
+		unsigned size);
+
+/** Set checksum for the framed channel.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_checksum(struct channel ch, crc_t type);
+
+/** Get framing counters of the channel.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_framestats(struct channel ch, struct frame_stats* fs);
+
+/** Get data path counters of the channel.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_stats(struct channel ch, struct channel_stats* cs);
+
+/** Get latency histogram of the channel, optionally resetting it.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_latency(struct channel ch, latency_t which,
+		struct latency_histogram* h, int reset);
+
+/** Get bring-up timing of the channel.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_bringup(struct channel ch, struct attach_timing* t);
+
+/** Get bring-up timing aggregated over all attaches.					*/
+extern void usbuart_bringup_report(struct attach_report* r);
+
+/** Publish channel counters to a shared memory stats page.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_publish(const char* path, unsigned interval);
+
+/** Send request and wait for response inside the event loop.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_transact(struct channel ch, const void* request,
+		unsigned size, const struct match_spec* match, unsigned timeout,
+		transact_cb cb, void* user);
+
+/** Set software XON/XOFF flow control options.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_xonxoff(struct channel ch, int strip);
+
+/** Set transmit pacing lead window, microseconds, 0 disables pacing.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_pace(struct channel ch, unsigned lead);
+
+/** Capture channel traffic to a pcapng file, NULL path stops capturing.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_capture(struct channel ch, const char* path,
+		unsigned limit);
+
+/** Inject faults into transfers of the channel, NULL plan stops injecting.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_inject(struct channel ch, const struct fault_plan* plan);
+
+/** Get fault injection counters of the channel.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_faults(struct channel ch, struct fault_stats* fs);
+
+/** Set limit of in place recoveries from endpoint STALL and OVERFLOW.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_recovery(struct channel ch, unsigned limit,
+		unsigned window);
+
+/** Register an in-process loopback device, attachable by its address.
+ * @param	addr - receives the device address
+ * @param	latency - IN latency in microseconds
+ * @returns 0 on success or error code
+ */
+extern int usbuart_loopback(struct device_addr* addr, unsigned latency);
+
+/** Attach pair of file descriptors to a replay of a capture file.
+ * @param	mode - combination of replay_t flags
+ * @returns 0 on success or error code
+ */
+extern int usbuart_replay(struct channel ch, const char* path, unsigned mode,
+		const struct eia_tia_232_info* pi);
+
+/** Send data at the given CLOCK_MONOTONIC time, in nanoseconds.
+ * @returns 0 on success or error code
+ */
+extern int usbuart_send_at(struct channel ch, const void* data,
+		unsigned size, uint64_t deadline, schedule_cb cb, void* user);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 
@@ -197,6 +565,7 @@ enum class error_t {
 	pipe_error,			/**< failed to create a pipe						*/
 	out_of_memory,		/**< memory allocation failed						*/
 	jni_error,			/**< a JNI error occurred							*/
+	timed_out,			/**< operation timed out							*/
 	unknown_error		/**< other errors									*/
 };
 
@@ -273,6 +642,263 @@ public:
 	/** Send RS232 break signal to the USB device 							*/
 	int sendbreak(channel) noexcept;
 
+	/** Send one copy of data to every channel of the group.
+	 * Data is copied once and submitted as a separate OUT transfer to each
+	 * member. The callback is called from the event loop once per member.
+	 * @param	group	- array of channels
+	 * @param	count	- number of channels in the group
+	 * @param	data	- data to send
+	 * @param	size	- size of data
+	 * @param	cb		- per-member completion callback, may be nullptr
+	 * @param	user	- user data passed to the callback
+	 * @returns number of members the data was queued to or negative error
+	 */
+	int broadcast(const channel* group, unsigned count, const void* data,
+		unsigned size, broadcast_cb cb = nullptr, void* user = nullptr) noexcept;
+
+	/** Open a stream of rx_timestamp records for the channel.
+	 * Each bulk-in completion that leaves data for the channel's fd_write
+	 * produces one record. The record offset and length refer to the byte
+	 * stream written to fd_write, bytes consumed by exchanges, an exclusive
+	 * receive callback or framing are not counted.
+	 * Records are dropped if the stream is not read in time.
+	 * @param	ch		- channel
+	 * @param	fd		- destination that accepts file descriptor to read from
+	 * @param	flags	- combination of timestamp_t flags
+	 * @returns 0 on success or error code
+	 */
+	int timestamps(channel ch, int& fd, unsigned flags = ts_monotonic) noexcept;
+
+	/** Set receive callback for the channel, nullptr callback removes it.
+	 * The callback is called from the event loop on each bulk-in completion.
+	 * With ts_exclusive flag the data is consumed by the callback and
+	 * not written to the channel's fd_write.
+	 * @param	ch		- channel
+	 * @param	cb		- receive callback
+	 * @param	user	- user data passed to the callback
+	 * @param	flags	- combination of timestamp_t flags
+	 * @returns 0 on success or error code
+	 */
+	int onreceive(channel ch, receive_cb cb, void* user,
+			unsigned flags = ts_monotonic) noexcept;
+
+	/** Set framing for the channel, frame_none removes framing.
+	 * Framing runs on the event loop, received data are decoded and
+	 * delivered by frames to the callback, they are not written to
+	 * the channel's fd_write.
+	 * frame_gap framing splits the stream by silence of 3.5 characters
+	 * (or fi.gap tenths of character time) as Modbus RTU does. Silence is
+	 * detected from completion timestamps, the channel's baud rate and the
+	 * device latency (FTDI latency timer).
+	 * @param	ch		- channel
+	 * @param	fi		- framing parameters
+	 * @param	cb		- frame callback
+	 * @param	user	- user data passed to the callback
+	 * @returns 0 on success or error code
+	 */
+	int framing(channel ch, const framing_info& fi, frame_cb cb,
+			void* user = nullptr) noexcept;
+
+	/** Encode a frame with the channel's framing and send it.
+	 * The frame is sent as a separate OUT transfer.
+	 * @param	ch		- channel
+	 * @param	data	- frame payload
+	 * @param	size	- size of the payload
+	 * @returns 0 on success or error code
+	 */
+	int send_frame(channel ch, const void* data, unsigned size) noexcept;
+
+	/** Set checksum for the framed channel.
+	 * On receive, checksum trailer is verified and stripped, frames with
+	 * bad checksum are counted and dropped. On send, trailer is appended
+	 * before the frame is encoded.
+	 * @param	ch		- channel
+	 * @param	type	- checksum type, crc_none disables checksum
+	 * @returns 0 on success or error code
+	 */
+	int checksum(channel ch, crc_t type) noexcept;
+
+	/** Get framing counters of the channel.
+	 * @param	ch		- channel
+	 * @param	fs		- destination for the counters
+	 * @returns 0 on success or error code
+	 */
+	int framestats(channel ch, frame_stats& fs) noexcept;
+
+	/** Get data path counters of the channel.
+	 * Counters are updated by the event loop and read without locking.
+	 * @param	ch		- channel
+	 * @param	cs		- destination for the counters
+	 * @returns 0 on success or error code
+	 */
+	int stats(channel ch, channel_stats& cs) noexcept;
+
+	/** Get latency histogram of the channel.
+	 * Histograms are always on, samples are taken with CLOCK_MONOTONIC.
+	 * Snapshot with reset does not lose samples recorded concurrently.
+	 * @param	ch		- channel
+	 * @param	which	- histogram to get
+	 * @param	h		- destination for the histogram
+	 * @param	reset	- reset the histogram after taking the snapshot
+	 * @returns 0 on success or error code
+	 */
+	int latency(channel ch, latency_t which, latency_histogram& h,
+			bool reset = false) noexcept;
+
+	/** Get bring-up timing of the channel, recorded when it was attached.
+	 * @param	ch		- channel
+	 * @param	t		- destination for the timing
+	 * @returns 0 on success or error code
+	 */
+	int bringup(channel ch, attach_timing& t) noexcept;
+
+	/** Get bring-up timing aggregated over all attaches, including failed.
+	 * @param	r		- destination for the report
+	 */
+	void bringup_report(attach_report& r) noexcept;
+
+	/** Publish channel counters to a memory mapped stats page.
+	 * The page layout is defined in usbuart_shm.h, it is updated by the
+	 * event loop every interval, data path is not affected. Publishing
+	 * again replaces the page atomically, readers never see a partial one.
+	 * @param	path		- file to create, e.g. /dev/shm/usbuart.<pid>,
+	 * 						  nullptr stops publishing and removes the file
+	 * @param	interval	- update interval in milliseconds, 0-default
+	 * @returns 0 on success or error code
+	 */
+	int publish(const char* path, unsigned interval = 0) noexcept;
+
+	/** Send request and match response on the event loop thread.
+	 * The request is submitted as a separate OUT transfer, received data
+	 * is matched against the spec before it reaches the pipe, receive
+	 * callback or framer. Transactions on a channel run one at a time,
+	 * in the order they were queued. Callback is called exactly once.
+	 * @param	ch		- channel
+	 * @param	request	- request data
+	 * @param	size	- size of the request
+	 * @param	match	- response match specification
+	 * @param	timeout	- response timeout in milliseconds, 0-default
+	 * @param	cb		- completion callback
+	 * @param	user	- user data passed to the callback
+	 * @returns 0 if queued or error code
+	 */
+	int transact(channel ch, const void* request, unsigned size,
+			const match_spec& match, unsigned timeout, transact_cb cb,
+			void* user = nullptr) noexcept;
+
+	/** Set software XON/XOFF flow control options.
+	 * Software flow control is active on channels attached with xon_xoff
+	 * to devices that do not implement it in hardware. Received DC3/DC1
+	 * pause/resume sending, DC3/DC1 are sent when received data are
+	 * not consumed fast enough.
+	 * @param	ch		- channel
+	 * @param	strip	- remove DC1/DC3 from received data (default)
+	 * @returns 0 on success or error code
+	 */
+	int xonxoff(channel ch, bool strip) noexcept;
+
+	/** Set transmit pacing.
+	 * Paced channel meters OUT submissions to the line rate computed from
+	 * the protocol information, so that data submitted to the device
+	 * never exceed what the line drains within the lead window.
+	 * Frames and broadcasts are submitted whole, the pipe stream is split.
+	 * @param	ch		- channel
+	 * @param	lead	- lead window in microseconds, 0 disables pacing
+	 * @returns 0 on success or error code
+	 */
+	int pace(channel ch, unsigned lead) noexcept;
+
+	/** Capture channel traffic to a pcapng file.
+	 * Records received and transmitted payloads and line status changes
+	 * with link type USER0, each packet prefixed by a 4-byte header:
+	 * event (0-data, 1-line status), direction (0-rx, 1-tx) and 16-bit
+	 * line error count. The file is written through a memory mapped
+	 * window, the data path does not make a syscall per packet.
+	 * @param	ch		- channel
+	 * @param	path	- file to create, nullptr stops capturing
+	 * @param	limit	- maximal file size in bytes, 0 - no limit
+	 * @returns 0 on success or error code
+	 */
+	int capture(channel ch, const char* path, unsigned limit = 0) noexcept;
+
+	/** Inject faults into USB transfers of the channel.
+	 * Successful completions are turned, at the rates of the plan, into
+	 * STALL, OVERFLOW, TIMED_OUT, ERROR or NO_DEVICE, short reads or
+	 * partial writes, submits fail with LIBUSB_ERROR_IO. Recovery paths
+	 * may be exercised on a loopback, without unplugging hardware.
+	 * Simulated devices draw faults before moving data and preserve the
+	 * byte stream, on real devices completions are altered after the fact
+	 * and data may be lost or duplicated.
+	 * @param	ch		- channel
+	 * @param	plan	- fault rates, nullptr stops injecting
+	 * @returns 0 on success or error code
+	 */
+	int inject(channel ch, const fault_plan* plan) noexcept;
+
+	/** Get fault injection counters of the channel.
+	 * @returns 0 on success or error code
+	 */
+	int faults(channel ch, fault_stats& fs) noexcept;
+
+	/** Set limit of in place recoveries from endpoint errors.
+	 * A transfer completed with STALL or OVERFLOW does not tear the
+	 * channel down, the loop clears the halt of the endpoint and submits
+	 * the failed transfers again. When more than limit recoveries are
+	 * needed within the window, the channel is removed as before.
+	 * Transfers of send_frame, broadcast, transact and send_at resume
+	 * with their unsent part, past the limit they fail with usb_error.
+	 * By default up to 3 recoveries per 1000 ms are made.
+	 * @param	ch		- channel
+	 * @param	limit	- recoveries per window, 0 - remove on first error
+	 * @param	window	- window, milliseconds
+	 * @returns 0 on success or error code
+	 */
+	int recovery(channel ch, unsigned limit, unsigned window) noexcept;
+
+	/** Register an in-process loopback device.
+	 * The device returns every byte written to it, at the baud rate of the
+	 * channel and after the latency. It sits on virtual bus 0 and is
+	 * attached with attach or pipe by its address, each attach gets its
+	 * own instance. No USB hardware is involved.
+	 * @param	addr	- receives the device address
+	 * @param	latency	- IN latency in microseconds
+	 * @param	chunk	- transfer size in bytes, 0 - default (512)
+	 * @returns 0 on success or error code
+	 */
+	int loopback(device_addr& addr, unsigned latency = 0,
+			unsigned chunk = 0) noexcept;
+
+	/** Attach pair of file descriptors to a replay of a capture file.
+	 * The simulated device plays back received traffic of a file made by
+	 * capture through the regular receive path, OUT transfers complete
+	 * immediately. No USB hardware is involved. Captures hold payload with
+	 * chip status bytes already stripped, so the chip driver's status
+	 * handling is not replayed, only its recorded line error counts.
+	 * @param	ch		- channel
+	 * @param	path	- pcapng file made by capture
+	 * @param	mode	- combination of replay_t flags
+	 * @param	pi		- line parameters, used for timing only
+	 * @returns 0 on success or error code
+	 */
+	int replay(channel ch, const char* path, unsigned mode = replay_fast,
+			const eia_tia_232_info& pi = _115200_8N1n) noexcept;
+
+	/** Send data at the given time.
+	 * The OUT transfer is prepared in advance and submitted by the event
+	 * loop at the deadline, bypassing pacing and XOFF. Callback reports
+	 * actual submission and completion times.
+	 * @param	ch			- channel
+	 * @param	data		- data to send
+	 * @param	size		- size of the data
+	 * @param	deadline	- CLOCK_MONOTONIC time in nanoseconds
+	 * @param	cb			- completion callback
+	 * @param	user		- user data passed to the callback
+	 * @returns 0 on success or error code
+	 */
+	int send_at(channel ch, const void* data, unsigned size,
+			uint64_t deadline, schedule_cb cb = nullptr,
+			void* user = nullptr) noexcept;
+
 	/** Run libusb and async I/O message loops.
 	 * @param timeout - timeout in milliseconds
 	 */
@@ -284,6 +910,10 @@ public:
 	static context& instance() noexcept;
 	/** Set logging level 													*/
 	static loglevel_t setloglevel(loglevel_t lvl) noexcept;
+	/** Switch logging to asynchronous mode. Messages are queued as binary
+	 *  records and written by a background thread, repeated messages are
+	 *  rate limited in either mode. Returns the previous mode				*/
+	static bool setlogasync(bool async) noexcept;
 	class backend;
 private:
 	backend * const priv;
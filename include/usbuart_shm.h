@@ -0,0 +1,71 @@
+/** @brief Shared memory stats page layout of USBUART Library.
+ *  @file usbuart_shm.h
+ */
+/* Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * This file is part of USBUART Library. http://hutorny.in.ua/projects/usbuart
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#ifndef USBUART_SHM_H_
+#define USBUART_SHM_H_
+#include "usbuart.h"
+#ifdef __cplusplus
+namespace usbuart {
+#endif
+
+#define USBUART_SHM_MAGIC	0x55425355	/* "USBU"							*/
+#define USBUART_SHM_VERSION	2
+#define USBUART_SHM_SLOTS	64
+
+/** Stats page header, followed by slots of slot_size bytes each.
+ * Readers must use header_size and slot_size to locate slots, so that
+ * newer versions may extend the structures.								*/
+struct usbuart_shm_header {
+	uint32_t magic;						/**< USBUART_SHM_MAGIC				*/
+	uint32_t version;					/**< USBUART_SHM_VERSION			*/
+	uint32_t header_size;				/**< offset of the first slot		*/
+	uint32_t slot_size;					/**< size of a slot					*/
+	uint32_t slots;						/**< number of slots				*/
+	uint32_t pid;						/**< publishing process				*/
+	uint32_t interval;					/**< update interval, ms			*/
+	uint32_t reserved;
+	uint64_t updated;					/**< CLOCK_MONOTONIC of update, ns	*/
+};
+
+/** Per-channel counter block.
+ * Written by the event loop with seqlock semantics: seq is odd while
+ * the block is being updated, a reader retries until it reads the same
+ * even seq before and after copying the block.							*/
+struct usbuart_shm_slot {
+	uint32_t seq;						/**< seqlock sequence				*/
+	uint32_t active;					/**< 1 if the slot is in use		*/
+	uint64_t updated;					/**< CLOCK_MONOTONIC of update, ns	*/
+	struct channel ch;					/**< channel file descriptors		*/
+	uint16_t vid;						/**< USB vendor ID					*/
+	uint16_t pid;						/**< USB product ID					*/
+	uint8_t busid;						/**< USB bus ID						*/
+	uint8_t devid;						/**< USB device number				*/
+	uint8_t status;						/**< combination of status_t bits	*/
+	uint8_t reserved;
+	uint32_t baudrate;					/**< line baud rate					*/
+	struct channel_stats stats;			/**< data path counters				*/
+	struct frame_stats frames;			/**< framing counters				*/
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* USBUART_SHM_H_ */
@@ -62,6 +62,126 @@ int usbuart_reset(struct channel ch) {
 int usbuart_break(struct channel ch) {
 	return context::instance().sendbreak(ch);
 }
+/** sends one copy of data to every channel in the group				*/
+int usbuart_broadcast(const struct channel* group, unsigned count,
+		const void* data, unsigned size, broadcast_cb cb, void* user) {
+	return context::instance().broadcast(group, count, data, size, cb, user);
+}
+
+/** opens a stream of rx_timestamp records								*/
+int usbuart_timestamps(struct channel ch, int* fd, unsigned flags) {
+	return context::instance().timestamps(ch, *fd, flags);
+}
+
+/** sets receive callback												*/
+int usbuart_onreceive(struct channel ch, receive_cb cb, void* user,
+		unsigned flags) {
+	return context::instance().onreceive(ch, cb, user, flags);
+}
+
+/** sets framing for the channel										*/
+int usbuart_framing(struct channel ch, const struct framing_info* fi,
+		frame_cb cb, void* user) {
+	static const framing_info no_framing = { frame_none, 0, 0, 0, 0 };
+	return context::instance().framing(ch, fi ? *fi : no_framing, cb, user);
+}
+
+/** encodes and sends a frame											*/
+int usbuart_send_frame(struct channel ch, const void* data, unsigned size) {
+	return context::instance().send_frame(ch, data, size);
+}
+
+/** sets checksum for the framed channel								*/
+int usbuart_checksum(struct channel ch, crc_t type) {
+	return context::instance().checksum(ch, type);
+}
+
+/** returns framing counters											*/
+int usbuart_framestats(struct channel ch, struct frame_stats* fs) {
+	return context::instance().framestats(ch, *fs);
+}
+
+/** returns data path counters											*/
+int usbuart_stats(struct channel ch, struct channel_stats* cs) {
+	return context::instance().stats(ch, *cs);
+}
+
+/** returns latency histogram											*/
+int usbuart_latency(struct channel ch, latency_t which,
+		struct latency_histogram* h, int reset) {
+	return context::instance().latency(ch, which, *h, reset != 0);
+}
+
+/** returns bring-up timing of the channel								*/
+int usbuart_bringup(struct channel ch, struct attach_timing* t) {
+	return context::instance().bringup(ch, *t);
+}
+
+/** returns bring-up timing aggregated over all attaches				*/
+void usbuart_bringup_report(struct attach_report* r) {
+	context::instance().bringup_report(*r);
+}
+
+/** publishes channel counters to a shared memory stats page			*/
+int usbuart_publish(const char* path, unsigned interval) {
+	return context::instance().publish(path, interval);
+}
+
+/** sends request and matches response in the event loop				*/
+int usbuart_transact(struct channel ch, const void* request, unsigned size,
+		const struct match_spec* match, unsigned timeout, transact_cb cb,
+		void* user) {
+	return context::instance().transact(ch, request, size, *match, timeout,
+			cb, user);
+}
+
+/** sets software XON/XOFF flow control options						*/
+int usbuart_xonxoff(struct channel ch, int strip) {
+	return context::instance().xonxoff(ch, strip != 0);
+}
+
+/** sets transmit pacing lead window									*/
+int usbuart_pace(struct channel ch, unsigned lead) {
+	return context::instance().pace(ch, lead);
+}
+
+/** attaches channel to a replay of a capture file						*/
+int usbuart_replay(struct channel ch, const char* path, unsigned mode,
+		const struct eia_tia_232_info* pi) {
+	return context::instance().replay(ch, path, mode, pi ? *pi : _115200_8N1n);
+}
+
+/** registers an in-process loopback device							*/
+int usbuart_loopback(struct device_addr* addr, unsigned latency) {
+	return context::instance().loopback(*addr, latency, 0);
+}
+
+/** starts or stops traffic capture of the channel						*/
+int usbuart_capture(struct channel ch, const char* path, unsigned limit) {
+	return context::instance().capture(ch, path, limit);
+}
+
+/** starts or stops fault injection into transfers of the channel		*/
+int usbuart_inject(struct channel ch, const struct fault_plan* plan) {
+	return context::instance().inject(ch, plan);
+}
+
+/** returns fault injection counters									*/
+int usbuart_faults(struct channel ch, struct fault_stats* fs) {
+	return context::instance().faults(ch, *fs);
+}
+
+/** sets limit of in place recoveries from endpoint errors				*/
+int usbuart_recovery(struct channel ch, unsigned limit, unsigned window) {
+	return context::instance().recovery(ch, limit, window);
+}
+
+/** submits data at the deadline										*/
+int usbuart_send_at(struct channel ch, const void* data, unsigned size,
+		uint64_t deadline, schedule_cb cb, void* user) {
+	return context::instance().send_at(ch, data, size, deadline, cb, user);
+}
+
 /** run libusb and async I/O message loops								*/
 int usbuart_loop(int timeout) {
 	return context::instance().loop(timeout);
@@ -0,0 +1,161 @@
+/** @brief traffic capture to a pcapng file
+ *  @file  capture.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "usbuart.hpp"
+#include "capture.hpp"
+
+namespace usbuart {
+
+static inline std::size_t pad4(std::size_t n) noexcept {
+	return (n + 3) & ~std::size_t(3);
+}
+
+static inline uint8_t* put32(uint8_t* p, uint32_t v) noexcept {
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline uint8_t* put16(uint8_t* p, uint16_t v) noexcept {
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+capture_file::capture_file(const char* _path, std::size_t _limit)
+															throw(error_t)
+  : path(_path)
+  , limit(_limit)
+  , epoch(nanotime(CLOCK_REALTIME) - nanotime())
+  , fd(::open(_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+  , map(nullptr)
+  , base(0)
+  , mapped(0)
+  , pos(0)
+  , lost(0)
+  , failed(false) {
+	if( fd < 0 ) {
+		log.e(__,"open %s fail: %s", _path, strerror(errno));
+		throw error_t::io_error;
+	}
+	static constexpr uint32_t shb_size = 28, idb_size = 32;
+	uint8_t* p = reserve(shb_size + idb_size);
+	if( p == nullptr ) {
+		::close(fd);
+		unlink(_path);
+		throw error_t::io_error;
+	}
+	p = put32(p, pcapng::shb);
+	p = put32(p, shb_size);
+	p = put32(p, pcapng::bom);
+	p = put16(p, 1);						/* major version			*/
+	p = put16(p, 0);						/* minor version			*/
+	p = put32(p, UINT32_MAX);				/* section length unknown	*/
+	p = put32(p, UINT32_MAX);
+	p = put32(p, shb_size);
+
+	p = put32(p, pcapng::idb);
+	p = put32(p, idb_size);
+	p = put16(p, pcapng::linktype_user0);
+	p = put16(p, 0);
+	p = put32(p, 0);						/* no snap length			*/
+	p = put16(p, pcapng::if_tsresol);
+	p = put16(p, 1);
+	p = put32(p, 9);						/* nanoseconds, padded		*/
+	p = put32(p, 0);						/* opt_endofopt				*/
+	put32(p, idb_size);
+}
+
+capture_file::~capture_file() noexcept {
+	if( map ) munmap(map, mapped);
+	if( ftruncate(fd, pos) )
+		log.w(__,"truncate %s fail: %s", path.c_str(), strerror(errno));
+	::close(fd);
+	if( lost )
+		log.w(__,"capture %s dropped %u packets", path.c_str(), lost);
+}
+
+bool capture_file::remap(std::size_t size) noexcept {
+	static const std::size_t page = sysconf(_SC_PAGESIZE);
+	if( map ) munmap(map, mapped);
+	map = nullptr;
+	base = pos & ~(page - 1);
+	mapped = window_size;
+	if( pos - base + size > mapped )
+		mapped = (pos - base + size + page - 1) & ~(page - 1);
+	if( limit && base + mapped > limit )
+		mapped = limit - base;
+	void* m = MAP_FAILED;
+	if( ftruncate(fd, base + mapped) == 0 )
+		m = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base);
+	if( m == MAP_FAILED ) {
+		log.e(__,"mapping %s fail: %s", path.c_str(), strerror(errno));
+		mapped = 0;
+		return false;
+	}
+	map = static_cast<uint8_t*>(m);
+	return true;
+}
+
+uint8_t* capture_file::reserve(std::size_t size) noexcept {
+	if( failed || (limit && pos + size > limit) ) return nullptr;
+	if( map == nullptr || pos + size > base + mapped )
+		if( (failed = ! remap(size)) ) return nullptr;
+	uint8_t* p = map + (pos - base);
+	pos += size;
+	return p;
+}
+
+void capture_file::packet(event_t ev, direction_t dir, uint64_t time,
+		uint16_t errors, const void* data, std::size_t size) noexcept {
+	const std::size_t length = pcapng::pseudo_header + size;
+	const uint32_t total = pcapng::epb_size + pad4(length);
+	uint8_t* p = reserve(total);
+	if( p == nullptr ) {
+		++lost;
+		return;
+	}
+	time += epoch;
+	p = put32(p, pcapng::epb);
+	p = put32(p, total);
+	p = put32(p, 0);						/* interface id				*/
+	p = put32(p, time >> 32);
+	p = put32(p, time);
+	p = put32(p, length);
+	p = put32(p, length);
+	*p++ = ev;
+	*p++ = dir;
+	p = put16(p, errors);
+	memcpy(p, data, size);
+	p += size;
+	for(std::size_t n = length; n & 3; ++n) *p++ = 0;
+	p = put16(p, pcapng::epb_flags);
+	p = put16(p, 4);
+	p = put32(p, dir == dir_tx ? pcapng::outbound : pcapng::inbound);
+	p = put32(p, 0);						/* opt_endofopt				*/
+	put32(p, total);
+}
+
+}
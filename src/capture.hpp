@@ -0,0 +1,88 @@
+/** @brief traffic capture to a pcapng file
+ *  @file  capture.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef CAPTURE_HPP_
+#define CAPTURE_HPP_
+#include <string>
+
+namespace usbuart {
+
+/** pcapng block types and options used by capture and replay				*/
+namespace pcapng {
+	static constexpr uint32_t shb = 0x0A0D0D0A;
+	static constexpr uint32_t idb = 0x00000001;
+	static constexpr uint32_t epb = 0x00000006;
+	static constexpr uint32_t bom = 0x1A2B3C4D;
+	static constexpr uint16_t linktype_user0 = 147;
+	static constexpr uint16_t if_tsresol = 9;
+	static constexpr uint16_t epb_flags  = 2;
+	static constexpr uint32_t inbound  = 1;
+	static constexpr uint32_t outbound = 2;
+	static constexpr std::size_t epb_size = 44; /* without packet data	*/
+	static constexpr std::size_t pseudo_header = 4;
+}
+
+/**
+ * Channel traffic capture in pcapng format, link type USER0 (147).
+ * Every packet starts with a 4-byte pseudo header:
+ *  byte 0 - event, 0 - payload, 1 - line status (payload carries the raw
+ *  		 driver status bytes, e.g. FTDI modem and line status)
+ *  byte 1 - direction, 0 - received, 1 - transmitted
+ *  byte 2,3 - line error count of the driver, little endian, low 16 bits
+ * Direction is also reported in epb_flags, timestamps have ns resolution.
+ * The file is written through a memory mapped window, so recording a packet
+ * is a memcpy, the window is moved with a syscall once per window_size.
+ * Used by the event loop thread only
+ */
+class capture_file {
+public:
+	enum event_t : uint8_t { ev_data, ev_status };
+	enum direction_t : uint8_t { dir_rx, dir_tx };
+	static constexpr std::size_t window_size = 1 << 20;
+	/** creates capture file, limit - maximal file size, 0 - no limit	*/
+	capture_file(const char* path, std::size_t limit) throw(error_t);
+	~capture_file() noexcept;
+	/** records a packet, time - CLOCK_MONOTONIC in nanoseconds			*/
+	void packet(event_t ev, direction_t dir, uint64_t time, uint16_t errors,
+			const void* data, std::size_t size) noexcept;
+	/** returns number of packets that did not fit in the limit			*/
+	inline unsigned dropped() const noexcept { return lost; }
+private:
+	/** returns pointer to size bytes at the write position or nullptr	*/
+	uint8_t* reserve(std::size_t size) noexcept;
+	bool remap(std::size_t size) noexcept;
+	const std::string path;
+	const std::size_t limit;
+	const uint64_t epoch;		/* CLOCK_REALTIME - CLOCK_MONOTONIC		*/
+	int fd;
+	uint8_t* map;
+	std::size_t base;			/* file offset of the mapped window		*/
+	std::size_t mapped;			/* size of the mapped window			*/
+	std::size_t pos;			/* file offset of the write position	*/
+	unsigned lost;
+	bool failed;				/* mapping failed, capture stopped		*/
+};
+
+}
+
+#endif /* CAPTURE_HPP_ */
@@ -3,6 +3,7 @@
  *  @addtogroup core
  *  Implementation of core functionality.
  *  Core files: @files core.cpp capi.cpp generic.cpp usbuart.hpp
+ *  Framing: @files framing.cpp framing.hpp scan.hpp timer.cpp crc.cpp
  *
  *  Device drivers: @files ch34x.cpp ftdi.cpp pl2303.cpp
  */
@@ -28,7 +29,10 @@
 #include <cstring>
 #include <cerrno>
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <functional>
+#include <new>
 #include <exception>
 #include <system_error>
 #include <poll.h>
@@ -37,6 +41,17 @@
 #include <libusb.h>
 #include "usbuart.hpp"
 #include "vector_lock.hpp"
+#include "framing.hpp"
+#include "timer.hpp"
+#include "crc.hpp"
+#include "scan.hpp"
+#include "histogram.hpp"
+#include "statspage.hpp"
+#include "capture.hpp"
+#include "faults.hpp"
+#include "replay.hpp"
+#include "loopback.hpp"
+#include "probes.hpp"
 
 //TODO ??? set limit max packet size per USB capabilities (64/512)
 //FIXME flush files before terminating
@@ -207,6 +222,18 @@ driver* driver::factory::create(libusb_device_handle* dev, uint8_t id)
 	return registrar().create(dev, id);
 }
 
+int driver::submit(libusb_transfer* xfer) noexcept {
+	return libusb_submit_transfer(xfer);
+}
+
+int driver::cancel(libusb_transfer* xfer) noexcept {
+	return libusb_cancel_transfer(xfer);
+}
+
+int driver::clear_halt(uint8_t ep) noexcept {
+	return libusb_clear_halt(handle(), ep);
+}
+
 device_id driver::factory::devid(libusb_device_handle* handle) noexcept {
 	libusb_device* dev = libusb_get_device(handle);
 	libusb_device_descriptor desc;
@@ -238,10 +265,134 @@ static inline void setnonblock(int fd) throw(error_t) {
 		throw error_t::fcntl_error;
 }
 
+/******************************************************************************/
+/**
+ * Reference counted buffer, shared by several OUT transfers
+ * Data is copied once and released when the last reference is dropped
+ */
+class shared_buffer {
+public:
+	static shared_buffer* create(unsigned size) throw(error_t) {
+		void* mem = malloc(sizeof(shared_buffer) + size);
+		if( mem == nullptr ) throw error_t::out_of_memory;
+		return new(mem) shared_buffer(size);
+	}
+	static shared_buffer* create(const void* data, unsigned size)
+															throw(error_t) {
+		shared_buffer* buff = create(size);
+		memcpy(buff->data(), data, size);
+		return buff;
+	}
+	inline void ref() noexcept { refs.fetch_add(1, memory_order_relaxed); }
+	inline void unref() noexcept {
+		if( refs.fetch_sub(1, memory_order_acq_rel) != 1 ) return;
+		this->~shared_buffer();
+		free(this);
+	}
+	inline unsigned char* data() noexcept {
+		return reinterpret_cast<unsigned char*>(this + 1);
+	}
+	unsigned size;
+private:
+	inline shared_buffer(unsigned _size) noexcept : size(_size), refs(1) {}
+	atomic<unsigned> refs;
+};
+
+/**
+ * OUT transfer of a shared buffer, submitted aside of the pipe stream
+ */
+struct outbound {
+	typedef function<void(int status, unsigned sent)> callback;
+	file_channel* const chnl;
+	libusb_transfer* const xfer;
+	shared_buffer* const buff;
+	const callback done;
+	unsigned sent;
+};
+
+/**
+ * Data path counters, single writer - the event loop
+ */
+struct channel_counters {
+	atomic<uint64_t> rx_bytes;
+	atomic<uint64_t> tx_bytes;
+	atomic<uint32_t> rx_transfers;
+	atomic<uint32_t> tx_transfers;
+	atomic<uint32_t> short_reads;
+	atomic<uint32_t> partial_writes;
+	atomic<uint32_t> eagain;
+	atomic<uint32_t> poll_requests;
+	atomic<uint32_t> dropped;
+	atomic<uint32_t> recoveries;
+};
+
+/**
+ * Measures bring-up phases of an attach
+ */
+struct stopwatch {
+	inline stopwatch() noexcept : timing{}, last(nanotime()) {}
+	/** accounts time since the previous lap to the phase				*/
+	inline void lap(attach_phase_t phase) noexcept {
+		const uint64_t now = nanotime();
+		timing.phase[phase] += now - last;
+		last = now;
+	}
+	attach_timing timing;
+	uint64_t last;
+};
+
+/**
+ * Request/response exchange, queued on a channel and driven by the event loop
+ */
+struct exchange : timer {
+	static constexpr unsigned max_response = 4096;
+	inline exchange(const channel& _ch, shared_buffer* req,
+		const match_spec& m, unsigned ms, transact_cb _cb, void* _user) noexcept
+	  : ch(_ch), request(req), match(m), timeout(ms), cb(_cb), user(_user)
+	  , serial(0), chnl(nullptr) {}
+	~exchange() noexcept { request->unref(); }
+	inline unsigned limit() const noexcept {
+		return match.length ? match.length : max_response;
+	}
+	void expired(uint64_t) noexcept;
+	const channel ch;
+	shared_buffer* const request;
+	const match_spec match;
+	const unsigned timeout;
+	const transact_cb cb;
+	void* const user;
+	unsigned serial;
+	file_channel* chnl;
+	vector<uint8_t> response;
+};
+
+/**
+ * OUT transfer prepared in advance and submitted at its deadline
+ */
+struct scheduled : timer {
+	inline scheduled(const channel& _ch, schedule_cb _cb, void* _user) noexcept
+	  : ch(_ch), cb(_cb), user(_user), out(nullptr), submitted(0) {}
+	void expired(uint64_t) noexcept;
+	const channel ch;
+	const schedule_cb cb;
+	void* const user;
+	outbound* out;
+	uint64_t submitted;
+};
+
 /******************************************************************************/
 
 class file_channel {
 public:
+	static constexpr uint8_t xon  = 0x11; /* DC1							*/
+	static constexpr uint8_t xoff = 0x13; /* DC3							*/
+	static constexpr unsigned default_recovery_limit = 3;
+	static constexpr unsigned default_recovery_window = 1000; /* ms		*/
+	/* transfers to resubmit and endpoints to clear on recovery			*/
+	enum halt_bits : uint8_t {
+		halt_read0 = 1, halt_read1 = 2, halt_write = 4,
+		halt_in = 8, halt_out = 16, halt_outbound = 32
+	};
 	inline file_channel(context::backend& _owner, const channel& ch,
 			driver* _drv) noexcept
 	  :	owner(_owner)
@@ -262,9 +413,49 @@ public:
 	  , pipein_hangup(false)
 	  , pipeout_hangup(false)
 	  , device_hangup(false)
+	  , closing(false)
+	  , info(_115200_8N1n)
+	  , rxtime{{0,0},{0,0}}
+	  , rxoffset(0)
+	  , pipeoffset(0)
+	  , tsflags(0)
+	  , tsfd(-1)
+	  , tsdropped(0)
+	  , rxcb(nullptr)
+	  , rxuser(nullptr)
+	  , rxframer(nullptr)
+	  , txframing{frame_none, 0, 0, 0, 0}
+	  , check(crc_none)
+	  , fcounters{{0},{0},{0}}
+	  , serial(0)
+	  , swflow(false)
+	  , stripflow(true)
+	  , txpaused(false)
+	  , rxpaused(false)
+	  , pacing(*this)
+	  , lead(0)
+	  , chartime(0)
+	  , drained(0)
+	  , counters{{0},{0},{0},{0},{0},{0},{0},{0},{0},{0}}
+	  , txready(0)
+	  , txsubmit(0)
+	  , tap(nullptr)
+	  , taperrors(0)
+	  , faults(nullptr)
+	  , devfaults(false)
+	  , faultcount{}
+	  , halted(0)
+	  , recovery_limit(default_recovery_limit)
+	  , recovery_window(default_recovery_window * 1000000ull)
+	  , window_start(0)
+	  , window_halts(0)
+	  , bringup{}
+	  , shmslot(-1)
 	  { set_nonblocking(); }
 
-	void init() throw(error_t)  {
+	void init(const eia_tia_232_info& pi) throw(error_t)  {
+		info = pi;
+		swflow = pi.flowcontrol == xon_xoff && ! drv->xonxoff();
 		bool success = true;
 		transaction<unsigned char>  readbuff0(success, malloc(chunksize()));
 		transaction<unsigned char>  readbuff1(success, malloc(chunksize()));
@@ -277,11 +468,12 @@ public:
 		readxfer1 = rdxfer1;
 		current   = rdxfer0;
 		writexfer = wrxfer;
+		/* IN transfers wait for data indefinitely, close cancels them	*/
 		libusb_fill_bulk_transfer(readxfer0, dev, drv->getifc().ep_bulk_in,
-				readbuff0, chunksize() , read_cb, this, timeout);
+				readbuff0, chunksize() , read_cb, this, 0);
 
 		libusb_fill_bulk_transfer(readxfer1, dev, drv->getifc().ep_bulk_in,
-				readbuff1, chunksize() , read_cb, this, timeout);
+				readbuff1, chunksize() , read_cb, this, 0);
 
 		libusb_fill_bulk_transfer(writexfer, dev, drv->getifc().ep_bulk_out,
 				writebuff, 0, write_cb, this, timeout);
@@ -306,8 +498,12 @@ public:
 			free(readxfer0->buffer);
 			libusb_free_transfer(readxfer0);
 		}
+		if( tsfd >= 0 ) ::close(tsfd);
+		delete tap;
+		delete faults;
+		delete rxframer;
 		delete drv;
-		libusb_close(dev);
+		if( dev ) libusb_close(dev);
 	}
 
 	virtual bool equals(const channel& ch) noexcept {
@@ -322,15 +518,37 @@ public:
 
 	/** returns true if safe to delete */
 	bool close() noexcept {
+		PROBE(close, this, device_hangup, pipein_hangup, pipeout_hangup);
+		closing = true;
+		/* retiring held transfers concludes exchanges waiting for them,
+		 * exchanges are failed first so none is started in their place	*/
+		while( exchanges.size() )
+			conclude(-error_t::no_channel, false);
 		if( writexfer_busy )
-			libusb_cancel_transfer(writexfer);
+			drv->cancel(writexfer);
 		if( readxfer_busy[0] )
-			libusb_cancel_transfer(readxfer0);
+			drv->cancel(readxfer0);
 		if( readxfer_busy[1] )
-			libusb_cancel_transfer(readxfer1);
+			drv->cancel(readxfer1);
+		vector<outbound*> stale;
+		{
+			lock_guard<mutex> lock(outlock);
+			stale.swap(held);
+			/* stalled transfers are not submitted, recover would do it	*/
+			stale.insert(stale.end(), stalled.begin(), stalled.end());
+			stalled.clear();
+			for(auto out : outbox)
+				if( util::find(stale, out) == stale.end() )
+					drv->cancel(out->xfer);
+		}
+		for(auto out : stale)
+			retire(out, -error_t::no_channel);
 		pipein_hangup = true;
 		pipeout_hangup = true;
-		return ! (readxfer_busy[0] || readxfer_busy[1] || writexfer_busy);
+		for(auto s : agenda)
+			cancel(s, -error_t::no_channel);
+		agenda.clear();
+		return ! busy();
 	}
 
 	inline void events() noexcept {
@@ -367,7 +585,9 @@ public:
 	 * - error (res < 0 )							- request removal */
 	bool is_error(const char *tag, int res) noexcept { //FIXME consider merging with throw_error
 		switch(errno) {
-		case EAGAIN: return false;
+		case EAGAIN:
+			bump(counters.eagain, 1);
+			return false;
 		case EINTR:
 			log.i(tag, "interrupted with res=%d, attempting to continue", res);
 			return false;
@@ -384,16 +604,32 @@ public:
 	}
 
 	void readpipe() noexcept {
+		if( txpaused ) return; /* XOFF received							*/
+		if( writexfer_busy ) return; /* write_callback reads on completion,
+						 * reading zero bytes here would look like EOF	*/
+		if( halted & halt_write ) return; /* recover resubmits the data	*/
 		size_t size;
 		void * buff = getwritebuff(size); /* reading done to USB write buffer */
+		if( lead && size ) {
+			const unsigned room = window(nanotime());
+			if( room == 0 ) {
+				timers().schedule(pacing, drained - lead + chartime);
+				return;
+			}
+			if( room < size ) size = room;
+		}
 //		log.d(__,"size=%d", size);
 		ssize_t res = read(_readfd(), buff, size); /* whatever read from file */
+		PROBE(pipe_read, this, fdrd, res);
 		if( res <= 0 && is_error(__,res) ) {
 			pipein_hangup = true;
 			return;
 		}
 //		log.d(__,"%ld", (long)res); /* on some platforms sszie_t is long */
-		if( res > 0 ) submit(res); /* submit to USB */
+		if( res > 0 ) { /* submit to USB */
+			if( lead ) charge(res);
+			submit(res);
+		}
 		else if ( res == 0 ) {
 			pipein_hangup = true;
 //			request_removal(false); /* EOF */
@@ -407,6 +643,7 @@ public:
 		unsigned char* buff = getreadbuff(transfer, size); /* write from USB read buffer*/
 		if( ! size ) return;
 		ssize_t res = write(_writefd(), buff, size); /* write to file */
+		PROBE(pipe_write, this, fdrw, res);
 //		log.d(__,"[%d]=\"%*.*s\" -> %d", size, size, size, (char*) buff, res);
 		if( res <= 0 && is_error(__,res) ) {
 			pipeout_hangup = true;
@@ -422,7 +659,10 @@ public:
 	}
 
 	inline void set_events(int events, bool read) noexcept {
-		if( events & POLLIN  ) pipein_ready = true;
+		if( events & POLLIN  ) {
+			pipein_ready = true;
+			if( read && txready == 0 ) txready = nanotime();
+		}
 		if( events & POLLOUT ) pipeout_ready = true;
 		if( events & POLLHUP ) {
 			(read ? pipein_hangup : pipeout_hangup) = true;
@@ -432,6 +672,12 @@ public:
 
 	inline void request_removal(bool enforce) noexcept;
 
+	/* queues recovery of the failed transfer, returns false when
+	 * recoveries exceed the limit or the channel is going away			*/
+	inline bool halt(libusb_transfer* transfer) noexcept;
+
+	inline timer_queue& timers() noexcept;
+
 	bool error_callback(libusb_transfer* transfer) noexcept {
 		if( transfer == readxfer0 )	readxfer_busy[0] = false;
 		if( transfer == readxfer1 )	readxfer_busy[1] = false;
@@ -440,12 +686,18 @@ public:
 		case LIBUSB_TRANSFER_CANCELLED:
 		case LIBUSB_TRANSFER_NO_DEVICE:
 			request_removal(true);
+			return false;
 		case LIBUSB_TRANSFER_TIMED_OUT:
+			/* a timed out IN transfer may still carry data, read_callback
+			 * delivers it and submits the transfer again					*/
+			return transfer == readxfer0 || transfer == readxfer1;
 		case LIBUSB_TRANSFER_COMPLETED:
 			return false;
-		case LIBUSB_TRANSFER_ERROR:
 		case LIBUSB_TRANSFER_STALL:
 		case LIBUSB_TRANSFER_OVERFLOW:
+			if( halt(transfer) ) return false;
+			/* fallthrough */
+		case LIBUSB_TRANSFER_ERROR:
 			//TODO how to handle these errors
 			log.e(__,"transfer severe error %s", libusb_error_name(transfer->status));
 			request_removal(true);
@@ -459,6 +711,11 @@ public:
 	static void read_cb(libusb_transfer* transfer) noexcept {
 		file_channel * chnl = (file_channel*) transfer->user_data;
 		if( chnl ) {
+			chnl->stamp(transfer);
+			chnl->injure(transfer);
+			PROBE(read_complete, chnl, transfer, transfer->status,
+				transfer->actual_length,
+				chnl->rxtime[transfer == chnl->readxfer1].monotonic);
 		    if( transfer->status == LIBUSB_TRANSFER_COMPLETED ||
 		    	chnl->error_callback(transfer)	)
 		    	chnl->read_callback(transfer);
@@ -468,6 +725,9 @@ public:
 
 	static void write_cb(libusb_transfer* transfer) noexcept {
 		file_channel* chnl = (file_channel*) transfer->user_data;
+		if( chnl ) chnl->injure(transfer);
+		PROBE(write_complete, chnl, transfer, transfer->status,
+			transfer->actual_length);
 		if( chnl ) {
 		    if( transfer->status == LIBUSB_TRANSFER_COMPLETED ||
 		    	chnl->error_callback(transfer)	)
@@ -476,15 +736,150 @@ public:
 		else log.e(__, "broken callback in transfer %p",transfer);
 	}
 
+	static void out_cb(libusb_transfer* transfer) noexcept {
+		outbound* out = (outbound*) transfer->user_data;
+		if( out ) out->chnl->injure(transfer);
+		PROBE(write_complete, out ? out->chnl : nullptr, transfer,
+			transfer->status, transfer->actual_length);
+		if( out ) out->chnl->out_callback(out);
+		else log.e(__, "broken callback in transfer %p",transfer);
+	}
+
+	/** submits a shared buffer as a separate OUT transfer
+	 *  done is called from the event loop when the transfer is retired
+	 *  urgent transfers are submitted even if sending is paused by XOFF	*/
+	void send(shared_buffer* buff, outbound::callback done,
+			bool urgent = false) throw(error_t) {
+		if( device_hangup ) throw error_t::no_device;
+		outbound* out = prepare(buff, done);
+		try { enqueue(out, urgent); }
+		catch(error_t) {
+			discard(out);
+			throw;
+		}
+	}
+
+	/** allocates and fills an OUT transfer of the shared buffer			*/
+	outbound* prepare(shared_buffer* buff, outbound::callback done)
+			throw(error_t) {
+		bool success = false;
+		transaction<libusb_transfer> xfer(success, libusb_alloc_transfer(0));
+		outbound* out = new outbound { this, xfer, buff, done, 0 };
+		libusb_fill_bulk_transfer(xfer, dev, drv->getifc().ep_bulk_out,
+				buff->data(), buff->size, out_cb, out, timeout);
+		buff->ref();
+		success = true;
+		return out;
+	}
+
+	/** submits a prepared transfer, or holds it while sending is paused	*/
+	void enqueue(outbound* out, bool urgent) throw(error_t) {
+		lock_guard<mutex> lock(outlock);
+		if( (txpaused || lead || held.size() || stalled.size()) && ! urgent ) {
+			held.push_back(out);
+			if( ! txpaused ) wake();
+		} else if( int err = submit(out->xfer) ) {
+			log.e(__,"libusb_submit_transfer failed with error %d: %s",
+					err, libusb_error_name(err));
+			throw err == LIBUSB_ERROR_NO_DEVICE ?
+					error_t::no_device : error_t::usb_error;
+		}
+		outbox.push_back(out);
+	}
+
+	/** releases a transfer that was never submitted						*/
+	static void discard(outbound* out) noexcept {
+		out->buff->unref();
+		libusb_free_transfer(out->xfer);
+		delete out;
+	}
+
+	void out_callback(outbound* out) noexcept {
+		libusb_transfer* xfer = out->xfer;
+		tapout(xfer);
+		out->sent += xfer->actual_length;
+		bump(counters.tx_bytes, xfer->actual_length);
+		if( xfer->status == LIBUSB_TRANSFER_COMPLETED ) {
+			bump(counters.tx_transfers, 1);
+			if( out->sent >= out->buff->size ) {
+				retire(out, +error_t::success);
+				return;
+			}
+			bump(counters.partial_writes, 1);
+			log.i(__,"partially complete transfer %d/%d",
+					xfer->actual_length, xfer->length);
+			xfer->buffer += xfer->actual_length;
+			xfer->length -= xfer->actual_length;
+			if( ! device_hangup && submit(xfer) == 0 ) return;
+		}
+		if( (xfer->status == LIBUSB_TRANSFER_STALL ||
+			 xfer->status == LIBUSB_TRANSFER_OVERFLOW) && halt(xfer) ) {
+			lock_guard<mutex> lock(outlock);
+			stalled.push_back(out); /* recover submits the unsent part	*/
+			return;
+		}
+		if( xfer->status == LIBUSB_TRANSFER_NO_DEVICE )
+			request_removal(true);
+		retire(out, xfer->status == LIBUSB_TRANSFER_NO_DEVICE ?
+				-error_t::no_device : -error_t::usb_error);
+	}
+
+	void retire(outbound* out, int status) noexcept {
+		{
+			lock_guard<mutex> lock(outlock);
+			util::erase(outbox, out);
+		}
+		if( out->done ) out->done(status, out->sent);
+		discard(out);
+	}
+
+	/** prepares the transfer and arms its submission at the deadline		*/
+	void send_at(scheduled* s, shared_buffer* buff, uint64_t deadline)
+			throw(error_t) {
+		if( device_hangup ) throw error_t::no_device;
+		s->out = prepare(buff, [s](int status, unsigned) {
+			if( s->cb ) s->cb(s->user, s->ch, status, s->submitted, nanotime());
+			delete s;
+		});
+		agenda.push_back(s);
+		timers().schedule(*s, deadline);
+	}
+
+	/** submits a scheduled transfer, called on its deadline				*/
+	void launch(scheduled* s) noexcept {
+		util::erase(agenda, s);
+		s->submitted = nanotime();
+		try {
+			enqueue(s->out, true);
+		} catch(error_t err) {
+			cancel(s, -err);
+		}
+	}
+
+	/** drops a scheduled transfer that was not submitted					*/
+	void cancel(scheduled* s, int status) noexcept {
+		timers().cancel(*s);
+		discard(s->out);
+		if( s->cb ) s->cb(s->user, s->ch, status, s->submitted, 0);
+		delete s;
+	}
+
 	inline size_t chunksize() const noexcept {
 		return drv->getifc().chunk_size; //TODO driver may opt chunk_size
 	}
 
+	/** submits a transfer, returns libusb error code					*/
+	inline int submit(libusb_transfer* transfer) noexcept {
+		PROBE(submit, this, transfer, transfer->endpoint, transfer->length);
+		if( faults && faults->submit() ) return LIBUSB_ERROR_IO;
+		return drv->submit(transfer);
+	}
+
 	bool submit_transfer(libusb_transfer* transfer) noexcept {
 //		if( transfer->actual_length > 2 )
 //		log.d(__,"length=%d", transfer->length);
 		int err;
-		switch( err=libusb_submit_transfer(transfer) ) {
+		switch( err=submit(transfer) ) {
 		case 0:
 			return true;
 		case LIBUSB_ERROR_NO_DEVICE:
@@ -501,34 +896,531 @@ public:
 	void read_callback(libusb_transfer* readxfer) noexcept {
 //		if( readxfer->actual_length > 2 )
 //			log.d(__,"actual_length=%d readpos={%d,%d}", readxfer->actual_length, readpos[0], readpos[1]);
+		bump(counters.rx_transfers, 1);
+		if( readxfer->actual_length < readxfer->length )
+			bump(counters.short_reads, 1);
 		drv->read_callback(readxfer, readpos[readxfer == readxfer1]);
-		if( pipeout_hangup ) return;
+		if( tap ) tapin(readxfer);
+		if( readpos[readxfer == readxfer1] < readxfer->actual_length ) {
+			bump(counters.rx_bytes,
+				readxfer->actual_length - readpos[readxfer == readxfer1]);
+			receive(readxfer, readpos[readxfer == readxfer1]);
+		} else if( rxframer )
+			rxframer->idle(rxtime[readxfer == readxfer1].monotonic);
+		if( pipeout_hangup ) {
+			if( readpos[readxfer == readxfer1] < readxfer->actual_length )
+				bump(counters.dropped,
+					readxfer->actual_length - readpos[readxfer == readxfer1]);
+			readxfer_busy[readxfer == readxfer1] = false;
+			return;
+		}
 		if( readpos[readxfer == readxfer1] >= readxfer->actual_length ) {
 			readxfer_busy[readxfer == readxfer1] = submit_transfer(readxfer);
 		} else {
 			readxfer_busy[readxfer == readxfer1] = false;
 			writepipe(readxfer);
 		}
+		throttle();
 	}
 
 	void write_callback(libusb_transfer*) noexcept {
 //		log.d(__,"actual_length=%d", writexfer->actual_length);
-		if( pipein_hangup ) return;
+		bump(counters.tx_transfers, 1);
+		bump(counters.tx_bytes, writexfer->actual_length);
+		tapout(writexfer);
+		if( pipein_hangup ) {
+			writexfer_busy = false; /* completed before cancel			*/
+			return;
+		}
 		if( writexfer->actual_length < writexfer->length ) {
+			bump(counters.partial_writes, 1);
+			log.i(__,"partially complete transfer %d/%d",
+					writexfer->actual_length, writexfer->length);
+			/* only the unsent rest is submitted again					*/
+			writexfer->length -= writexfer->actual_length;
 			if( writexfer->actual_length != 0 )
 				memmove(writexfer->buffer,
 						writexfer->buffer + writexfer->actual_length,
-						writexfer->length - writexfer->actual_length);
-			log.i(__,"partially complete transfer %d/%d",
-					writexfer->actual_length, writexfer->length);
+						writexfer->length);
 			writexfer_busy = submit_transfer(writexfer);
 		} else {
 			drv->write_callback(writexfer);
 			writexfer_busy = false;
+			txready = nanotime();
+			latencies[lat_tx_complete].record(txready - txsubmit);
 			readpipe();
 		}
 	}
 
+	/** captures completion time of a read transfer						*/
+	inline void stamp(libusb_transfer* readxfer) noexcept {
+		auto& time(rxtime[readxfer == readxfer1]);
+		time.monotonic = nanotime();
+#		ifdef CLOCK_TAI
+		time.tai = (tsflags & ts_tai) ? nanotime(CLOCK_TAI) : 0;
+#		endif
+	}
+
+	/** delivers received data to the timestamp stream, pending exchanges,
+	 *  the callback and the framer											*/
+	void receive(libusb_transfer* readxfer, size_t& pos) noexcept {
+		if( swflow ) {
+			flowcontrol(readxfer, pos);
+			if( pos >= readxfer->actual_length ) return;
+		}
+		const auto& time(rxtime[readxfer == readxfer1]);
+		rx_timestamp ts {
+			time.monotonic, time.tai, rxoffset,
+			(uint32_t)(readxfer->actual_length - pos),
+			(tsflags & ts_per_byte) ? char_time(info) : 0
+		};
+		rxoffset += ts.length;
+		while( exchanges.size() && ts.length ) {
+			const unsigned n = respond(readxfer->buffer + pos, ts.length);
+			pos += n;
+			ts.offset += n;
+			ts.length -= n;
+		}
+		if( ts.length && rxcb ) {
+			rxcb(rxuser, readxfer->buffer + pos, ts.length, &ts);
+			if( tsflags & ts_exclusive )
+				pos = readxfer->actual_length;
+		}
+		if( ts.length && rxframer ) {
+			rxframer->feed(readxfer->buffer + pos, ts.length, ts);
+			pos = readxfer->actual_length;
+		}
+		if( pos >= readxfer->actual_length ) return;
+		/* the rest, the tail of the chunk, goes to fd_write				*/
+		ts.offset = pipeoffset;
+		ts.length = readxfer->actual_length - pos;
+		pipeoffset += ts.length;
+		if( tsfd >= 0 ) record(ts);
+	}
+
+	/** acts on XON/XOFF in received data, strips them if requested		*/
+	void flowcontrol(libusb_transfer* readxfer, size_t pos) noexcept {
+		uint8_t* p = readxfer->buffer + pos;
+		uint8_t* const end = readxfer->buffer + readxfer->actual_length;
+		uint8_t* out = nullptr;
+		uint8_t* q;
+		while( (q = const_cast<uint8_t*>(scan(p, end, xon, xoff))) != end ) {
+			pause(*q == xoff);
+			if( stripflow ) {
+				if( out ) {
+					memmove(out, p, q - p);
+					out += q - p;
+				} else
+					out = q;
+			}
+			p = q + 1;
+		}
+		if( out == nullptr ) return;
+		memmove(out, p, end - p);
+		readxfer->actual_length = out + (end - p) - readxfer->buffer;
+	}
+
+	/** pauses or resumes sending on received XOFF/XON					*/
+	void pause(bool stop) noexcept {
+		{
+			lock_guard<mutex> lock(outlock);
+			if( txpaused == stop ) return;
+			txpaused = stop;
+			PROBE(flow, this, stop);
+		}
+		if( ! stop ) resume();
+	}
+
+	/** resumes sending held transfers and the pipe stream				*/
+	void resume() noexcept {
+		release();
+		if( ! writexfer_busy && ! pipein_hangup ) readpipe();
+	}
+
+	/** submits held outbound transfers, as XOFF state and pacer permit	*/
+	void release() noexcept {
+		vector<outbound*> failed;
+		{
+			lock_guard<mutex> lock(outlock);
+			const uint64_t now = nanotime();
+			auto i = held.begin();
+			for(; i != held.end() && ! txpaused && stalled.empty(); ++i) {
+				outbound* out = *i;
+				if( lead ) {
+					const unsigned length = out->xfer->length;
+					if( window(now) < length && drained > now ) {
+						const uint64_t time = (uint64_t) length * chartime;
+						timers().schedule(pacing, time >= lead ?
+								drained : drained - (lead - time));
+						break;
+					}
+					charge(length);
+				}
+				if( device_hangup || submit(out->xfer) )
+					failed.push_back(out);
+			}
+			held.erase(held.begin(), i);
+		}
+		for(auto out : failed)
+			retire(out, -error_t::usb_error);
+	}
+
+	/** returns number of bytes that fit in the lead window				*/
+	unsigned window(uint64_t now) noexcept {
+		if( drained < now ) drained = now;
+		const uint64_t ahead = drained - now;
+		if( ahead == 0 ) return lead > chartime ? lead / chartime : 1;
+		return ahead < lead ? (lead - ahead) / chartime : 0;
+	}
+
+	/** accounts size bytes submitted to the line							*/
+	inline void charge(unsigned size) noexcept {
+		drained += (uint64_t) size * chartime;
+	}
+
+	/** sets pacing lead window in nanoseconds, 0 disables pacing			*/
+	void pace(uint32_t window) noexcept {
+		{
+			lock_guard<mutex> lock(outlock);
+			lead = window;
+			chartime = char_time(info);
+		}
+		if( lead == 0 ) timers().cancel(pacing);
+		resume();
+	}
+
+	inline void wake() noexcept;
+
+	/** returns number of received bytes not yet delivered				*/
+	inline unsigned staged() const noexcept {
+		unsigned size = 0;
+		for(auto xfer : { readxfer0, readxfer1 }) {
+			const size_t pos = readpos[xfer == readxfer1];
+			if( ! readxfer_busy[xfer == readxfer1] && pos < xfer->actual_length )
+				size += xfer->actual_length - pos;
+		}
+		return size;
+	}
+
+	/** sends XOFF when staged data reach the high watermark,
+	 *  and XON when they drop below the low one							*/
+	void throttle() noexcept {
+		if( ! swflow ) return;
+		const unsigned size = staged();
+		if( rxpaused ? size > chunksize() / 4 : size < chunksize() ) return;
+		const uint8_t code = rxpaused ? xon : xoff;
+		shared_buffer* buff = shared_buffer::create(&code, 1);
+		try {
+			send(buff, nullptr, true);
+			rxpaused = ! rxpaused;
+		} catch(error_t) {}
+		buff->unref();
+	}
+
+	void xonxoff(bool strip) noexcept {
+		stripflow = strip;
+	}
+
+	/** replaces traffic capture, nullptr stops capturing					*/
+	void capture(capture_file* file) noexcept {
+		delete tap;
+		tap = file;
+		taperrors = drv->errorcount();
+	}
+
+	void recovery(unsigned limit, unsigned window) noexcept {
+		recovery_limit = limit;
+		recovery_window = window * 1000000ull;
+	}
+
+	/** clears halted endpoints and submits the failed transfers again,
+	 *  called by the loop outside of libusb callbacks					*/
+	void recover() noexcept {
+		const uint8_t h = halted;
+		halted = 0;
+		if( device_hangup ) return;
+		const interface& ifc = drv->getifc();
+		for(auto ep : { h & halt_in ? ifc.ep_bulk_in : 0,
+						h & halt_out ? ifc.ep_bulk_out : 0 }) {
+			if( ep == 0 ) continue;
+			if( int err = drv->clear_halt(ep) ) {
+				log.e(__,"clear halt of %02x failed with error %d: %s", ep,
+					err, libusb_error_name(err));
+				request_removal(true);
+				return;
+			}
+		}
+		bump(counters.recoveries, 1);
+		log.i(__,"recovered, halts %02x", h);
+		if( ! pipeout_hangup ) {
+			if( h & halt_read0 ) readxfer_busy[0] = submit_transfer(readxfer0);
+			if( h & halt_read1 ) readxfer_busy[1] = submit_transfer(readxfer1);
+		}
+		if( (h & halt_write) && ! pipein_hangup ) {
+			/* the device may have taken a part of the data				*/
+			if( writexfer->actual_length > 0 ) {
+				writexfer->length -= writexfer->actual_length;
+				memmove(writexfer->buffer,
+						writexfer->buffer + writexfer->actual_length,
+						writexfer->length);
+			}
+			writexfer_busy = submit_transfer(writexfer);
+		}
+		if( h & halt_outbound ) {
+			vector<outbound*> failed;
+			{
+				lock_guard<mutex> lock(outlock);
+				for(auto out : stalled) {
+					libusb_transfer* xfer = out->xfer;
+					xfer->buffer += xfer->actual_length;
+					xfer->length -= xfer->actual_length;
+					if( int err = submit(xfer) ) {
+						log.e(__,"resubmit failed with error %d: %s", err,
+								libusb_error_name(err));
+						failed.push_back(out);
+					}
+				}
+				stalled.clear();
+			}
+			for(auto out : failed)
+				retire(out, -error_t::usb_error);
+			release();	/* submits transfers held behind them		*/
+		}
+	}
+
+	/** replaces fault injection, nullptr stops injecting, called with
+	 * both channel lists locked, so no transfer is being submitted		*/
+	void inject(const fault_plan* plan) noexcept {
+		fault_injector* old = faults;
+		faults = plan ? new fault_injector(*plan, faultcount) : nullptr;
+		devfaults = drv->inject(faults);
+		delete old;
+	}
+
+	/** applies faults to a completed transfer, unless the device did		*/
+	inline void injure(libusb_transfer* transfer) noexcept {
+		if( faults && ! devfaults ) faults->complete(transfer);
+	}
+
+	void faultstats(fault_stats& fs) const noexcept {
+		fs.transfers = faultcount.transfers.load(memory_order_relaxed);
+		for(unsigned i = 0; i < USBUART_FAULT_KINDS; ++i)
+			fs.injected[i] = faultcount.injected[i].load(memory_order_relaxed);
+	}
+
+	/** records received payload and driver status changes to the capture	*/
+	void tapin(libusb_transfer* readxfer) noexcept {
+		const size_t pos = readpos[readxfer == readxfer1];
+		const uint64_t time = rxtime[readxfer == readxfer1].monotonic;
+		const uint32_t errors = drv->errorcount();
+		if( errors != taperrors ) {
+			taperrors = errors;
+			tap->packet(capture_file::ev_status, capture_file::dir_rx, time,
+					errors, readxfer->buffer, pos);
+		}
+		if( pos < readxfer->actual_length )
+			tap->packet(capture_file::ev_data, capture_file::dir_rx, time,
+				errors, readxfer->buffer + pos, readxfer->actual_length - pos);
+	}
+
+	/** records transmitted payload to the capture							*/
+	inline void tapout(const libusb_transfer* xfer) noexcept {
+		if( tap && xfer->actual_length )
+			tap->packet(capture_file::ev_data, capture_file::dir_tx,
+				nanotime(), drv->errorcount(), xfer->buffer, xfer->actual_length);
+	}
+
+	/** queues an exchange, starts it if the channel is idle				*/
+	void transact(exchange* x) noexcept {
+		x->chnl = this;
+		x->serial = ++serial;
+		exchanges.push_back(x);
+		if( closing ) conclude(-error_t::no_channel, false);
+		else if( exchanges.size() == 1 ) start();
+	}
+
+	/** sends request of the front exchange and arms its timeout			*/
+	void start() noexcept {
+		if( closing ) return;	/* close fails the queued exchanges		*/
+		exchange* x = exchanges.front();
+		timers().schedule(*x, nanotime() +
+				(uint64_t)(x->timeout ? x->timeout : timeout) * 1000000u);
+		const unsigned id = x->serial;
+		try {
+			send(x->request, [this, id](int status, unsigned) {
+				if( status != +error_t::success && exchanges.size() &&
+					exchanges.front()->serial == id )
+					conclude(status);
+			});
+		} catch(error_t err) {
+			conclude(-err);
+		}
+	}
+
+	/** matches received data against the front exchange,
+	 *  returns number of bytes consumed									*/
+	unsigned respond(const uint8_t* data, unsigned size) noexcept {
+		if( closing ) return size;
+		exchange& x(*exchanges.front());
+		const unsigned room = x.limit() - x.response.size();
+		unsigned n = size < room ? size : room;
+		bool complete = n == room && x.match.length;
+		if( x.match.terminator >= 0 ) {
+			const uint8_t* t = scan(data, data + n, (uint8_t) x.match.terminator);
+			if( t != data + n ) {
+				n = t - data + 1;
+				complete = true;
+			}
+		} else if( x.match.length == 0 )
+			complete = true;
+		x.response.insert(x.response.end(), data, data + n);
+		if( complete )
+			conclude(+error_t::success);
+		else if( n == room )
+			conclude(-error_t::io_error); /* terminator not found			*/
+		return n;
+	}
+
+	/** completes the front exchange and starts the next one				*/
+	void conclude(int status, bool next = true) noexcept {
+		exchange* x = exchanges.front();
+		exchanges.pop_front();
+		timers().cancel(*x);
+		if( x->cb )
+			x->cb(x->user, x->ch, status, x->response.data(),
+					x->response.size());
+		delete x;
+		if( next && exchanges.size() && ! device_hangup ) start();
+	}
+
+	void record(const rx_timestamp& ts) noexcept {
+		if( write(tsfd, &ts, sizeof(ts)) == sizeof(ts) ) return;
+		if( errno == EAGAIN || errno == EINTR ) {
+			if( tsdropped++ == 0 )
+				log.w(__,"timestamp stream overrun, records dropped");
+			return;
+		}
+		log.i(__,"timestamp stream closed, error %d", errno);
+		::close(tsfd);
+		tsfd = -1;
+	}
+
+	/** attaches write end of the timestamp stream						*/
+	void timestamps(int fd, unsigned flags) noexcept {
+		if( tsfd >= 0 ) ::close(tsfd);
+		tsfd = fd;
+		tsdropped = 0;
+		tsflags = (tsflags & ts_exclusive) | (flags & ~ts_exclusive);
+	}
+
+	void onreceive(receive_cb cb, void* user, unsigned flags) noexcept {
+		rxcb = cb;
+		rxuser = user;
+		tsflags = cb ? flags : tsflags & ~ts_exclusive;
+	}
+
+	/** replaces framer, nullptr removes framing							*/
+	void framing(framer* f, const framing_info& fi) noexcept {
+		delete rxframer;
+		rxframer = f;
+		lock_guard<mutex> lock(outlock);
+		txframing = fi;
+		if( f == nullptr ) return;
+		f->check = check;
+		f->counters = &fcounters;
+		f->attach(timers(), info, drv->latency());
+	}
+
+	void checksum(crc_t type) noexcept {
+		if( rxframer ) rxframer->check = type;
+		lock_guard<mutex> lock(outlock);
+		check = type;
+	}
+
+	void stats(channel_stats& cs) const noexcept {
+		cs.rx_bytes       = counters.rx_bytes.load(memory_order_relaxed);
+		cs.tx_bytes       = counters.tx_bytes.load(memory_order_relaxed);
+		cs.rx_transfers   = counters.rx_transfers.load(memory_order_relaxed);
+		cs.tx_transfers   = counters.tx_transfers.load(memory_order_relaxed);
+		cs.short_reads    = counters.short_reads.load(memory_order_relaxed);
+		cs.partial_writes = counters.partial_writes.load(memory_order_relaxed);
+		cs.eagain         = counters.eagain.load(memory_order_relaxed);
+		cs.poll_requests  = counters.poll_requests.load(memory_order_relaxed);
+		cs.line_errors    = drv->errorcount();
+		cs.dropped        = counters.dropped.load(memory_order_relaxed);
+		cs.recoveries     = counters.recoveries.load(memory_order_relaxed);
+	}
+
+	inline void latency(latency_t which, latency_histogram& h,
+			bool reset) noexcept {
+		latencies[which].snapshot(h, reset);
+	}
+
+	/** fills identity of the channel in a stats page slot				*/
+	void identify(usbuart_shm_slot& s) noexcept {
+		if( dev ) {
+			libusb_device* device = libusb_get_device(dev);
+			libusb_device_descriptor desc;
+			if( libusb_get_device_descriptor(device, &desc) == 0 ) {
+				s.vid = desc.idVendor;
+				s.pid = desc.idProduct;
+			}
+			s.busid = libusb_get_bus_number(device);
+			s.devid = libusb_get_device_address(device);
+		} else if( auto sim = dynamic_cast<const simulator*>(drv) ) {
+			/* simulated devices have no handle and no descriptor		*/
+			s.vid = s.pid = 0;
+			s.busid = sim->location.busid;
+			s.devid = sim->location.devid;
+		}
+		s.ch = { fdrd, fdrw };
+		s.baudrate = info.baudrate;
+	}
+
+	/** fills counters of the channel in a stats page slot				*/
+	void publish(usbuart_shm_slot& s, uint64_t now) noexcept {
+		s.active = 1;
+		s.updated = now;
+		s.status = status();
+		stats(s.stats);
+		framestats(s.frames);
+	}
+
+	void framestats(frame_stats& fs) const noexcept {
+		fs.frames  = fcounters.frames.load(memory_order_relaxed);
+		fs.bad_crc = fcounters.bad_crc.load(memory_order_relaxed);
+		fs.dropped = fcounters.dropped.load(memory_order_relaxed);
+	}
+
+	/** encodes frame with the channel's framing and sends it				*/
+	void send_frame(const void* data, unsigned size) throw(error_t) {
+		framing_info fi;
+		crc_t type;
+		{
+			lock_guard<mutex> lock(outlock);
+			fi = txframing;
+			type = check;
+		}
+		throw_if(fi.type == frame_none, __, "framing");
+		vector<uint8_t> payload;
+		if( type != crc_none ) {
+			payload.resize(size + crc::size(type));
+			memcpy(payload.data(), data, size);
+			size = crc::append(type, payload.data(), size);
+			data = payload.data();
+		}
+		shared_buffer* buff =
+			shared_buffer::create(framer::encoded_size(fi, size));
+		buff->size = framer::encode(fi, (const uint8_t*) data, size,
+				buff->data());
+		try { send(buff, nullptr); }
+		catch(error_t) {
+			buff->unref();
+			throw;
+		}
+		buff->unref();
+	}
+
 	inline unsigned char* getreadbuff(libusb_transfer* readxfer,
 			size_t& size) const noexcept {
 		if( readxfer_busy[readxfer == readxfer1] ) {
@@ -556,6 +1448,9 @@ public:
 			log.e(__,"wrong state");
 		}
 		writexfer->length = size;
+		txsubmit = nanotime();
+		if( txready ) latencies[lat_tx_pickup].record(txsubmit - txready);
+		txready = 0;
 		writexfer_busy = submit_transfer(writexfer);
 	}
 
@@ -570,8 +1465,11 @@ public:
 //		if( pos > readxfer->actual_length )
 //			log.d(__, "readpos > readxfer->actual_length ");
 		if( pos >= readxfer->actual_length ) {
+			latencies[lat_rx_deliver].record(
+				nanotime() - rxtime[readxfer == readxfer1].monotonic);
 			readxfer_busy[readxfer == readxfer1] = submit_transfer(readxfer);
 			current = readxfer == readxfer1 ? readxfer0 : readxfer1;
+			throttle();
 			return true;
 		}
 		return false;
@@ -579,7 +1477,9 @@ public:
 
 	inline bool busy() const noexcept {
 //		log.d(__,"w=%d r={%d,%d}",writexfer_busy,readxfer_busy[0],readxfer_busy[0]);
-		return writexfer_busy || readxfer_busy[0] || readxfer_busy[1];
+		if( writexfer_busy || readxfer_busy[0] || readxfer_busy[1] ) return true;
+		lock_guard<mutex> lock(outlock);
+		return outbox.size() != 0;
 	}
 
 	inline bool operator==(int fd) const noexcept {
@@ -606,8 +1506,67 @@ protected:
 	volatile bool pipein_hangup;
 	volatile bool pipeout_hangup;
 	volatile bool device_hangup;
+	bool closing;			/* no new exchanges are started				*/
+	vector<outbound*> outbox;
+	vector<outbound*> stalled;	/* halted outbox entries, sent in order	*/
+	mutable mutex outlock;
+	eia_tia_232_info info;
+	struct { uint64_t monotonic; uint64_t tai; } rxtime[2];
+	uint64_t rxoffset;			/* bytes received, offset of callbacks	*/
+	uint64_t pipeoffset;		/* bytes left for fd_write, of records	*/
+	unsigned tsflags;
+	int tsfd;
+	unsigned tsdropped;
+	receive_cb rxcb;
+	void* rxuser;
+	framer* rxframer;
+	framing_info txframing;
+	crc_t check;
+	frame_counters fcounters;
+	deque<exchange*> exchanges;
+	unsigned serial;
+	bool swflow;
+	bool stripflow;
+	bool txpaused;
+	bool rxpaused;
+	vector<outbound*> held;
+	struct pacer : timer {
+		inline pacer(file_channel& c) noexcept : chnl(c) {}
+		void expired(uint64_t) noexcept { chnl.resume(); }
+		file_channel& chnl;
+	} pacing;
+	uint32_t lead;
+	uint32_t chartime;
+	uint64_t drained;
+	vector<scheduled*> agenda;
+	channel_counters counters;
+	histogram latencies[lat_tx_complete + 1];
+	uint64_t txready;
+	uint64_t txsubmit;
+	capture_file* tap;
+	uint32_t taperrors;
+	fault_injector* faults;
+	bool devfaults;				/* faults are applied by the device		*/
+	fault_counters faultcount;
+	uint8_t halted;				/* halt_bits awaiting recovery			*/
+	unsigned recovery_limit;	/* recoveries per window, 0 - none		*/
+	uint64_t recovery_window;	/* ns									*/
+	uint64_t window_start;
+	unsigned window_halts;
+public:
+	attach_timing bringup;
+	int shmslot;
 };
 
+void scheduled::expired(uint64_t) noexcept {
+	out->chnl->launch(this);
+}
+
+void exchange::expired(uint64_t) noexcept {
+	log.i(__,"transaction %u timed out", serial);
+	chnl->conclude(-error_t::timed_out);
+}
+
 
 class pipe_channel : public file_channel {
 public:
@@ -641,7 +1600,7 @@ private:
 			fd_read 	= a[0];
 			fd_write	= b[1];
 			ex.fd_read	= b[0];
-			ex.fd_write	= b[1];
+			ex.fd_write	= a[1];
 		}
 	};
 
@@ -660,10 +1619,11 @@ public:
 	}
 	~backend() {
 		log.d(__,"this=%p", this);
+		dispatch();
 		while( child_list.size() ) {
-			auto & child = child_list.back();
+			/* request_removal erases the entry, so the pointer is copied	*/
+			file_channel* child = child_list.back();
 			request_removal(child);
-			child_list.pop_back();
 			child->close();
 		}
 		cleanup();
@@ -671,8 +1631,11 @@ public:
 		for(int i = N; i && delete_list.size(); --i) {
 //			log.d(__,"delete_list.size()=%d count=%d", delete_list.size(),i);
 			handle_libusb_events((N+1-i)*100);
+			dispatch();
+			timers.expire(nanotime());
 			cleanup();
 		}
+		delete page;
 		libusb_exit(ctx);
 	}
 
@@ -691,43 +1654,228 @@ public:
 			const eia_tia_232_info& pi) throw(error_t) {
 		validate(pi);
 		validate(ch);
-		return attach(find(id), id.ifc, ch, pi);
+		stopwatch sw;
+		return attach(sw, find(id), id.ifc, ch, pi);
 	}
 
 	inline int attach(device_addr addr, channel ch,
 			const eia_tia_232_info& pi) throw(error_t) {
 		validate(pi);
 		validate(ch);
-		return attach(find(addr), addr.ifc, ch, pi);
+		if( addr.busid == loopback_driver::bus )
+			return loopback(addr, ch, pi, false);
+		stopwatch sw;
+		return attach(sw, find(addr), addr.ifc, ch, pi);
 	}
 
-	int attach(libusb_device* dev, uint8_t ifc, channel& ch,
+	/** attaches device, accounting time of each bring-up phase			*/
+	int attach(stopwatch& sw, libusb_device* dev, uint8_t ifc, channel& ch,
 			const eia_tia_232_info& pi, bool pipes = false) throw(error_t) {
-		bool ok1 = false, ok2 = false;
+		sw.lap(phase_enumerate);
+		try {
+			const int res = attach(dev, ifc, ch, pi, pipes, sw);
+			account(sw.timing, res == +error_t::success);
+			return res;
+		} catch(...) {
+			account(sw.timing, false);
+			throw;
+		}
+	}
+
+	int attach(libusb_device* dev, uint8_t ifc, channel& ch,
+			const eia_tia_232_info& pi, bool pipes, stopwatch& sw)
+				throw(error_t) {
 		if( dev == nullptr ) return -error_t::no_device;
-		transaction<driver> drv(ok1, create(dev, ifc));
+		return attach(create(dev, ifc, sw), ch, pi, pipes, sw);
+	}
+
+	/** attaches a channel to the driver, takes ownership of the driver	*/
+	int attach(driver* device, channel& ch, const eia_tia_232_info& pi,
+			bool pipes, stopwatch& sw) throw(error_t) {
+		bool ok1 = false, ok2 = false;
+		transaction<driver> drv(ok1, device);
 		transaction<file_channel> child(ok2, (pipes ?
 			new pipe_channel(*this, ch, drv):new file_channel(*this, ch, drv)));
 		ok1 = true;
 		log.i(__,"channel {%d,%d}", ch.fd_read, ch.fd_write);
 		drv->setup(pi);
-		child->init();
+		sw.lap(phase_setup);
+		/* the loop may run on another thread, init adds to poll_list,
+		 * which the loop reads along with child_list under its own lock */
+		lock_guard<decltype(poll_list)> polling(poll_list);
+		lock_guard<decltype(child_list)> listing(child_list);
+		child->init(pi);
+		sw.lap(phase_init);
+		child->bringup = sw.timing;
+		PROBE(attach, (file_channel*) child, ch.fd_read, ch.fd_write);
 		child_list.push_back(child);
 		ok2 = true;
 		return +error_t::success;
 	}
 
+	/** attaches channel to a simulated device replaying a capture file	*/
+	int replay(channel& ch, const char* path, unsigned mode,
+			const eia_tia_232_info& pi) throw(error_t) {
+		throw_if(path == nullptr, __, "path");
+		validate(pi);
+		validate(ch);
+		log.i(__,"replaying %s", path);
+		return simulate(new replayer(path, mode, timers), ch, pi, false);
+	}
+
+	/** registers a loopback device on the virtual bus					*/
+	int loopback(device_addr& addr, time_us_t latency, unsigned chunk)
+															throw(error_t) {
+		if( chunk == 0 ) chunk = loopback_driver::default_chunk;
+		throw_if(chunk > loopback_driver::fifo_size, __, "chunk");
+		lock_guard<mutex> lock(loopback_lock);
+		throw_if(loopbacks.size() >= UINT8_MAX, __, "too many loopbacks");
+		loopbacks.push_back({latency, (size_t) chunk});
+		addr = { loopback_driver::bus, (uint8_t) loopbacks.size(), 0 };
+		return +error_t::success;
+	}
+
+	/** attaches channel to a new instance of a registered loopback		*/
+	int loopback(const device_addr& addr, channel& ch,
+			const eia_tia_232_info& pi, bool pipes) throw(error_t) {
+		loopback_spec spec;
+		{
+			lock_guard<mutex> lock(loopback_lock);
+			if( addr.devid == 0 || addr.devid > loopbacks.size() )
+				return -error_t::no_device;
+			spec = loopbacks[addr.devid - 1];
+		}
+		simulator* sim = new loopback_driver(timers, spec.latency, spec.chunk);
+		sim->location = addr;
+		return simulate(sim, ch, pi, pipes);
+	}
+
+	/** attaches channel to a simulated device, transfers submitted by
+	 *  init are accepted once the channel is listed						*/
+	int simulate(simulator* sim, channel& ch, const eia_tia_232_info& pi,
+			bool pipes) throw(error_t) {
+		stopwatch sw;
+		/* set before attach lists the channel, transfers may be submitted
+		 * from other threads as soon as it is listed						*/
+		sim->wake = [this, sim]() {
+			post([this, sim]() {
+				auto owns = [sim](file_channel* c) { return c->drv == sim; };
+				if( any_of(child_list.begin(), child_list.end(), owns) ||
+					any_of(delete_list.begin(), delete_list.end(), owns) )
+					sim->accept();
+			});
+		};
+		const int res = attach(sim, ch, pi, pipes, sw);
+		if( res != +error_t::success ) return res;
+		/* transfers submitted before the channel was listed			*/
+		sim->wake();
+		return res;
+	}
+
+	void account(const attach_timing& t, bool success) noexcept {
+		lock_guard<mutex> lock(report_lock);
+		++report.attaches;
+		if( ! success ) ++report.failures;
+		for(unsigned i = 0; i < attach_phases; ++i) {
+			report.total[i] += t.phase[i];
+			if( t.phase[i] > report.max[i] ) report.max[i] = t.phase[i];
+		}
+	}
 
 	inline int pipe(device_id id, channel& ch,
 			const eia_tia_232_info& pi) throw(error_t) {
 		validate(pi);
-		return attach(find(id), id.ifc, ch, pi, true);
+		stopwatch sw;
+		return attach(sw, find(id), id.ifc, ch, pi, true);
 	}
 
 	inline int pipe(device_addr ba, channel& ch,
 			const eia_tia_232_info& pi) throw(error_t) {
 		validate(pi);
-		return attach(find(ba), ba.ifc, ch, pi, true);
+		if( ba.busid == loopback_driver::bus )
+			return loopback(ba, ch, pi, true);
+		stopwatch sw;
+		return attach(sw, find(ba), ba.ifc, ch, pi, true);
+	}
+
+	/** submits one copy of data to every member of the group,
+	 *  returns number of members the data was queued to */
+	int broadcast(const channel* group, unsigned count, const void* data,
+			unsigned size, broadcast_cb cb, void* user) throw(error_t) {
+		throw_if(group == nullptr && count, __, "group");
+		throw_if(data == nullptr || size == 0, __, "data");
+		shared_buffer* buff = shared_buffer::create(data, size);
+		int queued = 0;
+		for(unsigned i = 0; i < count; ++i) {
+			const channel member = group[i];
+			file_channel* child = find(member);
+			int res = -error_t::no_channel;
+			if( child ) try {
+				child->send(buff, [cb, user, member](int status, unsigned sent) {
+					if( cb ) cb(user, member, status, sent);
+				});
+				++queued;
+				continue;
+			} catch(error_t err) {
+				res = -err;
+			}
+			/* failures are reported from the loop too, not under the lock	*/
+			if( cb ) post([cb, user, member, res]() {
+				cb(user, member, res, 0);
+			});
+		}
+		buff->unref();
+		return queued;
+	}
+
+	/** replaces the stats page, nullptr stops publishing				*/
+	void install(stats_page* p) noexcept {
+		for(auto child : child_list) child->shmslot = -1;
+		delete page;
+		page = p;
+		if( page ) timers.schedule(publisher, nanotime());
+		else timers.cancel(publisher);
+	}
+
+	/** updates stats page slots of all channels							*/
+	void publish(uint64_t now) noexcept {
+		for(auto child : child_list) {
+			if( child->shmslot < 0 ) {
+				if( (child->shmslot = page->acquire()) < 0 ) continue;
+				page->update(child->shmslot, [child](usbuart_shm_slot& s) {
+					child->identify(s);
+				});
+			}
+			page->update(child->shmslot, [child, now](usbuart_shm_slot& s) {
+				child->publish(s, now);
+			});
+		}
+		page->touch(now);
+		timers.schedule(publisher, now + page->interval * 1000000ull);
+	}
+
+	/** posts a job to be run on the event loop thread					*/
+	void post(function<void()> job) noexcept {
+		{
+			lock_guard<mutex> lock(inbox_lock);
+			inbox.push_back(move(job));
+		}
+		libusb_interrupt_event_handler(ctx);
+	}
+
+	/** runs posted jobs, called from the event loop						*/
+	void dispatch() noexcept {
+		vector<function<void()>> jobs;
+		{
+			lock_guard<mutex> lock(inbox_lock);
+			jobs.swap(inbox);
+		}
+		for(auto& job : jobs) job();
+	}
+
+	inline bool posted() noexcept {
+		lock_guard<mutex> lock(inbox_lock);
+		return inbox.size() != 0;
 	}
 
 	void append_poll_list(vector<pollfd>& list) noexcept {
@@ -746,17 +1894,42 @@ public:
 	}
 
 
+	/* libusb waits with millisecond resolution, so when a timer is armed
+	 * the loop polls libusb descriptors itself, waiting with ppoll up to
+	 * the deadline, and then handles libusb events without blocking */
 	int handle_events(int timeout) throw(error_t) {
-		if( poll_list.size() == 0 ) return handle_libusb_events(timeout);
-		int res = poll_events(timeout);
-		return res >= 0 ? handle_libusb_events(timeout) : res;
+		const uint64_t deadline = timers.next();
+		if( poll_list.size() == 0 && deadline == timer_queue::never )
+			return handle_libusb_events(timeout);
+		int res = poll_events(timeout, deadline);
+		return res >= 0 ? handle_libusb_events(0) : res;
+	}
+
+	/** returns time to wait in nanoseconds, or never					*/
+	uint64_t waittime(int timeout, uint64_t deadline) noexcept {
+		uint64_t wait = timeout < 0 ? timer_queue::never :
+				(uint64_t) timeout * 1000000u;
+		timeval tv;
+		if( ! libusb_pollfds_handle_timeouts(ctx) &&
+			libusb_get_next_timeout(ctx, &tv) == 1 ) {
+			const uint64_t next = (uint64_t) tv.tv_sec * 1000000000u +
+					(uint64_t) tv.tv_usec * 1000u;
+			if( next < wait ) wait = next;
+		}
+		if( deadline == timer_queue::never ) return wait;
+		const uint64_t now = nanotime();
+		if( deadline <= now ) return 0;
+		return deadline - now < wait ? deadline - now : wait;
 	}
 
-	int poll_events(int timeout) throw(error_t) {
-		if( poll_list.size() == 0 ) return 0;
+	int poll_events(int timeout, uint64_t deadline) throw(error_t) {
 		vector<pollfd> pollfd_list(poll_list);
 		append_poll_list(pollfd_list);
-		int polled = poll(poll_list.data(), poll_list.size(), timeout);
+		const uint64_t wait = waittime(timeout, deadline);
+		const timespec ts {
+			(time_t)(wait / 1000000000u), (long)(wait % 1000000000u) };
+		int polled = ppoll(pollfd_list.data(), pollfd_list.size(),
+				wait == timer_queue::never ? nullptr : &ts, nullptr);
 		if( polled < 0 ) {
 			if( polled == EINVAL ) throw error_t::poll_error;
 			throw_error(__,errno);
@@ -780,6 +1953,7 @@ public:
 	 * poll already quit, so it is safe to add to the poll_list
 	 */
 	inline void poll_request(int fd, short int events) noexcept {
+		PROBE(poll_request, fd, events);
 		if( util::find(poll_list, fd) != poll_list.end() ) {
 			log.w(__, "%d already in poll_list", fd);
 			return;
@@ -802,10 +1976,12 @@ public:
 		});
 	}
 
-	driver* create(libusb_device* dev, uint8_t id) throw(error_t) {
+	driver* create(libusb_device* dev, uint8_t id, stopwatch& sw)
+			throw(error_t) {
 		libusb_device_handle* devh;
 		int res = libusb_open(dev, &devh);
 		libusb_unref_device(dev); /* it was refed in find */
+		sw.lap(phase_open);
 		if( res ) {
 			int err = errno;
 			log.i(__,"libusb_open fail (%d) %s%s%s", res,
@@ -816,7 +1992,19 @@ public:
 
 		bool success = false;
 		transaction<libusb_device_handle> begin(success, devh);
-		driver* result = registrar().create(devh,id);
+		claim_time = 0;
+		auto probed = [&sw]() {	/* claims are done by probing drivers	*/
+			sw.lap(phase_probe);
+			sw.timing.phase[phase_probe] -= claim_time;
+			sw.timing.phase[phase_claim] += claim_time;
+		};
+		driver* result;
+		try { result = registrar().create(devh,id); }
+		catch(...) {
+			probed();
+			throw;
+		}
+		probed();
 		success = result != nullptr;
 		return result;
 	}
@@ -847,6 +2035,8 @@ public:
 //		log.d(__,"%p",child);
 		if( child == nullptr ) return;
 		request_removal(child);
+		child->close(); /* cancels transfers, so cleanup does not wait
+						 * for them to time out							*/
 	}
 
 	inline void request_removal(file_channel* child) noexcept {
@@ -857,6 +2047,21 @@ public:
 		}
 	}
 
+	/* synchronous clear_halt is not allowed in libusb callbacks,
+	 * so channels are queued for recovery by the loop					*/
+	inline void request_recovery(file_channel* child) noexcept {
+		if( util::find(halted, child) == halted.end() )
+			halted.push_back(child);
+	}
+
+	void recover() noexcept {
+		vector<file_channel*> list;
+		list.swap(halted);	/* recover may queue channels again			*/
+		for(auto child : list)
+			if( util::find(delete_list, child) == delete_list.end() )
+				child->recover();
+	}
+
 	bool cleanup() noexcept {
 //		if( delete_list.size() > 0 )
 //			log.d(__,"delete_list[0]==%p child_list[0]=%p",delete_list[0],
@@ -871,6 +2076,8 @@ public:
 			util::erase(poll_list, child->fdrd);
 			util::erase(poll_list, child->fdrw);
 			child->close();
+			if( page ) page->release(child->shmslot);
+			util::erase(halted, child);
 			delete child;
 			delete_list.erase(i);
 		}
@@ -888,13 +2095,74 @@ public:
 	vector_lock<pollfd> poll_list;
 	vector_lock<file_channel*> child_list;
 	vector<file_channel*> delete_list;
+	vector<file_channel*> halted;	/* loop thread only					*/
+	vector<function<void()>> inbox;
+	mutex inbox_lock;
+	timer_queue timers;
+	struct publishing : timer {
+		inline publishing(backend& b) noexcept : owner(b) {}
+		void expired(uint64_t now) noexcept { owner.publish(now); }
+		backend& owner;
+	} publisher { *this };
+	stats_page* page = nullptr;
+	attach_report report = {};
+	mutex report_lock;
+	struct loopback_spec {
+		time_us_t latency;
+		size_t chunk;
+	};
+	vector<loopback_spec> loopbacks;	/* registered loopbacks			*/
+	mutex loopback_lock;
 	bool pending = false;
 };
 
 inline void file_channel::poll_request(int fd, bool reading) noexcept {
+	bump(counters.poll_requests, 1);
 	owner.poll_request(fd, reading ? (POLLIN|POLLHUP):(POLLOUT|POLLHUP));
 }
 
+inline timer_queue& file_channel::timers() noexcept {
+	return owner.timers;
+}
+
+/** schedules release of held transfers on the event loop					*/
+inline void file_channel::wake() noexcept {
+	context::backend& loop(owner);
+	file_channel* self = this;
+	loop.post([&loop, self]() {
+		if( util::find(loop.child_list, self) != loop.child_list.end() )
+			self->release();
+	});
+}
+
+inline bool file_channel::halt(libusb_transfer* transfer) noexcept {
+	const uint8_t bit =
+		transfer == readxfer0 ? halt_read0 :
+		transfer == readxfer1 ? halt_read1 :
+		transfer == writexfer ? halt_write :
+		transfer->callback == out_cb ? halt_outbound : 0;
+	if( bit == 0 || recovery_limit == 0 || device_hangup ) return false;
+	if( halted == 0 ) {	/* a new recovery							*/
+		const uint64_t now = nanotime();
+		if( now - window_start > recovery_window ) {
+			window_start = now;
+			window_halts = 0;
+		}
+		if( ++window_halts > recovery_limit ) {
+			log.e(__,"%u recoveries in %u ms, giving up", recovery_limit,
+				(unsigned)(recovery_window / 1000000));
+			return false;
+		}
+		owner.request_recovery(this);
+	}
+	halted |= bit;
+	if( transfer->status == LIBUSB_TRANSFER_STALL )
+		halted |= transfer == readxfer0 || transfer == readxfer1 ?
+				halt_in : halt_out;
+	log.w(__,"transfer error %d, recovering", transfer->status);
+	return true;
+}
+
 inline void file_channel::request_removal(bool enforce) noexcept {
 	device_hangup = device_hangup || enforce;
 	if( device_hangup || (pipein_hangup && pipeout_hangup) ) {
@@ -954,6 +2222,7 @@ int context::pipe(device_addr ba, channel& ch,
 /** close channel, detaches files from USB device						*/
 void context::close(channel ch) noexcept {
 	safe(__,[&]{
+		lock_guard<decltype(priv->poll_list)> polling(priv->poll_list);
 		lock_guard<decltype(priv->child_list)> lock(priv->child_list);
 		priv->close(ch);
 		return 0;
@@ -992,15 +2261,315 @@ int context::sendbreak(channel ch) noexcept {
 	});
 }
 
+/** sends one copy of data to every channel in the group				*/
+int context::broadcast(const channel* group, unsigned count, const void* data,
+		unsigned size, broadcast_cb cb, void* user) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		return priv->broadcast(group, count, data, size, cb, user);
+	});
+}
+
+/** opens a stream of rx_timestamp records								*/
+int context::timestamps(channel ch, int& fd, unsigned flags) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		int fds[2];
+		if( ::pipe(fds) ) throw error_t::pipe_error;
+		try { setnonblock(fds[1]); }
+		catch(error_t) {
+			::close(fds[0]);
+			::close(fds[1]);
+			throw;
+		}
+		const int wr = fds[1];
+		priv->post([this, ch, wr, flags]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->timestamps(wr, flags);
+			else ::close(wr);
+		});
+		fd = fds[0];
+		return +error_t::success;
+	});
+}
+
+/** sets receive callback												*/
+int context::onreceive(channel ch, receive_cb cb, void* user,
+		unsigned flags) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		priv->post([this, ch, cb, user, flags]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->onreceive(cb, user, flags);
+		});
+		return +error_t::success;
+	});
+}
+
+/** sets framing for the channel										*/
+int context::framing(channel ch, const framing_info& fi, frame_cb cb,
+		void* user) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		framer* f = fi.type == frame_none ? nullptr :
+				framer::create(fi, cb, user);
+		const framing_info info = fi;
+		priv->post([this, ch, f, info]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->framing(f, info);
+			else delete f;
+		});
+		return +error_t::success;
+	});
+}
+
+/** encodes and sends a frame											*/
+int context::send_frame(channel ch, const void* data, unsigned size) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		file_channel* child = priv->find(ch);
+		if( child == nullptr ) return -error_t::no_channel;
+		throw_if(data == nullptr && size, __, "data");
+		child->send_frame(data, size);
+		return +error_t::success;
+	});
+}
+
+/** sets checksum for the framed channel								*/
+int context::checksum(channel ch, crc_t type) noexcept {
+	return safe(__,[&]()->int{
+		throw_if(type > crc_32, __, "crc");
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		priv->post([this, ch, type]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->checksum(type);
+		});
+		return +error_t::success;
+	});
+}
+
+/** returns data path counters											*/
+int context::stats(channel ch, channel_stats& cs) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		file_channel* child = priv->find(ch);
+		if( child == nullptr ) return -error_t::no_channel;
+		child->stats(cs);
+		return +error_t::success;
+	});
+}
+
+/** publishes channel counters to a shared memory stats page			*/
+int context::publish(const char* path, unsigned interval) noexcept {
+	return safe(__,[&]()->int{
+		stats_page* page = path ? new stats_page(path, interval) : nullptr;
+		priv->post([this, page]() { priv->install(page); });
+		return +error_t::success;
+	});
+}
+
+/** returns bring-up timing of the channel								*/
+int context::bringup(channel ch, attach_timing& t) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		file_channel* child = priv->find(ch);
+		if( child == nullptr ) return -error_t::no_channel;
+		t = child->bringup;
+		return +error_t::success;
+	});
+}
+
+/** returns bring-up timing aggregated over all attaches				*/
+void context::bringup_report(attach_report& r) noexcept {
+	lock_guard<mutex> lock(priv->report_lock);
+	r = priv->report;
+}
+
+/** returns latency histogram											*/
+int context::latency(channel ch, latency_t which, latency_histogram& h,
+		bool reset) noexcept {
+	return safe(__,[&]()->int{
+		throw_if(which > lat_tx_complete, __, "which");
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		file_channel* child = priv->find(ch);
+		if( child == nullptr ) return -error_t::no_channel;
+		child->latency(which, h, reset);
+		return +error_t::success;
+	});
+}
+
+/** returns framing counters											*/
+int context::framestats(channel ch, frame_stats& fs) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		file_channel* child = priv->find(ch);
+		if( child == nullptr ) return -error_t::no_channel;
+		child->framestats(fs);
+		return +error_t::success;
+	});
+}
+
+/** submits data at the deadline										*/
+int context::send_at(channel ch, const void* data, unsigned size,
+		uint64_t deadline, schedule_cb cb, void* user) noexcept {
+	return safe(__,[&]()->int{
+		throw_if(data == nullptr || size == 0, __, "data");
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		shared_buffer* buff = shared_buffer::create(data, size);
+		scheduled* s = new scheduled(ch, cb, user);
+		priv->post([this, s, buff, deadline]() {
+			file_channel* child = priv->find(s->ch);
+			int res = -error_t::no_channel;
+			if( child ) try {
+				child->send_at(s, buff, deadline);
+				buff->unref();
+				return;
+			} catch(error_t err) {
+				res = -err;
+			}
+			buff->unref();
+			if( s->cb ) s->cb(s->user, s->ch, res, 0, 0);
+			delete s;
+		});
+		return +error_t::success;
+	});
+}
+
+/** sets transmit pacing lead window									*/
+int context::pace(channel ch, unsigned lead) noexcept {
+	return safe(__,[&]()->int{
+		throw_if(lead > UINT32_MAX / 1000, __, "lead");
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		priv->post([this, ch, lead]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->pace(lead * 1000);
+		});
+		return +error_t::success;
+	});
+}
+
+/** attaches channel to a replay of a capture file						*/
+int context::replay(channel ch, const char* path, unsigned mode,
+		const eia_tia_232_info& pi) noexcept {
+	return safe(__,[&]{ return priv->replay(ch, path, mode, pi); });
+}
+
+/** registers an in-process loopback device							*/
+int context::loopback(device_addr& addr, unsigned latency,
+		unsigned chunk) noexcept {
+	return safe(__,[&]{ return priv->loopback(addr, latency, chunk); });
+}
+
+/** starts or stops traffic capture of the channel						*/
+int context::capture(channel ch, const char* path, unsigned limit) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		capture_file* file = path ? new capture_file(path, limit) : nullptr;
+		priv->post([this, ch, file]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->capture(file);
+			else delete file;
+		});
+		return +error_t::success;
+	});
+}
+
+/** starts or stops fault injection into transfers of the channel		*/
+int context::inject(channel ch, const fault_plan* plan) noexcept {
+	return safe(__,[&]()->int{
+		if( plan )
+			for(auto rate : plan->rate)
+				throw_if(rate > fault_injector::million, __, "rate");
+		/* transfers are submitted from user threads and from the loop,
+		 * holding either of these, so the injector is swapped under both	*/
+		lock_guard<decltype(priv->poll_list)> polling(priv->poll_list);
+		lock_guard<decltype(priv->child_list)> lock(priv->child_list);
+		file_channel* child = priv->find(ch);
+		if( child == nullptr ) return -error_t::no_channel;
+		child->inject(plan);
+		return +error_t::success;
+	});
+}
+
+/** sets limit of in place recoveries from endpoint errors				*/
+int context::recovery(channel ch, unsigned limit, unsigned window) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		priv->post([this, ch, limit, window]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->recovery(limit, window);
+		});
+		return +error_t::success;
+	});
+}
+
+/** returns fault injection counters									*/
+int context::faults(channel ch, fault_stats& fs) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		file_channel* child = priv->find(ch);
+		if( child == nullptr ) return -error_t::no_channel;
+		child->faultstats(fs);
+		return +error_t::success;
+	});
+}
+
+/** sets software XON/XOFF flow control options						*/
+int context::xonxoff(channel ch, bool strip) noexcept {
+	return safe(__,[&]()->int{
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		priv->post([this, ch, strip]() {
+			file_channel* child = priv->find(ch);
+			if( child ) child->xonxoff(strip);
+		});
+		return +error_t::success;
+	});
+}
+
+/** sends request and matches response in the event loop				*/
+int context::transact(channel ch, const void* request, unsigned size,
+		const match_spec& match, unsigned timeout, transact_cb cb,
+		void* user) noexcept {
+	return safe(__,[&]()->int{
+		throw_if(request == nullptr || size == 0, __, "request");
+		shared_guard<decltype(priv->child_list)> lock(priv->child_list);
+		if( priv->find(ch) == nullptr ) return -error_t::no_channel;
+		exchange* x = new exchange(ch,
+			shared_buffer::create(request, size), match, timeout, cb, user);
+		priv->post([this, x]() {
+			file_channel* child = priv->find(x->ch);
+			if( child ) {
+				child->transact(x);
+				return;
+			}
+			if( x->cb ) x->cb(x->user, x->ch, -error_t::no_channel, nullptr, 0);
+			delete x;
+		});
+		return +error_t::success;
+	});
+}
+
 /** run libusb and async I/O message loops								*/
 int context::loop(int timeout) noexcept {
 	return safe(__,[&]()->int{
 		int result;
 		{
 			lock_guard<decltype(priv->poll_list)> lock(priv->poll_list);
-			result = priv->handle_events(timeout);
+			result = priv->handle_events(priv->posted() ? 0 : timeout);
 		}
 		shared_guard<decltype(priv->child_list)> locked(priv->child_list);
+		if( priv->halted.size() ) priv->recover();
+		priv->dispatch();
+		priv->timers.expire(nanotime());
 		if( priv->pending ) priv->handle_pending_events();
 		if( priv->delete_list.size() ) {
 			priv->handle_libusb_events(timeout);
@@ -1029,6 +2598,10 @@ loglevel_t context::setloglevel(loglevel_t lvl) noexcept {
 	return old;
 }
 
+bool context::setlogasync(bool async) noexcept {
+	return log.async(async);
+}
+
 
 } /* namespace usbuart */
 bool operator==(const usbuart::file_channel* ch, const pollfd& fd) noexcept {
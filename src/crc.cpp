@@ -0,0 +1,289 @@
+/** @brief CRC16-CCITT, CRC16-Modbus and CRC32 kernels
+ *  @file  crc.cpp
+ *  @addtogroup core
+ *  Table driven kernels process eight bytes per step (slicing-by-8).
+ *  CRC32 uses carry-less multiplication folding on x86 with PCLMULQDQ
+ *  and CRC32 instructions on ARMv8 when available.
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cstring>
+#include "crc.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#	include <immintrin.h>
+#	define USBUART_CRC_PCLMUL
+#elif defined(__ARM_FEATURE_CRC32)
+#	include <arm_acle.h>
+#endif
+
+namespace usbuart {
+
+/**
+ * slicing-by-8 tables
+ * t[k][b] is the CRC register after byte b followed by k zero bytes
+ */
+struct slicing_table {
+	uint32_t t[8][256];
+};
+
+/** tables for reflected polynomials, LSB first						*/
+static slicing_table reflected(uint32_t poly) noexcept {
+	slicing_table tbl;
+	for(unsigned i = 0; i < 256; ++i) {
+		uint32_t c = i;
+		for(int j = 0; j < 8; ++j)
+			c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+		tbl.t[0][i] = c;
+	}
+	for(unsigned i = 0; i < 256; ++i)
+		for(int k = 1; k < 8; ++k)
+			tbl.t[k][i] = (tbl.t[k-1][i] >> 8) ^ tbl.t[0][tbl.t[k-1][i] & 0xFF];
+	return tbl;
+}
+
+/** tables for 16 bit normal polynomials, MSB first					*/
+static slicing_table normal16(uint16_t poly) noexcept {
+	slicing_table tbl;
+	for(unsigned i = 0; i < 256; ++i) {
+		uint32_t c = i << 8;
+		for(int j = 0; j < 8; ++j)
+			c = ((c & 0x8000) ? (c << 1) ^ poly : c << 1) & 0xFFFF;
+		tbl.t[0][i] = c;
+	}
+	for(unsigned i = 0; i < 256; ++i)
+		for(int k = 1; k < 8; ++k)
+			tbl.t[k][i] = ((tbl.t[k-1][i] << 8) & 0xFFFF) ^
+						  tbl.t[0][tbl.t[k-1][i] >> 8];
+	return tbl;
+}
+
+static const slicing_table& ccitt_table() noexcept {
+	static const slicing_table tbl = normal16(0x1021);
+	return tbl;
+}
+
+static const slicing_table& modbus_table() noexcept {
+	static const slicing_table tbl = reflected(0xA001);
+	return tbl;
+}
+
+static const slicing_table& crc32_table() noexcept {
+	static const slicing_table tbl = reflected(0xEDB88320);
+	return tbl;
+}
+
+static inline uint32_t load32le(const uint8_t* p) noexcept {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/** reflected CRC of up to 32 bits, c is the CRC register				*/
+static uint32_t slice_reflected(const slicing_table& tbl, uint32_t c,
+		const uint8_t* p, std::size_t n) noexcept {
+	const auto& t(tbl.t);
+	for(; n >= 8; n -= 8, p += 8) {
+		const uint32_t lo = load32le(p) ^ c;
+		const uint32_t hi = load32le(p + 4);
+		c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+			t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^
+			t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+	}
+	for(; n; --n, ++p)
+		c = (c >> 8) ^ t[0][(c ^ *p) & 0xFF];
+	return c;
+}
+
+/** normal CRC16, c is the CRC register									*/
+static uint32_t slice_normal16(const slicing_table& tbl, uint32_t c,
+		const uint8_t* p, std::size_t n) noexcept {
+	const auto& t(tbl.t);
+	for(; n >= 8; n -= 8, p += 8) {
+		c = t[7][p[0] ^ (c >> 8)] ^ t[6][p[1] ^ (c & 0xFF)] ^
+			t[5][p[2]] ^ t[4][p[3]] ^ t[3][p[4]] ^
+			t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+	}
+	for(; n; --n, ++p)
+		c = ((c << 8) & 0xFFFF) ^ t[0][(c >> 8) ^ *p];
+	return c;
+}
+
+#ifdef USBUART_CRC_PCLMUL
+/**
+ * CRC32 folding with carry-less multiplication, as described in
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction", Intel, 2009. Requires n >= 64 and n % 16 == 0
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t fold_crc32(uint32_t c, const uint8_t* p, std::size_t n)
+																	noexcept {
+	alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+	alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+	alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+	alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(c));
+	x0 = _mm_load_si128((const __m128i*) k1k2);
+	p += 64;
+	n -= 64;
+	/* fold by four 128 bit lanes */
+	for(; n >= 64; n -= 64, p += 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+				_mm_loadu_si128((const __m128i*)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+				_mm_loadu_si128((const __m128i*)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+				_mm_loadu_si128((const __m128i*)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+				_mm_loadu_si128((const __m128i*)(p + 0x30)));
+	}
+	/* fold four lanes into one */
+	x0 = _mm_load_si128((const __m128i*) k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+	/* fold remaining 16 byte blocks */
+	for(; n >= 16; n -= 16, p += 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+				_mm_loadu_si128((const __m128i*) p));
+	}
+	/* fold 128 bits to 64 */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i*) k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	/* Barrett reduction to 32 bits */
+	x0 = _mm_load_si128((const __m128i*) poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return _mm_extract_epi32(x1, 1);
+}
+
+static bool has_pclmul() noexcept {
+	static const bool yes = __builtin_cpu_supports("pclmul") &&
+							__builtin_cpu_supports("sse4.1");
+	return yes;
+}
+#endif
+
+static uint32_t crc32_register(uint32_t c, const uint8_t* p, std::size_t n)
+																	noexcept {
+#if defined(USBUART_CRC_PCLMUL)
+	if( n >= 64 && has_pclmul() ) {
+		const std::size_t bulk = n & ~(std::size_t)15;
+		c = fold_crc32(c, p, bulk);
+		p += bulk;
+		n -= bulk;
+	}
+#elif defined(__ARM_FEATURE_CRC32)
+	for(; n >= 8; n -= 8, p += 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		c = __crc32d(c, v);
+	}
+	for(; n; --n, ++p)
+		c = __crc32b(c, *p);
+	return c;
+#endif
+	return slice_reflected(crc32_table(), c, p, n);
+}
+
+unsigned crc::size(crc_t type) noexcept {
+	switch( type ) {
+	case crc_ccitt:
+	case crc_modbus:	return 2;
+	case crc_32:		return 4;
+	default:			return 0;
+	}
+}
+
+uint32_t crc::compute(crc_t type, const uint8_t* data, std::size_t n)
+																	noexcept {
+	switch( type ) {
+	case crc_ccitt:
+		return slice_normal16(ccitt_table(), 0xFFFF, data, n);
+	case crc_modbus:
+		return slice_reflected(modbus_table(), 0xFFFF, data, n);
+	case crc_32:
+		return ~crc32_register(0xFFFFFFFF, data, n);
+	default:
+		return 0;
+	}
+}
+
+/** stores checksum c as the trailer of given type					*/
+static void store(crc_t type, uint32_t c, uint8_t* out) noexcept {
+	switch( type ) {
+	case crc_ccitt:
+		out[0] = c >> 8;
+		out[1] = c;
+		break;
+	case crc_32:
+		out[3] = c >> 24;
+		out[2] = c >> 16;
+		/* fallthrough */
+	case crc_modbus:
+		out[1] = c >> 8;
+		out[0] = c;
+		break;
+	default:;
+	}
+}
+
+unsigned crc::append(crc_t type, uint8_t* data, unsigned n) noexcept {
+	store(type, compute(type, data, n), data + n);
+	return n + size(type);
+}
+
+bool crc::verify(crc_t type, const uint8_t* data, unsigned n) noexcept {
+	const unsigned len = size(type);
+	if( n < len ) return false;
+	uint8_t trailer[4];
+	store(type, compute(type, data, n - len), trailer);
+	return memcmp(trailer, data + n - len, len) == 0;
+}
+
+} /* namespace usbuart */
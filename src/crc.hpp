@@ -0,0 +1,52 @@
+/** @brief checksum kernels
+ *  @file  crc.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#ifndef CRC_HPP_
+#define CRC_HPP_
+#include <cstddef>
+#include "usbuart.hpp"
+
+namespace usbuart {
+
+/**
+ * Checksums for framed channels
+ *  crc_ccitt	- CRC-16/CCITT-FALSE, trailer is big endian
+ *  crc_modbus	- CRC-16/MODBUS, trailer is little endian
+ *  crc_32		- CRC-32 (ISO-HDLC), trailer is little endian
+ */
+class crc {
+public:
+	/** returns size of the checksum trailer in bytes					*/
+	static unsigned size(crc_t) noexcept;
+	/** computes checksum of the data									*/
+	static uint32_t compute(crc_t, const uint8_t* data, std::size_t size)
+																	noexcept;
+	/** appends checksum trailer to the data, returns new size
+	 *  data must have room for size(type) more bytes					*/
+	static unsigned append(crc_t, uint8_t* data, unsigned size) noexcept;
+	/** returns true if data ends with a valid checksum trailer			*/
+	static bool verify(crc_t, const uint8_t* data, unsigned size) noexcept;
+};
+
+}
+
+#endif /* CRC_HPP_ */
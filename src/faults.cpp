@@ -0,0 +1,99 @@
+/** @brief Fault injection into USB transfers
+ *  @file  faults.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <libusb.h>
+#include "usbuart.hpp"
+#include "faults.hpp"
+
+namespace usbuart {
+
+/* completion statuses of fault_stall ... fault_no_device				*/
+static constexpr libusb_transfer_status statuses[] = {
+	LIBUSB_TRANSFER_STALL,
+	LIBUSB_TRANSFER_OVERFLOW,
+	LIBUSB_TRANSFER_TIMED_OUT,
+	LIBUSB_TRANSFER_ERROR,
+	LIBUSB_TRANSFER_NO_DEVICE
+};
+
+fault_injector::fault_injector(const fault_plan& _plan,
+		fault_counters& _counters) noexcept
+  : plan(_plan)
+  , counters(_counters)
+  , state(_plan.seed)
+  , accrued{} {
+}
+
+uint32_t fault_injector::random() noexcept {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+bool fault_injector::fire(fault_t kind) noexcept {
+	const uint32_t rate = plan.rate[kind];
+	if( rate == 0 ) return false;
+	std::lock_guard<std::mutex> guard(lock);
+	if( plan.seed ) {
+		if( random() % million >= rate ) return false;
+	} else {
+		if( (accrued[kind] += rate) < million ) return false;
+		accrued[kind] -= million;
+	}
+	bump(counters.injected[kind], 1);
+	return true;
+}
+
+bool fault_injector::submit() noexcept {
+	return fire(fault_submit);
+}
+
+int fault_injector::draw(libusb_transfer* xfer) noexcept {
+	bump(counters.transfers, 1);
+	for(unsigned kind = fault_stall; kind <= fault_no_device; ++kind) {
+		if( fire((fault_t) kind) ) {
+			log.d(__,"%p status %d", xfer, statuses[kind]);
+			return statuses[kind];
+		}
+	}
+	return LIBUSB_TRANSFER_COMPLETED;
+}
+
+int fault_injector::cut(libusb_transfer* xfer, int length) noexcept {
+	if( length == 0 || ! fire(xfer->endpoint & LIBUSB_ENDPOINT_IN ?
+			fault_short_read : fault_partial_write) )
+		return length;
+	std::lock_guard<std::mutex> guard(lock);
+	length = plan.seed ? random() % length : length / 2;
+	log.d(__,"%p cut to %d", xfer, length);
+	return length;
+}
+
+void fault_injector::complete(libusb_transfer* xfer) noexcept {
+	if( xfer->status != LIBUSB_TRANSFER_COMPLETED ) return;
+	xfer->status = (libusb_transfer_status) draw(xfer);
+	if( xfer->status == LIBUSB_TRANSFER_COMPLETED )
+		xfer->actual_length = cut(xfer, xfer->actual_length);
+}
+
+}
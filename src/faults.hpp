@@ -0,0 +1,72 @@
+/** @brief Fault injection into USB transfers
+ *  @file  faults.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef FAULTS_HPP_
+#define FAULTS_HPP_
+#include <atomic>
+#include <mutex>
+
+struct libusb_transfer;
+
+namespace usbuart {
+
+/** injection counters, kept by the channel, readable from any thread	*/
+struct fault_counters {
+	std::atomic<uint64_t> transfers;
+	std::atomic<uint32_t> injected[USBUART_FAULT_KINDS];
+};
+
+/**
+ * Injects faults into transfers of a channel according to a fault_plan.
+ * With seed 0 faults of a kind are evenly spaced, e.g. rate 1000 fails
+ * every 1000th transfer, otherwise they are drawn from a xorshift sequence.
+ * Only successful completions are altered, so cancellations and real
+ * errors reach the channel unchanged. Simulated devices draw faults before
+ * moving data, so data is neither lost nor duplicated, completions of real
+ * devices are altered after the fact.
+ * Transfers may be submitted from any thread, the state is guarded
+ */
+class fault_injector {
+public:
+	static constexpr uint32_t million = 1000000;
+	fault_injector(const fault_plan& plan, fault_counters& counters) noexcept;
+	/** returns true if the submit has to fail							*/
+	bool submit() noexcept;
+	/** alters status or length of a completed transfer					*/
+	void complete(libusb_transfer* xfer) noexcept;
+	/** counts a transfer and returns status it has to complete with		*/
+	int draw(libusb_transfer* xfer) noexcept;
+	/** returns length the transfer is cut to, of length available		*/
+	int cut(libusb_transfer* xfer, int length) noexcept;
+private:
+	bool fire(fault_t kind) noexcept;
+	uint32_t random() noexcept;
+	const fault_plan plan;
+	fault_counters& counters;
+	uint32_t state;							/* xorshift state			*/
+	uint32_t accrued[USBUART_FAULT_KINDS];	/* evenly spaced faults		*/
+	std::mutex lock;						/* guards state and accrued	*/
+};
+
+}
+#endif /* FAULTS_HPP_ */
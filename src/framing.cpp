@@ -0,0 +1,393 @@
+/** @brief Framing engine: delimiter, SLIP, COBS and HDLC framers
+ *  @file  framing.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include "framing.hpp"
+#include "scan.hpp"
+#include "crc.hpp"
+
+namespace usbuart {
+
+framer::framer(const framing_info& fi, frame_cb _cb, void* _user) noexcept
+  : check(crc_none)
+  , counters(&own)
+  , info(fi)
+  , cb(_cb)
+  , user(_user)
+  , base(nullptr)
+  , current(nullptr)
+  , first{0,0,0,0,0}
+  , overflow(false)
+  , own{{0},{0},{0}} {
+	frame.reserve(info.max_frame);
+}
+
+bool framer::admit(const uint8_t* at, unsigned size) noexcept {
+	if( overflow ) {
+		bump(counters->dropped, size);
+		return false;
+	}
+	if( frame.size() + size > info.max_frame ) {
+		log.w(__,"frame exceeds %d bytes, dropped", info.max_frame);
+		bump(counters->dropped, frame.size() + size);
+		frame.clear();
+		overflow = true;
+		return false;
+	}
+	if( frame.size() == 0 ) {
+		first = *current;
+		first.offset += at - base;
+	}
+	return true;
+}
+
+void framer::append(const uint8_t* begin, const uint8_t* end) noexcept {
+	if( begin == end || ! admit(begin, end - begin) ) return;
+	frame.insert(frame.end(), begin, end);
+}
+
+void framer::append(uint8_t byte, const uint8_t* at) noexcept {
+	if( admit(at, 1) ) frame.push_back(byte);
+}
+
+void framer::complete() noexcept {
+	if( ! overflow && frame.size() ) {
+		unsigned size = frame.size();
+		if( check != crc_none ) {
+			if( ! crc::verify(check, frame.data(), size) ) {
+				bump(counters->bad_crc, 1);
+				frame.clear();
+				return;
+			}
+			size -= crc::size(check);
+		}
+		first.length = size;
+		bump(counters->frames, 1);
+		cb(user, frame.data(), size, &first);
+	}
+	frame.clear();
+	overflow = false;
+}
+
+void framer::discard() noexcept {
+	if( ! overflow ) bump(counters->dropped, frame.size());
+	frame.clear();
+	overflow = false;
+}
+
+/*****************************************************************************/
+/** frames terminated with a delimiter byte, delimiter is not delivered	*/
+class delimiter_framer : public framer {
+public:
+	using framer::framer;
+	void feed(const uint8_t* data, unsigned size,
+			const rx_timestamp& ts) noexcept {
+		const uint8_t* end = data + size;
+		chunk(data, ts);
+		for(const uint8_t* p = data; p < end; ) {
+			const uint8_t* q = scan(p, end, info.delimiter);
+			append(p, q);
+			if( q == end ) break;
+			complete();
+			p = q + 1;
+		}
+	}
+};
+
+/*****************************************************************************/
+/** RFC 1055 SLIP														*/
+class slip_framer : public framer {
+public:
+	static constexpr uint8_t end_ = 0xC0;
+	static constexpr uint8_t esc = 0xDB;
+	static constexpr uint8_t esc_end = 0xDC;
+	static constexpr uint8_t esc_esc = 0xDD;
+
+	slip_framer(const framing_info& fi, frame_cb cb, void* user) noexcept
+	  : framer(fi, cb, user), escaped(false) {}
+
+	void feed(const uint8_t* data, unsigned size,
+			const rx_timestamp& ts) noexcept {
+		const uint8_t* end = data + size;
+		chunk(data, ts);
+		for(const uint8_t* p = data; p < end; ) {
+			if( escaped ) {
+				escaped = false;
+				if( *p == esc_end ) append(end_, p);
+				else if( *p == esc_esc ) append(esc, p);
+				else {
+					log.w(__,"invalid SLIP escape %02x", *p);
+					discard();
+					continue; /* p is reprocessed as a regular byte */
+				}
+				++p;
+				continue;
+			}
+			const uint8_t* q = scan(p, end, end_, esc);
+			append(p, q);
+			if( q == end ) break;
+			if( *q == end_ ) complete();
+			else escaped = true;
+			p = q + 1;
+		}
+	}
+
+	static unsigned encode(const uint8_t* src, unsigned size,
+			uint8_t* dst) noexcept {
+		const uint8_t* end = src + size;
+		uint8_t* out = dst;
+		*out++ = end_;
+		for(const uint8_t* p = src; p < end; ) {
+			const uint8_t* q = scan(p, end, end_, esc);
+			memcpy(out, p, q - p);
+			out += q - p;
+			if( q == end ) break;
+			*out++ = esc;
+			*out++ = *q == end_ ? esc_end : esc_esc;
+			p = q + 1;
+		}
+		*out++ = end_;
+		return out - dst;
+	}
+private:
+	bool escaped;
+};
+
+/*****************************************************************************/
+/** HDLC-like byte stuffing: 0x7E flags, 0x7D escapes next byte ^ 0x20	*/
+class hdlc_framer : public framer {
+public:
+	static constexpr uint8_t flag = 0x7E;
+	static constexpr uint8_t esc = 0x7D;
+	static constexpr uint8_t mask = 0x20;
+
+	hdlc_framer(const framing_info& fi, frame_cb cb, void* user) noexcept
+	  : framer(fi, cb, user), escaped(false) {}
+
+	void feed(const uint8_t* data, unsigned size,
+			const rx_timestamp& ts) noexcept {
+		const uint8_t* end = data + size;
+		chunk(data, ts);
+		for(const uint8_t* p = data; p < end; ) {
+			if( escaped ) {
+				escaped = false;
+				if( *p == flag ) { /* abort sequence */
+					discard();
+					++p;
+					continue;
+				}
+				append(*p ^ mask, p);
+				++p;
+				continue;
+			}
+			const uint8_t* q = scan(p, end, flag, esc);
+			append(p, q);
+			if( q == end ) break;
+			if( *q == flag ) complete();
+			else escaped = true;
+			p = q + 1;
+		}
+	}
+
+	static unsigned encode(const uint8_t* src, unsigned size,
+			uint8_t* dst) noexcept {
+		const uint8_t* end = src + size;
+		uint8_t* out = dst;
+		*out++ = flag;
+		for(const uint8_t* p = src; p < end; ) {
+			const uint8_t* q = scan(p, end, flag, esc);
+			memcpy(out, p, q - p);
+			out += q - p;
+			if( q == end ) break;
+			*out++ = esc;
+			*out++ = *q ^ mask;
+			p = q + 1;
+		}
+		*out++ = flag;
+		return out - dst;
+	}
+private:
+	bool escaped;
+};
+
+/*****************************************************************************/
+/** Consistent Overhead Byte Stuffing, frames are zero delimited.
+ *  Encoded bytes are collected up to the delimiter and decoded in place */
+class cobs_framer : public framer {
+public:
+	using framer::framer;
+	void feed(const uint8_t* data, unsigned size,
+			const rx_timestamp& ts) noexcept {
+		const uint8_t* end = data + size;
+		chunk(data, ts);
+		for(const uint8_t* p = data; p < end; ) {
+			const uint8_t* q = scan(p, end, 0);
+			append(p, q);
+			if( q == end ) break;
+			if( decode() ) complete();
+			else {
+				log.w(__,"malformed COBS frame");
+				discard();
+			}
+			p = q + 1;
+		}
+	}
+
+	static unsigned encode(const uint8_t* src, unsigned size,
+			uint8_t* dst) noexcept {
+		uint8_t* code = dst;
+		uint8_t* out = dst + 1;
+		for(const uint8_t* p = src, *end = src + size; p < end; ++p) {
+			if( *p ) *out++ = *p;
+			/* a full block at the end needs no next code byte			*/
+			if( *p == 0 || (out - code == 0xFF && p + 1 < end) ) {
+				*code = out - code;
+				code = out++;
+			}
+		}
+		*code = out - code;
+		*out++ = 0;
+		return out - dst;
+	}
+private:
+	bool decode() noexcept {
+		uint8_t* buff = frame.data();
+		unsigned n = frame.size(), i = 0, o = 0;
+		while( i < n ) {
+			const unsigned code = buff[i++];
+			if( code == 0 || i + code - 1 > n ) return false;
+			memmove(buff + o, buff + i, code - 1);
+			o += code - 1;
+			i += code - 1;
+			if( code != 0xFF && i < n ) buff[o++] = 0;
+		}
+		frame.resize(o);
+		return true;
+	}
+};
+
+/*****************************************************************************/
+/** frames delimited by silence on the line, as in Modbus RTU.
+ *  Bytes of a chunk are assumed to arrive back to back, so the silence
+ *  before a chunk is its arrival time less the previous arrival time and
+ *  the chunk's own transmission time. Trailing silence is detected by
+ *  the timer, or by an empty completion, which devices like FTDI send
+ *  on latency timer expiration when there are no data				 	*/
+class gap_framer : public framer {
+public:
+	static constexpr unsigned default_gap = 35; /* 3.5 characters		*/
+	static constexpr uint64_t fixed_gap = 1750000; /* 1.75ms per Modbus	*/
+
+	gap_framer(const framing_info& fi, frame_cb cb, void* user) noexcept
+	  : framer(fi, cb, user), expiry(*this), timers(nullptr), last(0),
+		chartime(0), gap(0), latency(0) {}
+
+	void attach(timer_queue& queue, const eia_tia_232_info& line,
+			time_us_t devlatency) noexcept {
+		timers = &queue;
+		chartime = char_time(line);
+		gap = (uint64_t) chartime * (info.gap ? info.gap : default_gap) / 10;
+		if( info.gap == 0 && line.baudrate > 19200 ) gap = fixed_gap;
+		latency = 1000ull * (info.latency ? info.latency : devlatency);
+	}
+
+	void feed(const uint8_t* data, unsigned size,
+			const rx_timestamp& ts) noexcept {
+		const uint64_t busy = (uint64_t) size * chartime;
+		if( frame.size() && ts.monotonic > last + busy &&
+				ts.monotonic - last - busy > gap )
+			complete();
+		chunk(data, ts);
+		append(data, data + size);
+		last = ts.monotonic;
+		/* the device may hold the last bytes for up to latency 			*/
+		if( timers ) timers->schedule(expiry, last + gap + latency + chartime);
+	}
+
+	void idle(uint64_t now) noexcept {
+		if( frame.size() && now - last > gap ) {
+			if( timers ) timers->cancel(expiry);
+			complete();
+		}
+	}
+private:
+	struct expiry_timer : timer {
+		inline expiry_timer(gap_framer& _owner) noexcept : owner(_owner) {}
+		void expired(uint64_t) noexcept { owner.complete(); }
+		gap_framer& owner;
+	} expiry;
+	timer_queue* timers;
+	uint64_t last;
+	uint32_t chartime;
+	uint64_t gap;
+	uint64_t latency;
+};
+
+/*****************************************************************************/
+
+framer* framer::create(const framing_info& fi, frame_cb cb, void* user)
+															throw(error_t) {
+	framing_info info(fi);
+	if( info.max_frame == 0 ) info.max_frame = default_max_frame;
+	if( cb == nullptr ) {
+		log.e(__,"invalid parameter %s", "cb");
+		throw error_t::invalid_param;
+	}
+	switch( info.type ) {
+	case frame_delimiter:	return new delimiter_framer(info, cb, user);
+	case frame_slip:		return new slip_framer(info, cb, user);
+	case frame_cobs:		return new cobs_framer(info, cb, user);
+	case frame_hdlc:		return new hdlc_framer(info, cb, user);
+	case frame_gap:			return new gap_framer(info, cb, user);
+	default:
+		log.e(__,"invalid parameter %s", "framing");
+		throw error_t::invalid_param;
+	}
+}
+
+unsigned framer::encoded_size(const framing_info& info, unsigned size)
+															noexcept {
+	switch( info.type ) {
+	case frame_delimiter:	return size + 1;
+	case frame_slip:
+	case frame_hdlc:		return 2 * size + 2;
+	case frame_cobs:		return size + size / 254 + 2;
+	default:				return size;
+	}
+}
+
+unsigned framer::encode(const framing_info& info, const uint8_t* src,
+		unsigned size, uint8_t* dst) noexcept {
+	switch( info.type ) {
+	case frame_delimiter:
+		memcpy(dst, src, size);
+		dst[size] = info.delimiter;
+		return size + 1;
+	case frame_slip:	return slip_framer::encode(src, size, dst);
+	case frame_hdlc:	return hdlc_framer::encode(src, size, dst);
+	case frame_cobs:	return cobs_framer::encode(src, size, dst);
+	default:
+		memcpy(dst, src, size);
+		return size;
+	}
+}
+
+} /* namespace usbuart */
@@ -0,0 +1,111 @@
+/** @brief framing engine
+ *  @file  framing.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#ifndef FRAMING_HPP_
+#define FRAMING_HPP_
+#include <vector>
+#include "usbuart.hpp"
+#include "timer.hpp"
+
+namespace usbuart {
+
+/**
+ * Framing counters, updated on the event loop thread
+ */
+struct frame_counters {
+	std::atomic<uint32_t> frames;	/** number of delivered frames		*/
+	std::atomic<uint32_t> bad_crc;	/** number of frames with bad crc	*/
+	std::atomic<uint32_t> dropped;	/** number of dropped bytes			*/
+};
+
+/**
+ * Frame decoder, runs on the event loop thread.
+ * Splits received data into frames and delivers them to the frame callback
+ */
+class framer {
+public:
+	static constexpr unsigned default_max_frame = 4096;
+	/**
+	 * creates a framer for the given framing type
+	 */
+	static framer* create(const framing_info&, frame_cb, void*)
+															throw(error_t);
+	/**
+	 * returns worst case size of the encoded frame
+	 */
+	static unsigned encoded_size(const framing_info&, unsigned size) noexcept;
+	/**
+	 * encodes frame into dst, returns encoded size
+	 * dst must fit encoded_size bytes
+	 */
+	static unsigned encode(const framing_info&, const uint8_t* src,
+			unsigned size, uint8_t* dst) noexcept;
+	/**
+	 * consumes received data
+	 */
+	virtual void feed(const uint8_t* data, unsigned size,
+			const rx_timestamp& ts) noexcept = 0;
+	/**
+	 * called on bulk-in completions that carry no data
+	 */
+	virtual void idle(uint64_t) noexcept {}
+	/**
+	 * called when framer is installed on a channel
+	 */
+	virtual void attach(timer_queue&, const eia_tia_232_info&,
+			time_us_t /* device latency */) noexcept {}
+
+	virtual ~framer() noexcept {}
+
+	crc_t check;				/** checksum verified and stripped		*/
+	frame_counters* counters;	/** counters to update					*/
+protected:
+	framer(const framing_info&, frame_cb, void*) noexcept;
+	/** sets chunk being decoded 										*/
+	inline void chunk(const uint8_t* data, const rx_timestamp& ts) noexcept {
+		base = data;
+		current = &ts;
+	}
+	/** appends decoded bytes to the frame								*/
+	void append(const uint8_t* begin, const uint8_t* end) noexcept;
+	/** appends a decoded byte, received at given position			*/
+	void append(uint8_t byte, const uint8_t* at) noexcept;
+	/** delivers complete frame, empty frames are not delivered			*/
+	void complete() noexcept;
+	/** drops current frame												*/
+	void discard() noexcept;
+	const framing_info info;
+	std::vector<uint8_t> frame;
+private:
+	bool admit(const uint8_t* at, unsigned size) noexcept;
+	const frame_cb cb;
+	void* const user;
+	const uint8_t* base;
+	const rx_timestamp* current;
+	rx_timestamp first;
+	bool overflow;
+	frame_counters own;
+};
+
+}
+
+#endif /* FRAMING_HPP_ */
@@ -20,6 +20,8 @@
  * <http://www.gnu.org/licenses/gpl-2.0.html>.
  */
 
+#include <algorithm>
+#include <cstring>
 #include "usbuart.hpp"
 #include <libusb.h>
 namespace usbuart {
@@ -32,6 +34,8 @@ public:
 	static constexpr uint8_t set_baudrate_req = 0x03;
 	static constexpr uint8_t set_data_req = 0x04;
 
+	static constexpr time_us_t latency_timer = 16000; /* chip default, 16ms */
+
 	static constexpr unsigned high_clk = 120*1000*1000;
 	static constexpr unsigned low_clk = 48*1000*1000;
 	enum status_bit {
@@ -52,6 +56,8 @@ public:
 	static const struct interface l_ifc;
 	~ftdi() noexcept { }
 
+	/* every packet starts with two status bytes, payloads of the second
+	 * and next packets are moved to follow the payload of the first one	*/
 	void read_callback(libusb_transfer* readxfer, size_t& readpos) noexcept {
 		if( readxfer->actual_length < 2 ) {
 			log.w(__,"malformed transfer");
@@ -59,8 +65,22 @@ public:
 			return;
 		}
 		readpos = 2;
-		if( uint8_t err = (readxfer->buffer[1] & error_mask) ) {
+		uint8_t err = 0;
+		int end = 0;
+		for(int pos = 0; pos < readxfer->actual_length; pos += packet) {
+			const int size = std::min<int>(packet,
+					readxfer->actual_length - pos);
+			if( size < 2 ) break;
+			err |= readxfer->buffer[pos + 1] & error_mask;
+			if( pos )
+				memmove(readxfer->buffer + end, readxfer->buffer + pos + 2,
+						size - 2);
+			end += pos ? size - 2 : size;
+		}
+		readxfer->actual_length = end;
+		if( err ) {
 			errors |= err;
+			bump(line_errors, 1);
 			log.w(__,"error %02x:%s%s%s%s", err,
 				(err&(1<<break_interrupt) ? " break"   : ""),
 				(err&(1<<framing_error  ) ? " framing" : ""),
@@ -95,15 +115,22 @@ public:
 	}
 
 	void reset() const throw(error_t) {
-	  write_cv(0, 0, ifcnum);
+	  write_cv(0, 0, port());
 	}
 
+	const interface& getifc() const noexcept { return bulk; }
+
+	/* FTDI chip completes bulk-in transfers on latency timer expiration,
+	 * with status bytes only, if no data were received				 	*/
+	time_us_t latency() const noexcept { return latency_timer; }
+	bool xonxoff() const noexcept { return true; }
+
 	void setbaudrate(baudrate_t baudrate) const throw(error_t) {
 		uint16_t index;
 		uint16_t value;
 		compute_divisors(baudrate, value, index);
 		log.i(__,"baudrate=%d, i=%#04X v=%#04X", baudrate, index, value);
-		write_cv(set_baudrate_req, value, index | ifcnum);
+		write_cv(set_baudrate_req, value, index | port());
 	}
 
 	void setup(const eia_tia_232_info& info) const throw(error_t) {
@@ -115,16 +142,29 @@ public:
 protected:
 	bool isH;
 	uint8_t errors;
+	interface bulk;		/* transfers are at least one packet long		*/
+	uint16_t packet;	/* max packet size of the bulk-in endpoint		*/
 private:
 	inline ftdi(libusb_device_handle* d, uint8_t num, bool ish) throw(error_t)
-	  : generic(d, ish?h_ifcs[num]:l_ifc, num), isH(ish) {}
+	  : generic(d, ish?h_ifcs[num]:l_ifc, num), isH(ish), bulk(ifc),
+		packet(packet_size(d, ifc.ep_bulk_in)) {
+		if( bulk.chunk_size < packet ) bulk.chunk_size = packet;
+	}
+	/* high speed chips send 512 byte packets when attached to a high
+	 * speed port and 64 byte packets otherwise							*/
+	static uint16_t packet_size(libusb_device_handle* d, uint8_t ep) noexcept {
+		int size = libusb_get_max_packet_size(libusb_get_device(d), ep);
+		return size > 2 ? size : 64;
+	}
+	/* SIO requests address ports starting from 1, A=1, B=2 ...			*/
+	inline uint16_t port() const noexcept { return ifcnum + 1; }
 	void setlineprops(const eia_tia_232_info& info) const throw(error_t) {
 		uint16_t value =
 				info.databits					|
 				(((uint16_t)info.parity)<<8) 	|
 				(((uint16_t)info.stopbits)<<11);
-		write_cv(set_data_req, value, ifcnum);
-		write_cv(set_flowcontrol_req, info.flowcontrol, ifcnum);
+		write_cv(set_data_req, value, port());
+		write_cv(set_flowcontrol_req, info.flowcontrol, port());
 	}
 	static class factory : driver::factory {
 		driver* create(libusb_device_handle*, uint8_t) const throw(error_t);
@@ -135,8 +175,8 @@ const struct interface ftdi::l_ifc = {
 	0x1|LIBUSB_ENDPOINT_IN, 0x2|LIBUSB_ENDPOINT_OUT, 64,
 };
 
-static constexpr size_t chunk_size = 64; /* 512 causes out of band data
- 	 	 	 	 	 	 	 	 	 	 	e.g. status bytes, to appear in-band
+static constexpr size_t chunk_size = 64; /* minimal transfer size,
+ 	 	 	 	 	 	 	 	 	 	 	extended to the max packet size
  	 	 	 	 	 	 	 	 	 	  */
 
 const struct interface ftdi::h_ifcs[] = {
@@ -204,6 +244,6 @@ driver* ftdi::factory::create(libusb_device_handle* handle, uint8_t num) const t
 	//        return packet_size;
 
 	//TODO actually probe and init driver here
-	return new ftdi(handle, ish, num);
+	return new ftdi(handle, num, ish);
 }
 } /* namespace usbuart */
@@ -25,6 +25,7 @@
 #include <endian.h>
 #include <libusb.h>
 #include "usbuart.hpp"
+#include "probes.hpp"
 
 namespace usbuart {
 static constexpr uint8_t vendor_reqo =
@@ -34,8 +35,10 @@ static constexpr uint8_t vendor_reqi =
 
 void generic::write_cv(uint8_t req, uint16_t val, uint16_t index)
 														const throw(error_t) {
-	if( int r = libusb_control_transfer(dev,
-			vendor_reqo, req, val, index, nullptr, 0, timeout) < 0) {
+	int r = libusb_control_transfer(dev,
+			vendor_reqo, req, val, index, nullptr, 0, timeout);
+	PROBE(control, dev, vendor_reqo, req, val, index, r);
+	if( r < 0 ) {
 		log.e(__, "control transfer %02x,%02x,%04x,%04x "
 				  "fail with error %d: %s\n", vendor_reqo, req, val, index, r,
 				  libusb_error_name(r));
@@ -45,8 +48,10 @@ void generic::write_cv(uint8_t req, uint16_t val, uint16_t index)
 
 void generic::control(uint8_t reqtype, uint8_t req, void* data, size_t size)
 														const throw(error_t) {
-	if( int r = libusb_control_transfer(dev,
-			reqtype, req, 0, 0, (unsigned char*)data, size, timeout) < 0 ) {
+	int r = libusb_control_transfer(dev,
+			reqtype, req, 0, 0, (unsigned char*)data, size, timeout);
+	PROBE(control, dev, reqtype, req, 0, 0, r);
+	if( r < 0 ) {
 		log.e(__,"control transfer %02x,%02x,%04x,%04x "
 		"fail with error %d: %s\n", reqtype, req,
 		0, 0, r, libusb_error_name(r));
@@ -57,8 +62,10 @@ void generic::control(uint8_t reqtype, uint8_t req, void* data, size_t size)
 
 void generic::read_cv(uint8_t req, uint16_t val, uint8_t& dst)
 														const throw(error_t) {
-	if( int r = libusb_control_transfer(dev,
-			vendor_reqi, req, val, 0, &dst, 1, timeout) != 1 ) {
+	int r = libusb_control_transfer(dev,
+			vendor_reqi, req, val, 0, &dst, 1, timeout);
+	PROBE(control, dev, vendor_reqi, req, val, 0, r);
+	if( r != 1 ) {
 		log.e(__,"control transfer %02x,%02x,%04x,%04x "
 			"fail with error %d: %s\n", vendor_reqi, req,
 			val, 0, r, libusb_error_name(r));
@@ -68,8 +75,10 @@ void generic::read_cv(uint8_t req, uint16_t val, uint8_t& dst)
 
 void generic::read_cv(uint8_t req, uint16_t val, uint16_t& dst)
 														const throw(error_t) {
-	if( int r = libusb_control_transfer(dev,
-			vendor_reqi, req, val, 0, (unsigned char*)&dst, 1, timeout) != 2 ) {
+	int r = libusb_control_transfer(dev,
+			vendor_reqi, req, val, 0, (unsigned char*)&dst, 2, timeout);
+	PROBE(control, dev, vendor_reqi, req, val, 0, r);
+	if( r != 2 ) {
 		log.e(__,"control transfer %02x,%02x,%04x,%04x "
 			"fail with error %d: %s\n", vendor_reqi, req,
 			val, 0, r, libusb_error_name(r));
@@ -78,8 +87,12 @@ void generic::read_cv(uint8_t req, uint16_t val, uint16_t& dst)
 	dst = le16toh(dst);
 }
 
+thread_local uint64_t claim_time = 0;
+
 void generic::claim_interface() const throw(error_t) {
+	const uint64_t start = nanotime();
 	int r = libusb_claim_interface(dev, ifcnum);
+	claim_time += nanotime() - start;
 	if( r == 0 ) return;
 	int err = errno;
 	log.e(__,"claim interface %d fail %d: %s\n", ifcnum, r, libusb_error_name(r));
@@ -0,0 +1,73 @@
+/** @brief log-linear latency histogram
+ *  @file  histogram.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef HISTOGRAM_HPP_
+#define HISTOGRAM_HPP_
+#include <atomic>
+#include "usbuart.h"
+
+namespace usbuart {
+
+/**
+ * HDR-style histogram of latencies in nanoseconds. Each power of two is
+ * split in 16 linear buckets, which keeps relative error within 6.25%.
+ * Values are recorded by the event loop and may be snapshotted and reset
+ * from any thread without losing samples.
+ */
+class histogram {
+public:
+	static constexpr unsigned buckets = USBUART_HISTOGRAM_BUCKETS;
+	inline histogram() noexcept : sum(0) {
+		for(auto& count : counts) count.store(0, std::memory_order_relaxed);
+	}
+	/** returns bucket index of the value								*/
+	static inline unsigned index(uint64_t ns) noexcept {
+		if( ns < 16 ) return ns;
+		const unsigned e = 63 - __builtin_clzll(ns);
+		const unsigned i = (e - 3) * 16 + ((ns >> (e - 4)) & 15);
+		return i < buckets ? i : buckets - 1;
+	}
+	inline void record(uint64_t ns) noexcept {
+		counts[index(ns)].fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(ns, std::memory_order_relaxed);
+	}
+	void snapshot(latency_histogram& h, bool reset) noexcept {
+		h.count = 0;
+		for(unsigned i = 0; i < buckets; ++i) {
+			h.buckets[i] = reset
+				? counts[i].exchange(0, std::memory_order_relaxed)
+				: counts[i].load(std::memory_order_relaxed);
+			h.count += h.buckets[i];
+		}
+		h.sum = reset
+			? sum.exchange(0, std::memory_order_relaxed)
+			: sum.load(std::memory_order_relaxed);
+	}
+private:
+	std::atomic<uint32_t> counts[buckets];
+	std::atomic<uint64_t> sum;
+};
+
+}
+
+#endif /* HISTOGRAM_HPP_ */
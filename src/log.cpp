@@ -23,17 +23,25 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "usbuart.hpp"
 namespace usbuart {
 Log log;
 
+/** messages of the same format admitted per second, the rest is counted	*/
+#ifndef USBUART_LOG_BURST
+#	define USBUART_LOG_BURST 10
+#endif
+
 static inline const char* strchrr(const char* s, const char* e, char c) {
 	while( s != e && *e != c ) --e;
 	return e;
 }
 
-static void vlogf(loglevel_t lvl,
-					const char *tag, const char * fmt, va_list args) {
+static void prefix(loglevel_t lvl, const char *tag) {
 	static const char* const L[] = {"     ","error","warn ","info ", "debug"};
 	int l = static_cast<int>(lvl);
 	static constexpr int W=28;
@@ -51,41 +59,466 @@ static void vlogf(loglevel_t lvl,
 	} else{
 		fprintf(stderr, "{} %s ", L[l]);
 	}
+}
+
+static void suppressed(loglevel_t lvl, const char *tag, unsigned count) {
+	if( count == 0 ) return;
+	prefix(lvl, tag);
+	fprintf(stderr, "%u similar messages suppressed\n", count);
+}
+
+static void vlogf(loglevel_t lvl,
+					const char *tag, const char * fmt, va_list args) {
+	prefix(lvl, tag);
 	vfprintf(stderr, fmt, args);
 	if( ! strrchr(fmt, '\n') )
 		fputs("\n", stderr);
 }
 
+/*****************************************************************************/
+/**
+ * Rate limiter, admits USBUART_LOG_BURST messages of the same format
+ * per second. Formats are hashed by address into a small table, collisions
+ * restart the window. Counting is approximate under contention
+ */
+class limiter {
+public:
+	/** returns true if message is admitted, count of messages suppressed
+	 *  since the last admitted one is returned in skipped					*/
+	bool admit(const char* fmt, unsigned& skipped) noexcept {
+		entry& e(table[(reinterpret_cast<uintptr_t>(fmt) >> 3) % countof(table)]);
+		const uint32_t now = seconds();
+		if( e.fmt.load(std::memory_order_relaxed) != fmt ) {
+			e.fmt.store(fmt, std::memory_order_relaxed);
+			e.suppressed.store(0, std::memory_order_relaxed);
+		} else if( e.window.load(std::memory_order_relaxed) == now ) {
+			if( e.count.fetch_add(1, std::memory_order_relaxed) <
+					USBUART_LOG_BURST ) {
+				skipped = 0;
+				return true;
+			}
+			e.suppressed.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		e.window.store(now, std::memory_order_relaxed);
+		e.count.store(1, std::memory_order_relaxed);
+		skipped = e.suppressed.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+private:
+	static inline uint32_t seconds() noexcept {
+#		ifdef CLOCK_MONOTONIC_COARSE
+		return nanotime(CLOCK_MONOTONIC_COARSE) / 1000000000u;
+#		else
+		return nanotime() / 1000000000u;
+#		endif
+	}
+	struct entry {
+		std::atomic<const char*> fmt;
+		std::atomic<uint32_t> window;
+		std::atomic<uint32_t> count;
+		std::atomic<uint32_t> suppressed;
+	};
+	entry table[64];
+};
+
+/*****************************************************************************/
+/**
+ * Binary log record - format pointer, tag pointer and arguments captured
+ * by walking the format. Strings are copied into the record's pool,
+ * formatting is done by the writer thread
+ */
+struct record {
+	enum kind_t : uint8_t { k_int, k_long, k_llong, k_double, k_ldouble,
+		k_ptr, k_str };
+	union arg_t {
+		long long i;
+		double f;
+		const void* p;
+		unsigned s; /* offset in the pool */
+	};
+	static constexpr unsigned max_args = 8;
+	std::atomic<unsigned> seq;
+	loglevel_t level;
+	uint8_t count;
+	uint16_t used;
+	unsigned skipped;
+	const char* tag;
+	const char* fmt;
+	kind_t kinds[max_args];
+	arg_t args[max_args];
+	char pool[120];
+
+	/** captures arguments, returns false if format is not supported	*/
+	bool capture(const char* f, va_list args) noexcept;
+	/** formats the message into buff									*/
+	void format(char* buff, std::size_t size) const noexcept;
+private:
+	/** parses one conversion starting after '%', returns pointer to the
+	 *  conversion character, or nullptr if not supported					*/
+	static const char* parse(const char* f, unsigned& stars, char& length)
+															noexcept;
+	bool push(kind_t k, const arg_t& v) noexcept {
+		if( count >= max_args ) return false;
+		kinds[count] = k;
+		args[count++] = v;
+		return true;
+	}
+	bool copy(const char* str) noexcept {
+		if( used >= sizeof(pool) ) return false;
+		arg_t v;
+		v.s = used;
+		if( str == nullptr ) str = "(null)";
+		std::size_t len = strnlen(str, sizeof(pool) - used - 1);
+		memcpy(pool + used, str, len);
+		used += len;
+		pool[used++] = 0;
+		return push(k_str, v);
+	}
+	template<typename T>
+	static int put(char* buff, std::size_t size, const char* spec,
+			unsigned stars, const int* star, T value) noexcept {
+		switch( stars ) {
+		case 0:  return snprintf(buff, size, spec, value);
+		case 1:  return snprintf(buff, size, spec, star[0], value);
+		default: return snprintf(buff, size, spec, star[0], star[1], value);
+		}
+	}
+};
+
+const char* record::parse(const char* f, unsigned& stars, char& length)
+															noexcept {
+	stars = 0;
+	length = 0;
+	while( strchr("-+ #0'", *f) && *f ) ++f;
+	if( *f == '*' ) { ++stars; ++f; }
+	else while( *f >= '0' && *f <= '9' ) ++f;
+	if( *f == '.' ) {
+		++f;
+		if( *f == '*' ) { ++stars; ++f; }
+		else while( *f >= '0' && *f <= '9' ) ++f;
+	}
+	switch( *f ) {
+	case 'h':
+		length = *f++;
+		if( *f == 'h' ) ++f;
+		break;
+	case 'l':
+		length = *f++;
+		if( *f == 'l' ) { length = 'q'; ++f; }
+		break;
+	case 'q': case 'j': case 'z': case 't': case 'L':
+		length = *f++;
+		break;
+	}
+	return *f && strchr("diouxXcsfFeEgGaAp%", *f) ? f : nullptr;
+}
+
+bool record::capture(const char* f, va_list ap) noexcept {
+	count = 0;
+	used = 0;
+	for(; (f = strchr(f, '%')) != nullptr; ++f) {
+		unsigned stars;
+		char length;
+		if( (f = parse(f + 1, stars, length)) == nullptr ) return false;
+		if( *f == '%' ) continue;
+		arg_t v;
+		while( stars-- ) {
+			v.i = va_arg(ap, int);
+			if( ! push(k_int, v) ) return false;
+		}
+		if( length == 'l' && (*f == 's' || *f == 'c') ) return false;
+		bool ok;
+		switch( *f ) {
+		case 's':
+			ok = copy(va_arg(ap, const char*));
+			break;
+		case 'p':
+			v.p = va_arg(ap, const void*);
+			ok = push(k_ptr, v);
+			break;
+		case 'f': case 'F': case 'e': case 'E':
+		case 'g': case 'G': case 'a': case 'A':
+			if( length == 'L' ) {
+				v.f = va_arg(ap, long double);
+				ok = push(k_ldouble, v);
+			} else {
+				v.f = va_arg(ap, double);
+				ok = push(k_double, v);
+			}
+			break;
+		default:
+			switch( length ) {
+			case 'l':
+				v.i = va_arg(ap, long);
+				ok = push(k_long, v);
+				break;
+			case 'q':
+				v.i = va_arg(ap, long long);
+				ok = push(k_llong, v);
+				break;
+			case 'j':
+				v.i = va_arg(ap, intmax_t);
+				ok = push(sizeof(intmax_t) == sizeof(long) ? k_long : k_llong, v);
+				break;
+			case 'z':
+				v.i = va_arg(ap, std::size_t);
+				ok = push(sizeof(std::size_t) == sizeof(long) ? k_long:k_llong, v);
+				break;
+			case 't':
+				v.i = va_arg(ap, ptrdiff_t);
+				ok = push(sizeof(ptrdiff_t) == sizeof(long) ? k_long : k_llong, v);
+				break;
+			default:
+				v.i = va_arg(ap, int);
+				ok = push(k_int, v);
+			}
+		}
+		if( ! ok ) return false;
+	}
+	return true;
+}
+
+void record::format(char* buff, std::size_t size) const noexcept {
+	const char* f = fmt;
+	unsigned n = 0;
+	std::size_t pos = 0;
+	while( *f && pos + 1 < size ) {
+		const char* next = strchr(f, '%');
+		std::size_t len = next ? next - f : strlen(f);
+		if( len ) {
+			if( len > size - pos - 1 ) len = size - pos - 1;
+			memcpy(buff + pos, f, len);
+			pos += len;
+			f += len;
+			continue;
+		}
+		unsigned stars;
+		char length;
+		const char* end = parse(f + 1, stars, length);
+		if( end == nullptr ) break;
+		++end;
+		char spec[32];
+		std::size_t speclen = end - f;
+		if( speclen >= sizeof(spec) ) break;
+		memcpy(spec, f, speclen);
+		spec[speclen] = 0;
+		f = end;
+		if( end[-1] == '%' ) {
+			buff[pos++] = '%';
+			continue;
+		}
+		int star[2] = { 0, 0 };
+		for(unsigned i = 0; i < stars; ++i) star[i] = args[n++].i;
+		const arg_t& v(args[n]);
+		char* out = buff + pos;
+		const std::size_t room = size - pos;
+		int res = 0;
+		switch( kinds[n++] ) {
+		case k_int:		res = put(out, room, spec, stars, star, (int) v.i); break;
+		case k_long:	res = put(out, room, spec, stars, star, (long) v.i); break;
+		case k_llong:	res = put(out, room, spec, stars, star, v.i); break;
+		case k_double:	res = put(out, room, spec, stars, star, v.f); break;
+		case k_ldouble:	res = put(out, room, spec, stars, star,
+										(long double) v.f); break;
+		case k_ptr:		res = put(out, room, spec, stars, star, v.p); break;
+		case k_str:		res = put(out, room, spec, stars, star, pool+v.s); break;
+		}
+		if( res < 0 ) break;
+		pos += (std::size_t) res < room ? res : room - 1;
+	}
+	buff[pos] = 0;
+}
+
+/*****************************************************************************/
+/**
+ * Lock-free bounded multi-producer ring of records drained by a
+ * background thread. When the ring is full records are dropped and counted
+ */
+class log_ring {
+public:
+	static constexpr unsigned capacity = 256; /* power of two */
+
+	log_ring() noexcept : head(0), tail(0), dropped(0), sleeping(false),
+			running(false) {
+		for(unsigned i = 0; i < capacity; ++i)
+			ring[i].seq.store(i, std::memory_order_relaxed);
+	}
+	~log_ring() noexcept { stop(); }
+
+	inline bool active() const noexcept {
+		return running.load(std::memory_order_acquire);
+	}
+
+	/** queues a message, falls back to synchronous output if
+	 *  the format cannot be captured										*/
+	void push(loglevel_t lvl, const char* tag, unsigned skipped,
+			const char* fmt, va_list args) noexcept {
+		unsigned pos = tail.load(std::memory_order_relaxed);
+		record* rec;
+		for(;;) {
+			rec = ring + (pos & (capacity - 1));
+			const int diff = rec->seq.load(std::memory_order_acquire) - pos;
+			if( diff == 0 ) {
+				if( tail.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed) ) break;
+			} else if( diff < 0 ) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			} else
+				pos = tail.load(std::memory_order_relaxed);
+		}
+		rec->level = lvl;
+		rec->tag = tag;
+		rec->skipped = skipped;
+		va_list copy;
+		va_copy(copy, args);
+		if( rec->capture(fmt, copy) )
+			rec->fmt = fmt;
+		else {
+			/* format with text, such message is not expected on hot path */
+			vsnprintf(rec->pool, sizeof(rec->pool), fmt, args);
+			rec->fmt = "%s";
+			rec->count = 1;
+			rec->kinds[0] = record::k_str;
+			rec->args[0].s = 0;
+		}
+		va_end(copy);
+		rec->seq.store(pos + 1, std::memory_order_release);
+		if( sleeping.load(std::memory_order_acquire) )
+			wakeup.notify_one();
+	}
+
+	bool start() noexcept {
+		std::lock_guard<std::mutex> lock(control);
+		if( active() ) return true;
+		try {
+			running.store(true, std::memory_order_release);
+			writer = std::thread([this]() { run(); });
+		} catch(...) {
+			running.store(false, std::memory_order_release);
+			return false;
+		}
+		return true;
+	}
+
+	void stop() noexcept {
+		std::lock_guard<std::mutex> lock(control);
+		if( ! active() ) return;
+		running.store(false, std::memory_order_release);
+		wakeup.notify_one();
+		writer.join();
+		drain();
+	}
+private:
+	/** writes all queued records, returns false if ring was empty		*/
+	bool drain() noexcept {
+		bool any = false;
+		char text[512];
+		for(;;) {
+			record& rec(ring[head & (capacity - 1)]);
+			if( rec.seq.load(std::memory_order_acquire) != head + 1 ) break;
+			rec.format(text, sizeof(text));
+			suppressed(rec.level, rec.tag, rec.skipped);
+			prefix(rec.level, rec.tag);
+			fputs(text, stderr);
+			if( ! strrchr(rec.fmt, '\n') )
+				fputs("\n", stderr);
+			const loglevel_t lvl = rec.level;
+			rec.seq.store(head + capacity, std::memory_order_release);
+			++head;
+			any = true;
+			if( unsigned lost = dropped.exchange(0, std::memory_order_relaxed) ) {
+				prefix(lvl, nullptr);
+				fprintf(stderr, "%u log records dropped\n", lost);
+			}
+		}
+		return any;
+	}
+
+	void run() noexcept {
+		std::unique_lock<std::mutex> lock(idle);
+		while( active() ) {
+			if( drain() ) continue;
+			fflush(stderr);
+			sleeping.store(true, std::memory_order_release);
+			/* a wakeup lost between drain and wait is covered by timeout */
+			wakeup.wait_for(lock, std::chrono::milliseconds(100));
+			sleeping.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	record ring[capacity];
+	unsigned head;
+	std::atomic<unsigned> tail;
+	std::atomic<unsigned> dropped;
+	std::atomic<bool> sleeping;
+	std::atomic<bool> running;
+	std::mutex idle;
+	std::mutex control;
+	std::condition_variable wakeup;
+	std::thread writer;
+};
+
+static limiter limit;
+static log_ring ring;
+
+static void output(loglevel_t lvl,
+					const char *tag, const char * fmt, va_list args) {
+	unsigned skipped;
+	if( ! limit.admit(fmt, skipped) ) return;
+	if( ring.active() )
+		ring.push(lvl, tag, skipped, fmt, args);
+	else {
+		suppressed(lvl, tag, skipped);
+		vlogf(lvl, tag, fmt, args);
+	}
+}
+
+bool Log::async(bool enable) noexcept {
+	bool old = ring.active();
+	if( enable ) ring.start();
+	else ring.stop();
+	return old;
+}
 
+#if USBUART_LOG_LEVEL >= 1
 void Log::e(const char *tag, const char *fmt, ...) noexcept {
 	if( level < loglevel_t::error ) return;
 	va_list args;
 	va_start(args, fmt);
-	vlogf(loglevel_t::error, tag, fmt, args);
+	output(loglevel_t::error, tag, fmt, args);
 	va_end(args);
 }
+#endif
 
+#if USBUART_LOG_LEVEL >= 2
 void Log::w(const char *tag, const char *fmt, ...) noexcept {
 	if( level < loglevel_t::warning ) return;
 	va_list args;
 	va_start(args, fmt);
-	vlogf(loglevel_t::warning, tag, fmt, args);
+	output(loglevel_t::warning, tag, fmt, args);
 	va_end(args);
 }
+#endif
 
+#if USBUART_LOG_LEVEL >= 3
 void Log::i(const char *tag, const char *fmt, ...) noexcept {
 	if( level < loglevel_t::info ) return;
 	va_list args;
 	va_start(args, fmt);
-	vlogf(loglevel_t::info,tag, fmt, args);
+	output(loglevel_t::info,tag, fmt, args);
 	va_end(args);
 }
+#endif
 
+#if USBUART_LOG_LEVEL >= 4
 void Log::d(const char *tag, const char *fmt, ...) noexcept {
 	if( level < loglevel_t::debug ) return;
 	va_list args;
 	va_start(args, fmt);
-	vlogf(loglevel_t::debug, tag, fmt, args);
+	output(loglevel_t::debug, tag, fmt, args);
 	va_end(args);
 }
+#endif
 } /* namespace usbuart */
@@ -0,0 +1,82 @@
+/** @brief in-process loopback device
+ *  @file  loopback.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <libusb.h>
+#include "usbuart.hpp"
+#include "loopback.hpp"
+
+namespace usbuart {
+
+loopback_driver::loopback_driver(timer_queue& _timers, time_us_t latency,
+		size_t chunk) noexcept
+  : simulator(_timers, {0x81, 0x02, chunk})
+  , line(_115200_8N1n)
+  , chartime(char_time(line))
+  , delay(latency * 1000ull)
+  , linefree(0)
+  , head(0)
+  , count(0) {}
+
+uint64_t loopback_driver::drain(libusb_transfer* xfer, uint64_t now) noexcept {
+	linefree = std::max(now, linefree) + (uint64_t) xfer->length * chartime;
+	return linefree;
+}
+
+void loopback_driver::written(libusb_transfer* xfer, uint64_t now) noexcept {
+	std::size_t size = xfer->actual_length;
+	if( count + size > fifo_size ) {
+		bump(line_errors, 1);
+		size = fifo_size - count;
+		if( size == 0 ) return;
+	}
+	const std::size_t tail = (head + count) % fifo_size;
+	const std::size_t first = std::min(size, fifo_size - tail);
+	memcpy(fifo + tail, xfer->buffer, first);
+	memcpy(fifo, xfer->buffer + first, size - first);
+	count += size;
+	segments.push_back({now + delay, (uint32_t) size});
+}
+
+uint64_t loopback_driver::due(uint64_t) noexcept {
+	return segments.empty() ? timer_queue::never : segments.front().arrival;
+}
+
+void loopback_driver::fill(libusb_transfer* xfer, uint64_t now) noexcept {
+	std::size_t size = 0;
+	while( segments.size() && segments.front().arrival <= now &&
+			size < (std::size_t) xfer->length ) {
+		segment& s(segments.front());
+		const std::size_t n = std::min<std::size_t>(s.size, xfer->length - size);
+		const std::size_t first = std::min(n, fifo_size - head);
+		memcpy(xfer->buffer + size, fifo + head, first);
+		memcpy(xfer->buffer + size + first, fifo, n - first);
+		head = (head + n) % fifo_size;
+		count -= n;
+		size += n;
+		if( (s.size -= n) == 0 ) segments.pop_front();
+	}
+	xfer->actual_length = size;
+}
+
+}
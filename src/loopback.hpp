@@ -0,0 +1,76 @@
+/** @brief in-process loopback device
+ *  @file  loopback.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef LOOPBACK_HPP_
+#define LOOPBACK_HPP_
+#include <deque>
+#include "simulator.hpp"
+
+namespace usbuart {
+
+/**
+ * Simulated device that returns every byte written to it. OUT transfers
+ * complete when their bytes have been sent at the line baud rate, the
+ * bytes arrive at IN after the latency. Bytes that do not fit in the
+ * device FIFO are lost and counted as line errors (overrun)
+ */
+class loopback_driver : public simulator {
+public:
+	static constexpr uint8_t bus = 0;		/* virtual bus of loopbacks	*/
+	static constexpr std::size_t fifo_size = 1 << 14;
+	static constexpr size_t default_chunk = 512;
+	loopback_driver(timer_queue& timers, time_us_t latency,
+		size_t chunk = default_chunk) noexcept;
+	void setup(const eia_tia_232_info& info) const throw(error_t) {
+		line = info;
+		chartime = char_time(line);
+	}
+	void setbaudrate(baudrate_t baudrate) const throw(error_t) {
+		line.baudrate = baudrate;
+		chartime = char_time(line);
+	}
+	time_us_t latency() const noexcept { return delay / 1000; }
+protected:
+	uint64_t drain(libusb_transfer* xfer, uint64_t now) noexcept;
+	void written(libusb_transfer* xfer, uint64_t now) noexcept;
+	void flushed(uint64_t now) noexcept { linefree = now; }
+	uint64_t due(uint64_t now) noexcept;
+	void fill(libusb_transfer* xfer, uint64_t now) noexcept;
+private:
+	struct segment {
+		uint64_t arrival;
+		uint32_t size;
+	};
+	mutable eia_tia_232_info line;
+	mutable uint32_t chartime;		/* ns per character					*/
+	const uint64_t delay;			/* ns								*/
+	uint64_t linefree;				/* time the line finishes sending	*/
+	std::deque<segment> segments;
+	std::size_t head;				/* first byte in the fifo			*/
+	std::size_t count;				/* bytes in the fifo				*/
+	uint8_t fifo[fifo_size];
+};
+
+}
+
+#endif /* LOOPBACK_HPP_ */
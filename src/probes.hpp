@@ -0,0 +1,56 @@
+/** @brief USDT static probes
+ *  @file  probes.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef PROBES_HPP_
+#define PROBES_HPP_
+
+/* Probes compile to a single NOP and an ELF note when <sys/sdt.h> is
+ * available, to nothing otherwise or when USBUART_NO_PROBES is defined.
+ * List them with: bpftrace -l 'usdt:libusbuart.so:usbuart:*'
+ *
+ *  submit(chnl, xfer, endpoint, length)		bulk transfer submitted
+ *  read_complete(chnl, xfer, status, actual, time)	IN transfer completed,
+ *  												time - CLOCK_MONOTONIC, ns
+ *  write_complete(chnl, xfer, status, actual)	OUT transfer completed
+ *  pipe_read(chnl, fd, result)					read from attached file
+ *  pipe_write(chnl, fd, result)					write to attached file
+ *  poll_request(fd, events)						file registered for poll
+ *  attach(chnl, fd_read, fd_write)				channel attached
+ *  close(chnl, device, pipein, pipeout)			channel closed, hangup flags
+ *  flow(chnl, stop)								XOFF/XON received
+ *  control(dev, reqtype, req, value, index, result)	control request	*/
+
+#if ! defined(USBUART_NO_PROBES) && defined(__has_include)
+#	if __has_include(<sys/sdt.h>)
+#		include <sys/sdt.h>
+#		define USBUART_PROBES 1
+#	endif
+#endif
+
+#ifdef USBUART_PROBES
+#	define PROBE(name, ...) STAP_PROBEV(usbuart, name, ##__VA_ARGS__)
+#else
+#	define PROBE(name, ...) do {} while(0)
+#endif
+
+#endif /* PROBES_HPP_ */
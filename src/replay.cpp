@@ -0,0 +1,165 @@
+/** @brief replay of captured traffic as a simulated device
+ *  @file  replay.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libusb.h>
+#include "usbuart.hpp"
+#include "capture.hpp"
+#include "replay.hpp"
+
+namespace usbuart {
+
+static inline uint32_t get32(const uint8_t* p) noexcept {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint16_t get16(const uint8_t* p) noexcept {
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+replayer::replayer(const char* path, unsigned _mode, timer_queue& _timers)
+															throw(error_t)
+  : simulator(_timers, {0x81, 0x02, 64})
+  , mode(_mode)
+  , map(nullptr)
+  , mapsize(0)
+  , index(0)
+  , offset(0)
+  , start(0)
+  , errors(0) {
+	int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0 ) {
+		log.e(__,"open %s fail: %s", path, strerror(errno));
+		throw error_t::io_error;
+	}
+	struct stat st;
+	void* m = MAP_FAILED;
+	if( fstat(fd, &st) == 0 && st.st_size > 0 )
+		m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	const int err = errno;
+	::close(fd);
+	if( m == MAP_FAILED ) {
+		log.e(__,"mapping %s fail: %s", path, strerror(err));
+		throw error_t::io_error;
+	}
+	map = static_cast<const uint8_t*>(m);
+	mapsize = st.st_size;
+	try {
+		load(map, mapsize);
+	} catch(...) {
+		log.e(__,"%s is not a capture with received traffic", path);
+		munmap(const_cast<uint8_t*>(map), mapsize);
+		throw;
+	}
+}
+
+replayer::~replayer() noexcept {
+	munmap(const_cast<uint8_t*>(map), mapsize);
+}
+
+/** indexes received packets of USER0 interfaces							*/
+void replayer::load(const uint8_t* data, std::size_t size) throw(error_t) {
+	if( size < 28 || get32(data) != pcapng::shb ||
+			get32(data + 8) != pcapng::bom )
+		throw error_t::not_supported;
+	bool user0 = false;
+	uint64_t mul = 1000; /* default resolution is microseconds			*/
+	uint64_t first = 0;
+	uint32_t chunk = ifc.chunk_size;
+	for(std::size_t pos = 0, len; pos + 12 <= size; pos += len) {
+		const uint8_t* p = data + pos;
+		len = get32(p + 4);
+		if( len < 12 || (len & 3) || pos + len > size ) break;
+		switch( get32(p) ) {
+		case pcapng::idb:
+			user0 = get16(p + 8) == pcapng::linktype_user0;
+			for(const uint8_t* o = p + 16; o + 4 <= p + len - 4;
+					o += 4 + ((get16(o + 2) + 3) & ~3)) {
+				if( get16(o) == 0 ) break;
+				if( get16(o) != pcapng::if_tsresol ) continue;
+				const uint8_t r = o[4];
+				mul = 1;
+				if( r & 0x80 || r > 9 ) { user0 = false; break; }
+				for(unsigned i = r; i < 9; ++i) mul *= 10;
+			}
+			break;
+		case pcapng::epb: {
+			const uint32_t caplen = get32(p + 20);
+			if( ! user0 || caplen < pcapng::pseudo_header ||
+					28 + caplen > len - 4 ) break;
+			const uint8_t* h = p + 28;
+			if( h[1] != capture_file::dir_rx ) break;
+			const uint64_t t = ((uint64_t) get32(p + 12) << 32 | get32(p + 16))
+					* mul;
+			if( records.empty() ) first = t;
+			const bool status = h[0] == capture_file::ev_status;
+			const uint32_t n = caplen - pcapng::pseudo_header;
+			records.push_back({t - first, h + 4, n, get16(h + 2), status});
+			if( ! status && n > chunk ) chunk = n;
+			break;
+		}
+		}
+	}
+	if( std::none_of(records.begin(), records.end(),
+			[](const record& r) { return ! r.status && r.size; }) )
+		throw error_t::invalid_param;
+	ifc.chunk_size = std::min(chunk, 16384u);
+	errors = records.front().errors;
+}
+
+uint64_t replayer::due(uint64_t now) noexcept {
+	for(;;) {
+		while( index < records.size() && records[index].status ) {
+			bump(line_errors, (uint16_t)(records[index].errors - errors));
+			errors = records[index++].errors;
+		}
+		if( index < records.size() ) break;
+		if( ! (mode & replay_repeat) ) return timer_queue::never;
+		index = 0;
+		offset = 0;
+		start = 0;
+	}
+	if( start == 0 ) start = now - records[index].time;
+	return (mode & replay_timed) ? start + records[index].time : now;
+}
+
+void replayer::fill(libusb_transfer* xfer, uint64_t) noexcept {
+	const record& r(records[index]);
+	const uint32_t n = std::min<uint32_t>(r.size - offset, xfer->length);
+	memcpy(xfer->buffer, r.data + offset, n);
+	xfer->actual_length = n;
+	if( (offset += n) < r.size ) return;
+	++index;
+	offset = 0;
+}
+
+}
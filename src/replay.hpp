@@ -0,0 +1,67 @@
+/** @brief replay of captured traffic as a simulated device
+ *  @file  replay.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef REPLAY_HPP_
+#define REPLAY_HPP_
+#include <vector>
+#include "simulator.hpp"
+
+namespace usbuart {
+
+/**
+ * Simulated device that plays back received traffic of a pcapng capture
+ * made by capture_file. IN transfers complete with the captured payloads,
+ * at the original pace or as fast as possible, OUT transfers complete
+ * immediately. Line status records advance the line error count.
+ */
+class replayer : public simulator {
+public:
+	replayer(const char* path, unsigned mode, timer_queue& timers)
+															throw(error_t);
+	~replayer() noexcept;
+protected:
+	uint64_t due(uint64_t now) noexcept;
+	void fill(libusb_transfer* xfer, uint64_t now) noexcept;
+private:
+	struct record {
+		uint64_t time;			/* ns since the first record			*/
+		const uint8_t* data;
+		uint32_t size;
+		uint16_t errors;
+		bool status;
+	};
+	void load(const uint8_t* data, std::size_t size) throw(error_t);
+
+	const unsigned mode;
+	const uint8_t* map;
+	std::size_t mapsize;
+	std::vector<record> records;
+	std::size_t index;			/* next record to play					*/
+	uint32_t offset;			/* played part of the record			*/
+	uint64_t start;				/* loop time of the first record		*/
+	uint16_t errors;			/* error count of the last status		*/
+};
+
+}
+
+#endif /* REPLAY_HPP_ */
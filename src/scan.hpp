@@ -0,0 +1,75 @@
+/** @brief vectorized byte scanning
+ *  @file  scan.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#ifndef SCAN_HPP_
+#define SCAN_HPP_
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#	include <arm_neon.h>
+#endif
+
+namespace usbuart {
+
+/**
+ * returns pointer to the first byte equal to a, or end if none
+ * libc memchr is vectorized on all supported platforms
+ */
+static inline const uint8_t* scan(const uint8_t* p, const uint8_t* end,
+		uint8_t a) noexcept {
+	const void* r = memchr(p, a, end - p);
+	return r ? static_cast<const uint8_t*>(r) : end;
+}
+
+/**
+ * returns pointer to the first byte equal to a or b, or end if none
+ */
+static inline const uint8_t* scan(const uint8_t* p, const uint8_t* end,
+		uint8_t a, uint8_t b) noexcept {
+#if defined(__SSE2__)
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+	for(; end - p >= 16; p += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*) p);
+		if( int m = _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb))) )
+			return p + __builtin_ctz(m);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const uint8x16_t va = vdupq_n_u8(a);
+	const uint8x16_t vb = vdupq_n_u8(b);
+	for(; end - p >= 16; p += 16) {
+		const uint8x16_t v = vld1q_u8(p);
+		if( vmaxvq_u8(vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb))) )
+			break; /* locate the byte in the scalar tail */
+	}
+#endif
+	for(; p < end; ++p)
+		if( *p == a || *p == b ) return p;
+	return end;
+}
+
+}
+
+#endif /* SCAN_HPP_ */
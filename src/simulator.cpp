@@ -0,0 +1,196 @@
+/** @brief simulated devices completing transfers without hardware
+ *  @file  simulator.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <algorithm>
+#include <new>
+#include <libusb.h>
+#include "usbuart.hpp"
+#include "simulator.hpp"
+#include "faults.hpp"
+
+namespace usbuart {
+
+simulator::simulator(timer_queue& _timers, const interface& _ifc) noexcept
+  : location{0, 0, 0}
+  , timers(_timers)
+  , ifc(_ifc)
+  , line_errors(0)
+  , faults(nullptr)
+  , halts(0) {}
+
+simulator::~simulator() noexcept {
+	for(auto c : reads) delete c;
+	for(auto c : writes) delete c;
+	for(auto c : spare) delete c;
+}
+
+int simulator::submit(libusb_transfer* xfer) noexcept {
+	bool idle;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		idle = submitted.empty() && cancels.empty();
+		submitted.push_back(xfer);
+	}
+	if( idle && wake ) wake();
+	return LIBUSB_SUCCESS;
+}
+
+int simulator::cancel(libusb_transfer* xfer) noexcept {
+	bool idle;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		idle = submitted.empty() && cancels.empty();
+		cancels.push_back(xfer);
+	}
+	if( idle && wake ) wake();
+	return LIBUSB_SUCCESS;
+}
+
+/* simulated endpoints halt only on injected STALL and OVERFLOW			*/
+int simulator::clear_halt(uint8_t ep) noexcept {
+	halts &= ~((ep & LIBUSB_ENDPOINT_IN) ? 1 : 2);
+	return LIBUSB_SUCCESS;
+}
+
+void simulator::accept() noexcept {
+	std::vector<libusb_transfer*> in, out;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		in.swap(submitted);
+		out.swap(cancels);
+	}
+	const uint64_t now = nanotime();
+	for(auto xfer : in) {
+		completion* c;
+		if( spare.size() ) {
+			c = spare.back();
+			spare.pop_back();
+		} else if( (c = new (std::nothrow) completion(*this)) == nullptr ) {
+			xfer->status = LIBUSB_TRANSFER_ERROR;
+			xfer->actual_length = 0;
+			xfer->callback(xfer);
+			continue;
+		}
+		c->xfer = xfer;
+		c->expires = xfer->timeout ? now + xfer->timeout * 1000000ull : 0;
+		c->cancelled = false;
+		c->timedout = false;
+		if( xfer->endpoint & LIBUSB_ENDPOINT_IN )
+			reads.push_back(c);
+		else {
+			writes.push_back(c);
+			timers.schedule(*c, drain(xfer, now));
+		}
+	}
+	for(auto xfer : out) {
+		completion* c = find(xfer);
+		if( c == nullptr || c->cancelled ) continue;
+		c->cancelled = true;
+		timers.schedule(*c, now);
+	}
+	arm(now);
+}
+
+simulator::completion* simulator::find(libusb_transfer* xfer) noexcept {
+	for(auto c : reads) if( c->xfer == xfer ) return c;
+	for(auto c : writes) if( c->xfer == xfer ) return c;
+	return nullptr;
+}
+
+void simulator::arm(uint64_t now) noexcept {
+	if( reads.empty() || reads.front()->cancelled ) return;
+	completion& head(*reads.front());
+	uint64_t deadline = due(now);
+	head.timedout = head.expires && head.expires < deadline;
+	if( head.timedout ) deadline = head.expires;
+	if( deadline != timer_queue::never ) timers.schedule(head, deadline);
+	else if( head.armed() ) timers.cancel(head);
+}
+
+void simulator::move(libusb_transfer* xfer, uint64_t now) noexcept {
+	const uint8_t ep = (xfer->endpoint & LIBUSB_ENDPOINT_IN) ? 1 : 2;
+	/* transfers queued on a halted endpoint fail until it is cleared	*/
+	if( halts & ep )
+		xfer->status = LIBUSB_TRANSFER_STALL;
+	else
+		xfer->status = faults ? (libusb_transfer_status) faults->draw(xfer)
+							  : LIBUSB_TRANSFER_COMPLETED;
+	if( xfer->status == LIBUSB_TRANSFER_STALL ||
+		xfer->status == LIBUSB_TRANSFER_OVERFLOW )
+		halts |= ep;
+	/* a failed transfer moves no data, as on a halted endpoint			*/
+	if( xfer->status != LIBUSB_TRANSFER_COMPLETED ) return;
+	const int length = xfer->length;
+	if( xfer->endpoint & LIBUSB_ENDPOINT_IN ) {
+		/* a short read leaves the rest queued in the device				*/
+		if( faults ) xfer->length = faults->cut(xfer, length);
+		fill(xfer, now);
+		xfer->length = length;
+	} else {
+		/* a partial write leaves the rest to be sent again				*/
+		xfer->actual_length = faults ? faults->cut(xfer, length) : length;
+		written(xfer, now);
+	}
+}
+
+void simulator::complete(completion& c, uint64_t now) noexcept {
+	libusb_transfer* xfer = c.xfer;
+	xfer->actual_length = 0;
+	if( c.cancelled )
+		xfer->status = LIBUSB_TRANSFER_CANCELLED;
+	else if( c.timedout )
+		xfer->status = LIBUSB_TRANSFER_TIMED_OUT;
+	else
+		move(xfer, now);
+	if( xfer->endpoint & LIBUSB_ENDPOINT_IN )
+		reads.erase(std::find(reads.begin(), reads.end(), &c));
+	else
+		writes.erase(std::find(writes.begin(), writes.end(), &c));
+	spare.push_back(&c);
+	const bool in = xfer->endpoint & LIBUSB_ENDPOINT_IN;
+	xfer->callback(xfer);
+	if( halts & (in ? 1 : 2) ) flush(in, now);
+	arm(now);
+}
+
+/* a halted endpoint returns the transfers queued on it, in order		*/
+void simulator::flush(bool in, uint64_t now) noexcept {
+	while( in ? reads.size() : writes.size() ) {
+		completion* c;
+		if( in ) {
+			c = reads.front();
+			reads.pop_front();
+		} else {
+			c = writes.front();
+			writes.erase(writes.begin());
+		}
+		if( c->armed() ) timers.cancel(*c);
+		spare.push_back(c);
+		c->xfer->actual_length = 0;
+		c->xfer->status = c->cancelled ? LIBUSB_TRANSFER_CANCELLED
+									   : LIBUSB_TRANSFER_STALL;
+		c->xfer->callback(c->xfer);
+	}
+	if( ! in ) flushed(now);
+}
+
+}
@@ -0,0 +1,120 @@
+/** @brief simulated devices completing transfers without hardware
+ *  @file  simulator.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef SIMULATOR_HPP_
+#define SIMULATOR_HPP_
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "timer.hpp"
+
+namespace usbuart {
+
+/**
+ * Base of simulated devices. Transfers may be submitted and cancelled from
+ * any thread, they are accepted and completed on the event loop thread,
+ * woken with the wake callback. OUT transfers complete at the time given
+ * by drain, IN transfers are completed one at a time, oldest first, when
+ * data is due, or time out as they do on a real device. An injected STALL
+ * or OVERFLOW halts the endpoint, transfers queued on it fail until the
+ * halt is cleared.
+ */
+class simulator : public driver {
+public:
+	simulator(timer_queue& timers, const interface& ifc) noexcept;
+	~simulator() noexcept;
+	int submit(libusb_transfer* xfer) noexcept;
+	int cancel(libusb_transfer* xfer) noexcept;
+	int clear_halt(uint8_t ep) noexcept;
+	bool inject(fault_injector* f) noexcept { faults = f; return true; }
+	/** accepts submitted and cancelled transfers, called from the loop	*/
+	void accept() noexcept;
+	/** requests a call of accept on the event loop thread				*/
+	std::function<void()> wake;
+	/** virtual bus and address, reported in place of USB ones			*/
+	device_addr location;
+
+	const interface& getifc() const noexcept { return ifc; }
+	void setup(const eia_tia_232_info&) const throw(error_t) {}
+	void setbaudrate(baudrate_t) const throw(error_t) {}
+	void reset() const throw(error_t) {}
+	void sendbreak() const throw(error_t) {}
+	/** simulated IN data carries no chip status header				*/
+	void read_callback(libusb_transfer*, size_t& pos) noexcept { pos = 0; }
+	void write_callback(libusb_transfer*) noexcept {}
+	void prepare_write(libusb_transfer*) throw(error_t) {}
+	libusb_device_handle * handle() const noexcept { return nullptr; }
+	time_us_t latency() const noexcept { return 0; }
+	bool xonxoff() const noexcept { return false; }
+	uint32_t errorcount() const noexcept {
+		return line_errors.load(std::memory_order_relaxed);
+	}
+protected:
+	/** returns time when data for the next IN transfer is due, or never	*/
+	virtual uint64_t due(uint64_t now) noexcept = 0;
+	/** fills IN transfer with the data due								*/
+	virtual void fill(libusb_transfer* xfer, uint64_t now) noexcept = 0;
+	/** returns completion time of an OUT transfer						*/
+	virtual uint64_t drain(libusb_transfer*, uint64_t now) noexcept {
+		return now;
+	}
+	/** called when an OUT transfer completes								*/
+	virtual void written(libusb_transfer*, uint64_t) noexcept {}
+	/** called when OUT transfers queued on a halted endpoint are returned	*/
+	virtual void flushed(uint64_t) noexcept {}
+	/** (re)schedules completion of the oldest IN transfer				*/
+	void arm(uint64_t now) noexcept;
+	timer_queue& timers;
+	interface ifc;
+	std::atomic<uint32_t> line_errors;
+	fault_injector* faults;	/* faults drawn before data is moved		*/
+	uint8_t halts;			/* endpoints halted by faults, 1-in, 2-out	*/
+private:
+	struct completion : timer {
+		inline completion(simulator& s) noexcept
+		  : owner(s), xfer(nullptr), expires(0), cancelled(false),
+			timedout(false) {}
+		void expired(uint64_t now) noexcept { owner.complete(*this, now); }
+		simulator& owner;
+		libusb_transfer* xfer;
+		uint64_t expires;		/* transfer timeout, 0 - none			*/
+		bool cancelled;
+		bool timedout;
+	};
+	void complete(completion& c, uint64_t now) noexcept;
+	void move(libusb_transfer* xfer, uint64_t now) noexcept;
+	void flush(bool in, uint64_t now) noexcept;
+	completion* find(libusb_transfer* xfer) noexcept;
+
+	std::deque<completion*> reads;
+	std::vector<completion*> writes;
+	std::vector<completion*> spare;
+	std::mutex lock;
+	std::vector<libusb_transfer*> submitted;
+	std::vector<libusb_transfer*> cancels;
+};
+
+}
+
+#endif /* SIMULATOR_HPP_ */
@@ -0,0 +1,106 @@
+/** @brief shared memory stats page
+ *  @file  statspage.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "usbuart.hpp"
+#include "statspage.hpp"
+
+namespace usbuart {
+
+stats_page::stats_page(const char* _path, unsigned _interval) throw(error_t)
+  : interval(_interval ? _interval : default_interval)
+  , path(_path)
+  , size(sizeof(usbuart_shm_header) + sizeof(usbuart_shm_slot) * USBUART_SHM_SLOTS)
+  , header(nullptr)
+  , device(0)
+  , inode(0)
+  , used{} {
+	/* the page is built under a temporary name and renamed over the path,
+	 * a page already published there keeps its inode until it is deleted */
+	std::string temp(path + ".XXXXXX");
+	int fd = mkostemp(&temp[0], O_CLOEXEC);
+	if( fd < 0 ) {
+		log.e(__,"open %s fail: %s", temp.c_str(), strerror(errno));
+		throw error_t::io_error;
+	}
+	struct stat st;
+	void* map = MAP_FAILED;
+	if( fchmod(fd, 0644) == 0 && ftruncate(fd, size) == 0 &&
+			fstat(fd, &st) == 0 )
+		map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	const int err = errno;
+	::close(fd);
+	if( map == MAP_FAILED ) {
+		log.e(__,"mapping %s fail: %s", temp.c_str(), strerror(err));
+		unlink(temp.c_str());
+		throw error_t::io_error;
+	}
+	device = st.st_dev;
+	inode = st.st_ino;
+	header = static_cast<usbuart_shm_header*>(map);
+	header->version		= USBUART_SHM_VERSION;
+	header->header_size	= sizeof(usbuart_shm_header);
+	header->slot_size	= sizeof(usbuart_shm_slot);
+	header->slots		= USBUART_SHM_SLOTS;
+	header->pid			= getpid();
+	header->interval	= interval;
+	/* magic is stored last, readers ignore pages without it			*/
+	__atomic_store_n(&header->magic, USBUART_SHM_MAGIC, __ATOMIC_RELEASE);
+	if( rename(temp.c_str(), _path) != 0 ) {
+		log.e(__,"rename to %s fail: %s", _path, strerror(errno));
+		munmap(header, size);
+		unlink(temp.c_str());
+		throw error_t::io_error;
+	}
+}
+
+stats_page::~stats_page() noexcept {
+	/* a page published later to the same path owns it now				*/
+	struct stat st;
+	if( stat(path.c_str(), &st) == 0 && st.st_dev == device &&
+			st.st_ino == inode )
+		unlink(path.c_str());
+	munmap(header, size);
+}
+
+int stats_page::acquire() noexcept {
+	for(int i = 0; i < USBUART_SHM_SLOTS; ++i)
+		if( ! used[i] ) {
+			used[i] = true;
+			return i;
+		}
+	log.w(__,"no free slots in stats page %s", path.c_str());
+	return -1;
+}
+
+void stats_page::release(int i) noexcept {
+	if( i < 0 || i >= USBUART_SHM_SLOTS ) return;
+	update(i, [](usbuart_shm_slot& s) { s.active = 0; });
+	used[i] = false;
+}
+
+}
@@ -0,0 +1,72 @@
+/** @brief shared memory stats page
+ *  @file  statspage.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+
+#ifndef STATSPAGE_HPP_
+#define STATSPAGE_HPP_
+#include <string>
+#include "usbuart_shm.h"
+
+namespace usbuart {
+
+/**
+ * Memory mapped page of per-channel counter blocks, read by external
+ * monitoring tools. Created in any thread, updated by the event loop only
+ */
+class stats_page {
+public:
+	static constexpr unsigned default_interval = 1000; /* ms				*/
+	stats_page(const char* path, unsigned interval) throw(error_t);
+	~stats_page() noexcept;
+	/** returns index of a free slot, or -1 if none						*/
+	int acquire() noexcept;
+	/** marks the slot free												*/
+	void release(int i) noexcept;
+	/** updates the slot as a seqlock writer								*/
+	template<typename F>
+	inline void update(int i, F fill) noexcept {
+		usbuart_shm_slot& s(slot(i));
+		const uint32_t seq = s.seq;
+		__atomic_store_n(&s.seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		fill(s);
+		__atomic_store_n(&s.seq, seq + 2, __ATOMIC_RELEASE);
+	}
+	inline void touch(uint64_t now) noexcept {
+		__atomic_store_n(&header->updated, now, __ATOMIC_RELEASE);
+	}
+	const unsigned interval;
+private:
+	inline usbuart_shm_slot& slot(int i) noexcept {
+		return reinterpret_cast<usbuart_shm_slot*>(header + 1)[i];
+	}
+	const std::string path;
+	std::size_t size;
+	usbuart_shm_header* header;
+	uint64_t device;			/* identity of the published file		*/
+	uint64_t inode;
+	bool used[USBUART_SHM_SLOTS];
+};
+
+}
+
+#endif /* STATSPAGE_HPP_ */
@@ -0,0 +1,168 @@
+/** @brief hierarchical timer wheel
+ *  @file  timer.cpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#include "timer.hpp"
+
+namespace usbuart {
+
+static inline constexpr unsigned shift(unsigned level) noexcept {
+	return level * timer_queue::slot_bits;
+}
+
+static inline constexpr unsigned index(uint64_t tick, unsigned level) noexcept {
+	return (tick >> shift(level)) & (timer_queue::slots - 1);
+}
+
+/* unlinks timer from the list, leaves bitmaps intact						*/
+inline void timer_queue::unlink(timer*& head, timer& t) noexcept {
+	if( t.next ) t.next->prev = t.prev;
+	(t.prev ? t.prev->next : head) = t.next;
+}
+
+timer_queue::timer_queue() noexcept : current(0), occupied{}, wheel{} {}
+
+timer_queue::~timer_queue() noexcept {
+	for(auto& level : wheel)
+		for(auto& head : level)
+			while( head ) cancel(*head);
+}
+
+void timer_queue::schedule(timer& t, uint64_t deadline) noexcept {
+	if( t.queue ) cancel(t);
+	t.deadline = deadline;
+	t.queue = this;
+	insert(t);
+}
+
+/* places timer to the finest level where its tick shares all higher bits
+ * with the current tick, past deadlines go to the current slot			*/
+void timer_queue::insert(timer& t) noexcept {
+	uint64_t tick = t.deadline >> tick_bits;
+	if( tick < current ) tick = current;
+	const uint64_t diff = tick ^ current;
+	const unsigned level = diff ? (63 - __builtin_clzll(diff)) / slot_bits : 0;
+	const unsigned slot = index(tick, level);
+	timer*& head(wheel[level][slot]);
+	t.bucket = &head;
+	t.prev = nullptr;
+	t.next = head;
+	if( head ) head->prev = &t;
+	head = &t;
+	occupied[level] |= 1ull << slot;
+}
+
+void timer_queue::cancel(timer& t) noexcept {
+	if( t.queue != this ) return;
+	unlink(*t.bucket, t);
+	timer** const first = &wheel[0][0];
+	/* timers being fired are linked to a local list, not to the wheel	*/
+	if( *t.bucket == nullptr && t.bucket >= first &&
+		t.bucket < first + levels * slots ) {
+		const unsigned pos = t.bucket - first;
+		occupied[pos / slots] &= ~(1ull << (pos % slots));
+	}
+	t.queue = nullptr;
+	t.bucket = nullptr;
+	t.prev = t.next = nullptr;
+}
+
+/* finds the first non-empty slot at or after the current tick			*/
+bool timer_queue::earliest(unsigned& level, unsigned& slot) const noexcept {
+	for(level = 0; level < levels; ++level) {
+		const unsigned pos = index(current, level);
+		/* higher level slot at current position is already cascaded	*/
+		const unsigned from = level ? pos + 1 : pos;
+		if( from >= slots ) continue;
+		if( uint64_t mask = occupied[level] & (~0ull << from) ) {
+			slot = __builtin_ctzll(mask);
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t timer_queue::next() const noexcept {
+	unsigned level, slot;
+	if( ! earliest(level, slot) ) return never;
+	uint64_t deadline = never;
+	for(timer* t = wheel[level][slot]; t; t = t->next)
+		if( t->deadline < deadline ) deadline = t->deadline;
+	return deadline;
+}
+
+/* fires due timers of the current level 0 slot, timers armed by
+ * the callbacks are placed to the wheel and fire on the next expire		*/
+void timer_queue::fire(uint64_t now) noexcept {
+	timer*& head(wheel[0][index(current, 0)]);
+	timer* list = head;
+	head = nullptr;
+	occupied[0] &= ~(1ull << index(current, 0));
+	for(timer* t = list; t; t = t->next) t->bucket = &list;
+	while( list ) {
+		timer& t(*list);
+		unlink(list, t);
+		if( t.deadline > now ) {
+			insert(t);
+			continue;
+		}
+		t.queue = nullptr;
+		t.bucket = nullptr;
+		t.prev = t.next = nullptr;
+		t.expired(now);
+	}
+}
+
+/* moves the wheel to the tick and cascades slots it has reached			*/
+void timer_queue::advance(uint64_t tick) noexcept {
+	current = tick;
+	for(unsigned level = levels - 1; level; --level) {
+		const unsigned slot = index(current, level);
+		timer*& head(wheel[level][slot]);
+		if( head == nullptr ) continue;
+		timer* list = head;
+		head = nullptr;
+		occupied[level] &= ~(1ull << slot);
+		while( list ) {
+			timer& t(*list);
+			list = t.next;
+			insert(t);
+		}
+	}
+}
+
+void timer_queue::expire(uint64_t now) noexcept {
+	const uint64_t target = now >> tick_bits;
+	for(;;) {
+		fire(now);
+		if( current >= target ) return;
+		unsigned level, slot;
+		uint64_t tick = target;
+		if( earliest(level, slot) ) {
+			const uint64_t block = current >> shift(level + 1) << shift(level + 1);
+			const uint64_t start = block | ((uint64_t) slot << shift(level));
+			if( start < tick ) tick = start;
+		}
+		if( tick > current ) advance(tick);
+	}
+}
+
+}
@@ -0,0 +1,94 @@
+/** @brief event loop timers
+ *  @file  timer.hpp
+ *  @addtogroup core
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+#ifndef TIMER_HPP_
+#define TIMER_HPP_
+#include <cstdint>
+
+namespace usbuart {
+
+class timer_queue;
+
+/**
+ * A timer, armed in a timer_queue. Timers are scheduled, cancelled and
+ * expired on the event loop thread only
+ */
+class timer {
+public:
+	inline timer() noexcept
+	  : deadline(0), queue(nullptr), bucket(nullptr), prev(nullptr),
+		next(nullptr) {}
+	inline virtual ~timer() noexcept;
+	/** called from the event loop when deadline is reached				*/
+	virtual void expired(uint64_t now) noexcept = 0;
+	inline bool armed() const noexcept { return queue != nullptr; }
+	uint64_t deadline;	/** CLOCK_MONOTONIC, ns							*/
+private:
+	friend class timer_queue;
+	timer_queue* queue;
+	timer** bucket;
+	timer* prev;
+	timer* next;
+};
+
+/**
+ * Hierarchical timer wheel. Level 0 slots are one tick wide, each next
+ * level is 64 times coarser, eight levels cover the entire 64-bit range.
+ * Schedule and cancel are O(1), timers of a coarse slot are cascaded to
+ * finer levels when the wheel reaches the slot. Timers fire at their
+ * exact deadline, the tick only sets granularity of the wheel itself.
+ */
+class timer_queue {
+public:
+	static constexpr uint64_t never = UINT64_MAX;
+	static constexpr unsigned tick_bits = 16;	/* 65.5 us tick			*/
+	static constexpr unsigned slot_bits = 6;
+	static constexpr unsigned slots  = 1 << slot_bits;
+	static constexpr unsigned levels = 8;
+	timer_queue() noexcept;
+	~timer_queue() noexcept;
+	/** arms or re-arms the timer										*/
+	void schedule(timer& t, uint64_t deadline) noexcept;
+	/** disarms the timer												*/
+	void cancel(timer& t) noexcept;
+	/** returns the earliest deadline or never							*/
+	uint64_t next() const noexcept;
+	/** expires all timers with deadline not later than now				*/
+	void expire(uint64_t now) noexcept;
+private:
+	static inline void unlink(timer*& head, timer& t) noexcept;
+	void insert(timer& t) noexcept;
+	void fire(uint64_t now) noexcept;
+	void advance(uint64_t tick) noexcept;
+	bool earliest(unsigned& level, unsigned& slot) const noexcept;
+	uint64_t current;				/* current tick						*/
+	uint64_t occupied[levels];		/* bitmaps of non-empty slots		*/
+	timer* wheel[levels][slots];
+};
+
+inline timer::~timer() noexcept {
+	if( queue ) queue->cancel(*this);
+}
+
+}
+
+#endif /* TIMER_HPP_ */
@@ -26,6 +26,8 @@
 #include "usbuart.h"
 
 #include <cstdint>
+#include <atomic>
+#include <time.h>
 
 extern "C" {
 	struct libusb_device_handle;
@@ -37,6 +39,7 @@ namespace usbuart {
 
 typedef uint32_t time_us_t;
 typedef uint16_t size_t;
+class fault_injector;
 struct interface {
 	uint8_t	ep_bulk_in;
 	uint8_t	ep_bulk_out;
@@ -90,6 +93,41 @@ public:
 	 * Returns handle of associated USB device
 	 */
 	virtual  libusb_device_handle * handle() const noexcept =0;
+	/**
+	 * Returns time the device may hold received data before
+	 * completing a bulk-in transfer
+	 */
+	virtual time_us_t latency() const noexcept =0;
+	/**
+	 * Returns true if the device implements XON/XOFF flow control
+	 * in hardware, otherwise it is done in software by the channel
+	 */
+	virtual bool xonxoff() const noexcept =0;
+	/**
+	 * Returns number of line errors (overrun, parity, framing, break)
+	 * reported by the device, may be called from any thread
+	 */
+	virtual uint32_t errorcount() const noexcept =0;
+	/**
+	 * Submits a bulk transfer, returns libusb error code.
+	 * Simulated devices override it to complete transfers themselves
+	 */
+	virtual int submit(libusb_transfer* xfer) noexcept;
+	/**
+	 * Cancels a submitted bulk transfer, returns libusb error code
+	 */
+	virtual int cancel(libusb_transfer* xfer) noexcept;
+	/**
+	 * Clears halt of an endpoint, returns libusb error code.
+	 * Synchronous, must not be called from libusb callbacks
+	 */
+	virtual int clear_halt(uint8_t ep) noexcept;
+	/**
+	 * Takes fault injector of the channel, nullptr - none. Returns true
+	 * if the driver applies faults before data is moved, as simulated
+	 * devices do, false if faults are applied to completed transfers
+	 */
+	virtual bool inject(fault_injector*) noexcept { return false; }
 
 	virtual ~driver() noexcept {}
 
@@ -126,6 +164,7 @@ public:
 class generic : public driver {
 public:
 	static constexpr unsigned default_timeout = 5000;
+	static constexpr time_us_t default_latency = 1000; /* one USB frame */
 	~generic() noexcept;
 	void read_callback(libusb_transfer*, size_t& pos) noexcept { pos = 0; }
 	void write_callback(libusb_transfer*) noexcept { }
@@ -134,10 +173,15 @@ public:
 	void sendbreak() const throw(error_t) { throw error_t::not_implemented; }
 	void reset() const throw(error_t) { }
 	libusb_device_handle * handle() const noexcept { return dev; }
+	time_us_t latency() const noexcept { return default_latency; }
+	bool xonxoff() const noexcept { return false; }
+	uint32_t errorcount() const noexcept {
+		return line_errors.load(std::memory_order_relaxed);
+	}
 protected:
 	inline generic(libusb_device_handle* handle, const interface& _ifc,
 		uint8_t num = 0) throw(error_t) : dev(handle), ifc(_ifc), ifcnum(num),
-		timeout(default_timeout) {
+		timeout(default_timeout), line_errors(0) {
 		claim_interface();
 	}
 	void setup(const eia_tia_232_info&) const throw(error_t) {}
@@ -152,6 +196,7 @@ protected:
 	interface const & ifc;
 	const uint8_t ifcnum;
 	unsigned timeout; /** control transfer timeout */
+	std::atomic<uint32_t> line_errors;
 };
 
 
@@ -167,18 +212,82 @@ static inline constexpr size_t countof(T (C::*)[N]) noexcept { return N; }
 template<typename T, size_t N>
 static inline constexpr size_t countof(T (&)[N]) noexcept  { return N; }
 
+/**
+ * returns current time of the given clock in nanoseconds
+ */
+static inline uint64_t nanotime(clockid_t clk = CLOCK_MONOTONIC) noexcept {
+	timespec ts;
+	if( clock_gettime(clk, &ts) ) return 0;
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * returns time of one character on the line in nanoseconds,
+ * start bit, data bits, parity bit and stop bits accounted
+ */
+static inline uint32_t char_time(const eia_tia_232_info& info) noexcept {
+	const unsigned halfbits = 2 + 2 * info.databits +
+		(info.parity   != none ? 2 : 0) +
+		(info.stopbits == one  ? 2 : info.stopbits == _1_5 ? 3 : 4);
+	return (uint64_t) halfbits * 500000000u / info.baudrate;
+}
+
+/**
+ * increments a counter that has a single writer, readers may be any
+ */
+template<typename T, typename N>
+static inline void bump(std::atomic<T>& counter, N n) noexcept {
+	counter.store(counter.load(std::memory_order_relaxed) + n,
+			std::memory_order_relaxed);
+}
+
+/**
+ * time spent by this thread claiming interfaces, in nanoseconds,
+ * accounted separately from driver probe when timing an attach
+ */
+extern thread_local uint64_t claim_time;
+
 /*****************************************************************************/
 
+/**
+ * Compile time logging threshold, numeric value of loglevel_t.
+ * Calls to levels above it are empty inline functions and compile to nothing
+ */
+#ifndef USBUART_LOG_LEVEL
+#	define USBUART_LOG_LEVEL 4 /* loglevel_t::debug */
+#endif
+
+#define USBUART_LOG_FORMAT __attribute__ ((format (printf, 3, 4)))
+
+/**
+ * Log sink. Format strings and tags must have static storage duration,
+ * in asynchronous mode they are referenced after the call returns
+ */
 class Log {
 public:
-	void e(const char * tag, const char *fmt, ...) noexcept
-									__attribute__ ((format (printf, 3, 4)));
-	void w(const char * tag, const char *fmt, ...) noexcept
-									__attribute__ ((format (printf, 3, 4)));
-	void i(const char * tag, const char *fmt, ...) noexcept
-									__attribute__ ((format (printf, 3, 4)));
-	void d(const char * tag, const char *fmt, ...) noexcept
-									__attribute__ ((format (printf, 3, 4)));
+#if USBUART_LOG_LEVEL >= 1
+	void e(const char * tag, const char *fmt, ...) noexcept USBUART_LOG_FORMAT;
+#else
+	USBUART_LOG_FORMAT inline void e(const char*, const char*, ...) noexcept {}
+#endif
+#if USBUART_LOG_LEVEL >= 2
+	void w(const char * tag, const char *fmt, ...) noexcept USBUART_LOG_FORMAT;
+#else
+	USBUART_LOG_FORMAT inline void w(const char*, const char*, ...) noexcept {}
+#endif
+#if USBUART_LOG_LEVEL >= 3
+	void i(const char * tag, const char *fmt, ...) noexcept USBUART_LOG_FORMAT;
+#else
+	USBUART_LOG_FORMAT inline void i(const char*, const char*, ...) noexcept {}
+#endif
+#if USBUART_LOG_LEVEL >= 4
+	void d(const char * tag, const char *fmt, ...) noexcept USBUART_LOG_FORMAT;
+#else
+	USBUART_LOG_FORMAT inline void d(const char*, const char*, ...) noexcept {}
+#endif
+	/** switches between synchronous and asynchronous output,
+	 *  returns the previous mode										*/
+	bool async(bool enable) noexcept;
 	loglevel_t level;
 };
 
@@ -40,8 +40,10 @@ public:
 		if( --n == 0 ) unlock();
 	}
 	void upgrade() {
-		std::lock_guard<mutex> _lock(m);
-		if( --n ) lock();
+		std::unique_lock<mutex> _lock(m);
+		if( --n == 0 ) return; /* the only reader keeps the lock			*/
+		_lock.unlock(); /* other readers need m to leave				*/
+		lock();
 	}
 private:
 	std::mutex m;
@@ -0,0 +1,50 @@
+/** @brief Checks shared by the self-checking tests
+ *  @file  check.hpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Each test is a program of its own, it prints failed checks to stderr
+ * and exits with 1 if any check fails.									*/
+
+#ifndef CHECK_HPP_
+#define CHECK_HPP_
+
+#include <cstdio>
+
+namespace {
+
+unsigned failures = 0;
+
+/** counts and prints a failed check with two values of interest		*/
+void expect(bool ok, const char* what, unsigned long long a = 0,
+		unsigned long long b = 0) {
+	if( ok ) return;
+	fprintf(stderr, "FAIL %s (%llu, %llu)\n", what, a, b);
+	++failures;
+}
+
+/** prints the number of failed checks, returns exit code of the test	*/
+int report() {
+	if( failures ) fprintf(stderr, "%u checks failed\n", failures);
+	return failures ? 1 : 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+/** @brief Self-checking test of the frame checksums
+ *  @file  crc-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: crc-test
+ * Checks the catalogued check values of each checksum, compares the sliced
+ * and folded implementations with a bitwise one over lengths and alignments
+ * that reach every path, and checks trailers and their verification.	*/
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "crc.hpp"
+#include "framing.hpp"
+#include "check.hpp"
+
+using namespace usbuart;
+
+namespace {
+
+const crc_t types[] = { crc_ccitt, crc_modbus, crc_32 };
+const char* const names[] = { "", "ccitt", "modbus", "crc32" };
+
+/* bit at a time, straight from the catalogue parameters				*/
+uint32_t reference(crc_t type, const uint8_t* p, std::size_t n) {
+	uint32_t c;
+	switch( type ) {
+	case crc_ccitt:
+		c = 0xFFFF;
+		for(; n; --n, ++p) {
+			c ^= *p << 8;
+			for(int j = 0; j < 8; ++j)
+				c = ((c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1) & 0xFFFF;
+		}
+		return c;
+	case crc_modbus:
+		c = 0xFFFF;
+		for(; n; --n, ++p) {
+			c ^= *p;
+			for(int j = 0; j < 8; ++j)
+				c = (c & 1) ? (c >> 1) ^ 0xA001 : c >> 1;
+		}
+		return c;
+	case crc_32:
+		c = 0xFFFFFFFF;
+		for(; n; --n, ++p) {
+			c ^= *p;
+			for(int j = 0; j < 8; ++j)
+				c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+		}
+		return ~c;
+	default:
+		return 0;
+	}
+}
+
+void check_values() {
+	const uint8_t* check = (const uint8_t*) "123456789";
+	expect(crc::compute(crc_ccitt, check, 9) == 0x29B1, "ccitt check",
+			crc::compute(crc_ccitt, check, 9));
+	expect(crc::compute(crc_modbus, check, 9) == 0x4B37, "modbus check",
+			crc::compute(crc_modbus, check, 9));
+	expect(crc::compute(crc_32, check, 9) == 0xCBF43926, "crc32 check",
+			crc::compute(crc_32, check, 9));
+	expect(crc::size(crc_none) == 0, "size none", crc::size(crc_none));
+	expect(crc::size(crc_ccitt) == 2, "size ccitt", crc::size(crc_ccitt));
+	expect(crc::size(crc_modbus) == 2, "size modbus", crc::size(crc_modbus));
+	expect(crc::size(crc_32) == 4, "size crc32", crc::size(crc_32));
+}
+
+void lengths() {
+	std::vector<uint8_t> data(640 + 16);
+	uint32_t x = 1;
+	for(auto& b : data) {
+		x = x * 1103515245 + 12345;
+		b = x >> 16;
+	}
+	for(auto type : types)
+		for(unsigned offset : { 0, 1, 3, 8 })
+			for(unsigned n = 0; n <= 600; ++n) {
+				const uint8_t* p = data.data() + offset;
+				const uint32_t got = crc::compute(type, p, n);
+				const uint32_t want = reference(type, p, n);
+				if( got != want ) {
+					expect(false, names[type], n, offset);
+					break;
+				}
+			}
+}
+
+void trailers() {
+	static const uint8_t expected[][4] = {
+		{}, { 0x29, 0xB1 }, { 0x37, 0x4B }, { 0x26, 0x39, 0xF4, 0xCB } };
+	for(auto type : types) {
+		uint8_t buff[16] = "123456789";
+		const unsigned n = crc::append(type, buff, 9);
+		expect(n == 9 + crc::size(type), names[type], n);
+		expect(memcmp(buff + 9, expected[type], crc::size(type)) == 0,
+				names[type], buff[9], buff[10]);
+		expect(crc::verify(type, buff, n), names[type]);
+		for(unsigned i = 0; i < n; ++i) {
+			buff[i] ^= 0x10;
+			expect(! crc::verify(type, buff, n), names[type], i);
+			buff[i] ^= 0x10;
+		}
+		expect(! crc::verify(type, buff, crc::size(type) - 1), names[type]);
+	}
+}
+
+struct sink {
+	std::vector<std::vector<uint8_t>> frames;
+	static void cb(void* user, const uint8_t* frame, unsigned size,
+			const rx_timestamp*) {
+		static_cast<sink*>(user)->frames.emplace_back(frame, frame + size);
+	}
+};
+
+/* framer verifies and strips the trailer, bad frames are only counted	*/
+void framed() {
+	const framing_info info { frame_cobs, 0, 0, 0, 0 };
+	for(auto type : types) {
+		sink out;
+		std::unique_ptr<framer> f(framer::create(info, sink::cb, &out));
+		f->check = type;
+		uint8_t frame[16] = { 1, 0, 2, 0, 3 };
+		const unsigned n = crc::append(type, frame, 5);
+		uint8_t encoded[2][32];
+		const unsigned size = framer::encode(info, frame, n, encoded[0]);
+		memcpy(encoded[1], encoded[0], size);
+		encoded[1][1] ^= 0x40;
+		const rx_timestamp ts { 0, 0, 0, size, 0 };
+		f->feed(encoded[1], size, ts);
+		f->feed(encoded[0], size, ts);
+		expect(out.frames.size() == 1, names[type], out.frames.size());
+		expect(out.frames.size() &&
+				out.frames[0] == std::vector<uint8_t>(frame, frame + 5),
+				names[type]);
+		expect(f->counters->bad_crc.load() == 1, names[type],
+				f->counters->bad_crc.load());
+	}
+}
+
+}
+
+int main() {
+	check_values();
+	lengths();
+	trailers();
+	framed();
+	return report();
+}
@@ -0,0 +1,208 @@
+/** @brief Self-checking test of the delimiter, SLIP, COBS, HDLC and gap framers
+ *  @file  framing-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: framing-test
+ * Encodes series of frames, feeds the encoded stream to the framer in
+ * chunks of various sizes and compares decoded frames with the originals.	*/
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "framing.hpp"
+#include "check.hpp"
+
+using namespace usbuart;
+
+namespace {
+
+typedef std::vector<uint8_t> bytes;
+
+struct sink {
+	std::vector<bytes> frames;
+	static void cb(void* user, const uint8_t* frame, unsigned size,
+			const rx_timestamp*) {
+		static_cast<sink*>(user)->frames.push_back(bytes(frame, frame + size));
+	}
+};
+
+/* payload dense with bytes special to one framing or another			*/
+bytes payload(unsigned size, unsigned seed, bool nodelim) {
+	static const uint8_t special[] = { 0x00, 0xC0, 0xDB, 0xDC, 0xDD,
+		0x7E, 0x7D, 0x5E, 0x5D, 0xFF };
+	bytes data(size);
+	uint32_t x = seed * 2654435761u + 1;
+	for(auto& b : data) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		b = (x & 3) ? x >> 8 : special[(x >> 8) % sizeof(special)];
+		if( nodelim && b == '\n' ) b = ' ';
+	}
+	return data;
+}
+
+rx_timestamp stamp(uint64_t time, uint64_t offset, unsigned size) {
+	return { time, 0, offset, size, 0 };
+}
+
+void roundtrip(framing_t type, const char* name) {
+	static const unsigned sizes[] = { 1, 2, 253, 254, 255, 256, 508, 1000 };
+	static const unsigned chunks[] = { 1, 3, 64, 512, 65535 };
+	const framing_info info { type, '\n', 0, 0, 0 };
+	std::vector<bytes> frames;
+	bytes stream;
+	for(unsigned size : sizes) {
+		frames.push_back(payload(size, size, type == frame_delimiter));
+		const unsigned limit = framer::encoded_size(info, size);
+		bytes encoded(limit);
+		const unsigned n = framer::encode(info, frames.back().data(), size,
+				encoded.data());
+		expect(n <= limit, name, n, limit);
+		stream.insert(stream.end(), encoded.begin(), encoded.begin() + n);
+	}
+	for(unsigned chunk : chunks) {
+		sink out;
+		std::unique_ptr<framer> f(framer::create(info, sink::cb, &out));
+		for(unsigned pos = 0; pos < stream.size(); pos += chunk) {
+			const unsigned n = std::min<unsigned>(chunk, stream.size() - pos);
+			f->feed(stream.data() + pos, n, stamp(pos, pos, n));
+		}
+		expect(out.frames.size() == frames.size(), name, chunk,
+				out.frames.size());
+		for(unsigned i = 0; i < out.frames.size() && i < frames.size(); ++i)
+			expect(out.frames[i] == frames[i], name, chunk, i);
+	}
+}
+
+unsigned cobs(const bytes& data, bytes& encoded) {
+	const framing_info info { frame_cobs, 0, 0, 0, 0 };
+	encoded.resize(framer::encoded_size(info, data.size()));
+	const unsigned n = framer::encode(info, data.data(), data.size(),
+			encoded.data());
+	encoded.resize(n);
+	return n;
+}
+
+void cobs_blocks() {
+	bytes encoded;
+	unsigned n;
+	/* a full block at the end is not followed by an empty one			*/
+	bytes full(254, 0x11);
+	n = cobs(full, encoded);
+	expect(n == 256, "cobs 254 size", n);
+	expect(encoded.front() == 0xFF && encoded.back() == 0, "cobs 254 codes",
+			encoded.front(), encoded[encoded.size() - 2]);
+	full.push_back(0x22);
+	n = cobs(full, encoded);
+	expect(n == 258, "cobs 255 size", n);
+	expect(encoded[255] == 0x02, "cobs 255 code", encoded[255]);
+	/* a trailing zero still needs its code byte						*/
+	full.back() = 0;
+	n = cobs(full, encoded);
+	expect(n == 258, "cobs 254+0 size", n);
+	expect(encoded[255] == 0x01 && encoded[256] == 0x01, "cobs 254+0 codes",
+			encoded[255], encoded[256]);
+	n = cobs(bytes(3, 0), encoded);
+	expect(n == 5, "cobs zeros", n);
+	expect(encoded == bytes({ 1, 1, 1, 1, 0 }), "cobs zeros codes");
+}
+
+void malformed() {
+	const framing_info info { frame_cobs, 0, 0, 0, 0 };
+	sink out;
+	std::unique_ptr<framer> f(framer::create(info, sink::cb, &out));
+	/* code byte runs past the delimiter, the next frame is intact		*/
+	const uint8_t data[] = { 0x05, 0x01, 0x00, 0x03, 0x01, 0x02, 0x00 };
+	f->feed(data, sizeof(data), stamp(0, 0, sizeof(data)));
+	expect(out.frames.size() == 1, "cobs malformed frames", out.frames.size());
+	expect(out.frames.size() && out.frames[0] == bytes({ 1, 2 }),
+			"cobs malformed next");
+	expect(f->counters->dropped.load() == 2, "cobs malformed dropped",
+			f->counters->dropped.load());
+}
+
+void oversized() {
+	const framing_info info { frame_delimiter, '\n', 16, 0, 0 };
+	sink out;
+	std::unique_ptr<framer> f(framer::create(info, sink::cb, &out));
+	bytes data(20, 'a');
+	data.push_back('\n');
+	data.insert(data.end(), { 'o', 'k', '\n' });
+	for(unsigned pos = 0; pos < data.size(); pos += 5) {
+		const unsigned n = std::min<unsigned>(5, data.size() - pos);
+		f->feed(data.data() + pos, n, stamp(pos, pos, n));
+	}
+	expect(out.frames.size() == 1, "oversized frames", out.frames.size());
+	expect(out.frames.size() && out.frames[0] == bytes({ 'o', 'k' }),
+			"oversized next");
+	expect(f->counters->dropped.load() == 20, "oversized dropped",
+			f->counters->dropped.load());
+}
+
+void gaps() {
+	const framing_info info { frame_gap, 0, 0, 0, 0 };
+	const eia_tia_232_info line { 9600, 8, none, one, none_ };
+	const uint64_t chartime = char_time(line);
+	const uint64_t gap = chartime * 35 / 10;
+	sink out;
+	timer_queue timers;
+	std::unique_ptr<framer> f(framer::create(info, sink::cb, &out));
+	f->attach(timers, line, 0);
+	const bytes a = payload(40, 1, false), b = payload(7, 2, false);
+	uint64_t t = 1000000000;
+	/* chunks arrive back to back, well within the gap					*/
+	for(unsigned pos = 0; pos < a.size(); pos += 8) {
+		t += 8 * chartime;
+		f->feed(a.data() + pos, 8, stamp(t, pos, 8));
+	}
+	expect(out.frames.empty(), "gap early", out.frames.size());
+	/* silence before the next chunk completes the frame				*/
+	t += 8 * chartime + 2 * gap;
+	f->feed(b.data(), b.size(), stamp(t, a.size(), b.size()));
+	expect(out.frames.size() == 1 && out.frames[0] == a, "gap frame",
+			out.frames.size());
+	/* trailing silence is detected by the timer						*/
+	timers.expire(t + gap);
+	expect(out.frames.size() == 1, "gap timer early", out.frames.size());
+	timers.expire(timers.next());
+	expect(out.frames.size() == 2 && out.frames[1] == b, "gap timer",
+			out.frames.size());
+	/* or by an empty completion										*/
+	t += 100 * chartime;
+	f->feed(b.data(), b.size(), stamp(t, a.size() + b.size(), b.size()));
+	f->idle(t + gap / 2);
+	expect(out.frames.size() == 2, "gap idle early", out.frames.size());
+	f->idle(t + 2 * gap);
+	expect(out.frames.size() == 3, "gap idle", out.frames.size());
+	expect(timers.next() == timer_queue::never, "gap idle timer");
+}
+
+}
+
+int main() {
+	roundtrip(frame_delimiter, "delimiter");
+	roundtrip(frame_slip, "slip");
+	roundtrip(frame_cobs, "cobs");
+	roundtrip(frame_hdlc, "hdlc");
+	cobs_blocks();
+	malformed();
+	oversized();
+	gaps();
+	return report();
+}
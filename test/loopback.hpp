@@ -0,0 +1,120 @@
+/** @brief Loopback rig of the behavior tests
+ *  @file  loopback.hpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Behavior tests drive the library through its API, on channels piped
+ * to in-process loopback devices, with the event loop on its own thread.	*/
+
+#ifndef LOOPBACK_HPP_
+#define LOOPBACK_HPP_
+
+#include <atomic>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "usbuart.h"
+
+namespace {
+
+using namespace usbuart;
+
+inline uint64_t now_ns() noexcept {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** context with the event loop running and channels to loopbacks		*/
+class rig {
+public:
+	rig() noexcept : running(true), worker([this]() { run(); }) {
+		signal(SIGPIPE, SIG_IGN);
+	}
+	~rig() noexcept {
+		while( channels.size() ) close(channels.back());
+		running = false;
+		worker.join();
+	}
+
+	/** pipes a new loopback, fd_read is made non-blocking, the channel
+	 *  has fd_read/fd_write -1 on failure								*/
+	channel open(const eia_tia_232_info& pi, unsigned latency = 0) noexcept {
+		channel ch { -1, -1 };
+		device_addr addr;
+		if( ctx.loopback(addr, latency) || ctx.pipe(addr, ch, pi) )
+			return { -1, -1 };
+		fcntl(ch.fd_read, F_SETFL, fcntl(ch.fd_read, F_GETFL) | O_NONBLOCK);
+		channels.push_back(ch);
+		return ch;
+	}
+
+	/** closes the channel and its descriptors						*/
+	void close(channel ch) noexcept {
+		for(auto i = channels.begin(); i != channels.end(); ++i) {
+			if( i->fd_read != ch.fd_read ) continue;
+			channels.erase(i);
+			break;
+		}
+		ctx.close(ch);
+		::close(ch.fd_read);
+		::close(ch.fd_write);
+	}
+
+	/** reads what arrives within ms milliseconds, up to size bytes		*/
+	std::string read(channel ch, std::size_t size, unsigned ms) noexcept {
+		std::string data;
+		const uint64_t deadline = now_ns() + ms * 1000000ull;
+		char buff[4096];
+		while( data.size() < size && now_ns() < deadline ) {
+			const ssize_t n = ::read(ch.fd_read, buff, sizeof(buff));
+			if( n > 0 ) data.append(buff, n);
+			else usleep(200);
+		}
+		return data;
+	}
+
+	/** waits up to ms milliseconds for the condition					*/
+	template<typename T>
+	static bool wait(T condition, unsigned ms) noexcept {
+		const uint64_t deadline = now_ns() + ms * 1000000ull;
+		while( ! condition() ) {
+			if( now_ns() > deadline ) return false;
+			usleep(200);
+		}
+		return true;
+	}
+
+	context ctx;
+private:
+	void run() noexcept {
+		while( running ) ctx.loop(10);
+	}
+	std::atomic<bool> running;
+	std::thread worker;
+	std::vector<channel> channels;
+};
+
+}
+
+#endif
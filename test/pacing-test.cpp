@@ -0,0 +1,67 @@
+/** @brief Behavior test of transmit pacing
+ *  @file  pacing-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: pacing-test
+ * Queues a backlog of broadcasts on a 115200 baud loopback, then sends a
+ * marker with send_at, which bypasses pacing. On a paced channel the
+ * backlog is held by the library and the marker comes back within the
+ * first blocks, with pacing disabled the backlog sits in the device and
+ * the marker comes back after it. All of the backlog arrives intact.	*/
+
+#include "loopback.hpp"
+#include "check.hpp"
+
+namespace {
+
+constexpr unsigned blocks = 10, block = 400;
+
+/** returns position of the marker in the echo, or blocks * block + 1	*/
+std::size_t marker(rig& r, channel ch, unsigned lead) {
+	expect(r.ctx.pace(ch, lead) == 0, "pace", lead);
+	usleep(50000);		/* pacing is set on the loop thread				*/
+	const std::string data(block, 'a');
+	for(unsigned i = 0; i < blocks; ++i)
+		expect(r.ctx.broadcast(&ch, 1, data.data(), block) == 1,
+				"broadcast", i);
+	expect(r.ctx.send_at(ch, "Z", 1, now_ns()) == 0, "send_at");
+	const std::string echo = r.read(ch, blocks * block + 1, 3000);
+	expect(echo.size() == blocks * block + 1, "echo size", echo.size());
+	std::size_t pos = echo.find('Z');
+	if( pos == std::string::npos ) pos = blocks * block + 1;
+	else expect(echo.find_first_not_of('a', pos + 1) == std::string::npos,
+			"echo intact", pos);
+	return pos;
+}
+
+}
+
+int main() {
+	rig r;
+	const channel ch = r.open(_115200_8N1n);
+	expect(ch.fd_read >= 0, "open");
+	if( ch.fd_read < 0 ) return report();
+	/* a 10 ms lead window is some 115 characters						*/
+	std::size_t pos = marker(r, ch, 10000);
+	expect(pos <= 2 * block, "paced marker late", pos);
+	pos = marker(r, ch, 0);
+	expect(pos == blocks * block, "unpaced marker early", pos);
+	return report();
+}
@@ -0,0 +1,147 @@
+/** @brief Behavior test of recovery from endpoint STALL
+ *  @file  recovery-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: recovery-test
+ * Injects STALL into every 50th transfer of a loopback channel and checks
+ * that the pipe stream and broadcasts come back intact, that recoveries
+ * are counted and that with no recoveries allowed the first STALL removes
+ * the channel.															*/
+
+#include "loopback.hpp"
+#include "check.hpp"
+
+namespace {
+
+constexpr std::size_t total = 1 << 18;
+constexpr std::size_t window = 8192;		/* half of the loopback fifo	*/
+constexpr unsigned block = 1000;
+constexpr eia_tia_232_info line { 12000000, 8, none, one, none_ };
+
+inline uint8_t pattern(std::size_t i) noexcept {
+	return i * 7 % 251;
+}
+
+/** checks the echo against the pattern, returns false on a mismatch	*/
+bool verify(const std::string& echo, std::size_t& got) {
+	for(char c : echo)
+		if( (uint8_t) c != pattern(got++) ) {
+			expect(false, "echo corrupt", got - 1);
+			return false;
+		}
+	return true;
+}
+
+void stall(channel ch, rig& r) {
+	expect(r.ctx.recovery(ch, 1000, 1000) == 0, "recovery");
+	fault_plan plan {};
+	plan.rate[fault_stall] = 20000;
+	expect(r.ctx.inject(ch, &plan) == 0, "inject");
+}
+
+void piped(rig& r) {
+	const channel ch = r.open(line);
+	expect(ch.fd_read >= 0, "pipe open");
+	if( ch.fd_read < 0 ) return;
+	stall(ch, r);
+	std::size_t sent = 0, got = 0;
+	uint8_t data[1024];
+	const uint64_t deadline = now_ns() + 10000000000ull;
+	while( got < total && now_ns() < deadline ) {
+		if( sent < total && sent - got < window ) {
+			std::size_t n = 0;
+			for(; n < sizeof(data) && sent + n < total; ++n)
+				data[n] = pattern(sent + n);
+			const ssize_t w = ::write(ch.fd_write, data, n);
+			if( w > 0 ) sent += w;
+		}
+		if( ! verify(r.read(ch, 1, 1), got) ) break;
+	}
+	expect(got == total, "pipe echo", got);
+	fault_stats fs;
+	channel_stats cs;
+	expect(r.ctx.faults(ch, fs) == 0 && r.ctx.stats(ch, cs) == 0,
+			"pipe channel removed");
+	expect(fs.injected[fault_stall] > 0, "pipe stalls",
+			fs.injected[fault_stall]);
+	expect(cs.recoveries > 0, "pipe recoveries", cs.recoveries);
+}
+
+struct tally {
+	std::atomic<unsigned> done { 0 };
+	std::atomic<unsigned> failed { 0 };
+	static void cb(void* user, channel, int status, unsigned sent) {
+		tally& t(*static_cast<tally*>(user));
+		if( status || sent != block ) ++t.failed;
+		++t.done;
+	}
+};
+
+void broadcast(rig& r) {
+	const channel ch = r.open(line);
+	expect(ch.fd_read >= 0, "broadcast open");
+	if( ch.fd_read < 0 ) return;
+	stall(ch, r);
+	tally t;
+	std::size_t sent = 0, got = 0;
+	uint8_t data[block];
+	const uint64_t deadline = now_ns() + 10000000000ull;
+	while( got < total && now_ns() < deadline ) {
+		if( sent < total && sent - got < window ) {
+			for(unsigned i = 0; i < block; ++i)
+				data[i] = pattern(sent + i);
+			if( r.ctx.broadcast(&ch, 1, data, block, tally::cb, &t) != 1 )
+				break;
+			sent += block;
+		}
+		if( ! verify(r.read(ch, 1, 1), got) ) break;
+	}
+	expect(got == sent && sent >= total, "broadcast echo", got, sent);
+	expect(rig::wait([&]() { return t.done * block == sent; }, 1000),
+			"broadcast callbacks", t.done);
+	expect(t.failed == 0, "broadcast failed", t.failed);
+	channel_stats cs;
+	expect(r.ctx.stats(ch, cs) == 0, "broadcast channel removed");
+	expect(cs.recoveries > 0, "broadcast recoveries", cs.recoveries);
+}
+
+void limited(rig& r) {
+	const channel ch = r.open(line);
+	expect(ch.fd_read >= 0, "limit open");
+	if( ch.fd_read < 0 ) return;
+	expect(r.ctx.recovery(ch, 0, 1000) == 0, "limit recovery");
+	fault_plan plan {};
+	plan.rate[fault_stall] = 1000000;
+	expect(r.ctx.inject(ch, &plan) == 0, "limit inject");
+	expect(::write(ch.fd_write, "x", 1) == 1, "limit write");
+	channel_stats cs;
+	expect(rig::wait([&]() { return r.ctx.stats(ch, cs) != 0; }, 1000),
+			"limit channel kept");
+}
+
+}
+
+int main() {
+	rig r;
+	piped(r);
+	broadcast(r);
+	limited(r);
+	return report();
+}
@@ -0,0 +1,95 @@
+/** @brief Behavior test of capture and replay
+ *  @file  replay-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: replay-test
+ * Captures traffic of a loopback to a pcapng file, two bursts some time
+ * apart, then replays the file. Checks that the replay delivers what was
+ * received, at once in fast mode and with the gap between the bursts kept
+ * in timed mode.														*/
+
+#include <cstdio>
+#include "loopback.hpp"
+#include "check.hpp"
+
+namespace {
+
+constexpr uint64_t ms = 1000000ull;
+constexpr uint64_t gap = 150 * ms;
+const std::string first = "first burst of data ", second = "second burst";
+
+void record(rig& r, const char* path) {
+	const channel ch = r.open(_115200_8N1n);
+	expect(ch.fd_read >= 0, "open");
+	if( ch.fd_read < 0 ) return;
+	expect(r.ctx.capture(ch, path) == 0, "capture");
+	usleep(20000);		/* capture starts on the loop thread				*/
+	expect(::write(ch.fd_write, first.data(), first.size()) ==
+			(ssize_t) first.size(), "first write");
+	expect(r.read(ch, first.size(), 1000) == first, "first echo");
+	usleep(gap / 1000);
+	expect(::write(ch.fd_write, second.data(), second.size()) ==
+			(ssize_t) second.size(), "second write");
+	expect(r.read(ch, second.size(), 1000) == second, "second echo");
+	/* the file is complete when capture stops							*/
+	expect(r.ctx.capture(ch, nullptr) == 0, "capture stop");
+	usleep(20000);
+	r.close(ch);
+}
+
+/** replays the file, returns time between the bursts					*/
+uint64_t replay(rig& r, const char* path, unsigned mode) {
+	int in[2], out[2];
+	if( ::pipe(in) || ::pipe(out) ) {
+		expect(false, "pipes");
+		return 0;
+	}
+	fcntl(out[0], F_SETFL, fcntl(out[0], F_GETFL) | O_NONBLOCK);
+	const channel ch { in[0], out[1] };
+	const channel app { out[0], in[1] };
+	const std::size_t size = first.size() + second.size();
+	expect(r.ctx.replay(ch, path, mode) == 0, "replay", mode);
+	/* the first read may already take both bursts						*/
+	std::string data = r.read(app, first.size(), 1000);
+	const uint64_t start = now_ns();
+	if( data.size() < size ) data += r.read(app, size - data.size(), 1000);
+	const uint64_t between = now_ns() - start;
+	expect(data == first + second, "replay data", mode, data.size());
+	r.ctx.close(ch);
+	for(int fd : { in[0], in[1], out[0], out[1] }) ::close(fd);
+	return between;
+}
+
+}
+
+int main() {
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/replay-test-%d.pcapng", getpid());
+	{
+		rig r;
+		record(r, path);
+		const uint64_t fast = replay(r, path, replay_fast);
+		expect(fast < gap / 2, "fast replay slow", fast / 1000);
+		const uint64_t timed = replay(r, path, replay_timed);
+		expect(timed > gap * 3 / 4, "timed replay fast", timed / 1000);
+	}
+	unlink(path);
+	return report();
+}
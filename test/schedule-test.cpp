@@ -0,0 +1,121 @@
+/** @brief Behavior test of scheduled transmission
+ *  @file  schedule-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: schedule-test
+ * Schedules transmissions with send_at on a loopback, out of the order of
+ * their deadlines, and checks that they are submitted at the deadlines,
+ * come back in the order of deadlines and report sane times, that a past
+ * deadline submits at once and that closing the channel cancels those not
+ * yet submitted.														*/
+
+#include <mutex>
+#include "loopback.hpp"
+#include "check.hpp"
+
+namespace {
+
+constexpr uint64_t ms = 1000000ull;
+/* the loop may be late by its poll timeout and a tick of the timers	*/
+constexpr uint64_t tolerance = 30 * ms;
+
+struct outcome {
+	int status;
+	uint64_t submitted;
+	uint64_t completed;
+};
+
+struct journal {
+	std::mutex lock;
+	std::vector<outcome> entries;
+	static void cb(void* user, channel, int status, uint64_t submitted,
+			uint64_t completed) {
+		journal& j(*static_cast<journal*>(user));
+		std::lock_guard<std::mutex> guard(j.lock);
+		j.entries.push_back({ status, submitted, completed });
+	}
+	std::size_t size() {
+		std::lock_guard<std::mutex> guard(lock);
+		return entries.size();
+	}
+};
+
+void deadlines(rig& r, channel ch) {
+	journal j;
+	const uint64_t now = now_ns();
+	const uint64_t late = now + 80 * ms, early = now + 40 * ms;
+	expect(r.ctx.send_at(ch, "B", 1, late, journal::cb, &j) == 0, "late");
+	expect(r.ctx.send_at(ch, "A", 1, early, journal::cb, &j) == 0, "early");
+	expect(r.read(ch, 1, 20).empty(), "sent before deadline");
+	expect(r.read(ch, 2, 1000) == "AB", "deadline order");
+	expect(rig::wait([&j]() { return j.size() == 2; }, 1000),
+			"deadline callbacks", j.size());
+	if( j.size() != 2 ) return;
+	const uint64_t deadline[] = { early, late };
+	for(unsigned i = 0; i < 2; ++i) {
+		const outcome& o(j.entries[i]);
+		expect(o.status == 0, "deadline status", i, -o.status);
+		expect(o.submitted >= deadline[i], "submitted early", i,
+				(deadline[i] - o.submitted) / 1000);
+		expect(o.submitted < deadline[i] + tolerance, "submitted late", i,
+				(o.submitted - deadline[i]) / 1000);
+		expect(o.completed >= o.submitted, "completed early", i);
+	}
+}
+
+void past(rig& r, channel ch) {
+	journal j;
+	const uint64_t now = now_ns();
+	expect(r.ctx.send_at(ch, "P", 1, now - 100 * ms, journal::cb, &j) == 0,
+			"past");
+	expect(r.read(ch, 1, 1000) == "P", "past echo");
+	expect(rig::wait([&j]() { return j.size() == 1; }, 1000),
+			"past callback", j.size());
+	if( j.size() != 1 ) return;
+	expect(j.entries[0].status == 0, "past status", -j.entries[0].status);
+	expect(j.entries[0].submitted < now + tolerance, "past submitted late",
+			(j.entries[0].submitted - now) / 1000);
+}
+
+void cancelled(rig& r, channel ch) {
+	journal j;
+	expect(r.ctx.send_at(ch, "C", 1, now_ns() + 10000 * ms, journal::cb, &j)
+			== 0, "cancel");
+	r.close(ch);
+	expect(rig::wait([&j]() { return j.size() == 1; }, 1000),
+			"cancel callback", j.size());
+	if( j.size() != 1 ) return;
+	expect(j.entries[0].status < 0, "cancel status");
+	expect(j.entries[0].submitted == 0 && j.entries[0].completed == 0,
+			"cancel times");
+}
+
+}
+
+int main() {
+	rig r;
+	const channel ch = r.open(_115200_8N1n);
+	expect(ch.fd_read >= 0, "open");
+	if( ch.fd_read < 0 ) return report();
+	deadlines(r, ch);
+	past(r, ch);
+	cancelled(r, ch);
+	return report();
+}
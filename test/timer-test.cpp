@@ -0,0 +1,181 @@
+/** @brief Self-checking test of the timer wheel
+ *  @file  timer-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: timer-test
+ * Arms timers with deadlines spread over every level of the wheel, expires
+ * them in steps, cancels some of them on the way and checks that each
+ * timer fires once, at the first expire reaching its deadline, in order
+ * of ticks, and that cancelled timers never fire.						*/
+
+#include <vector>
+#include "timer.hpp"
+#include "check.hpp"
+
+using namespace usbuart;
+
+namespace {
+
+uint64_t random(uint64_t& x) {
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	return x;
+}
+
+struct probe : timer {
+	void expired(uint64_t now) noexcept {
+		++fired;
+		at = now;
+		order.push_back(this);
+		if( action ) action(*this, now);
+	}
+	unsigned fired = 0;
+	uint64_t at = 0;
+	bool cancelled = false;
+	void (*action)(probe&, uint64_t) = nullptr;
+	probe* other = nullptr;
+	timer_queue* queue = nullptr;
+	static std::vector<probe*> order;
+};
+
+std::vector<probe*> probe::order;
+
+constexpr uint64_t base = 5000000000000ull;	/* some 80 minutes of uptime	*/
+
+uint64_t earliest(const std::vector<probe>& timers) {
+	uint64_t min = timer_queue::never;
+	for(auto& t : timers)
+		if( t.armed() && t.deadline < min ) min = t.deadline;
+	return min;
+}
+
+void spread() {
+	static const uint64_t ranges[] = { 1000, 100000, 10000000, 1000000000,
+		100000000000ull, 10000000000000ull };
+	uint64_t x = 88172645463325252ull;
+	timer_queue queue;
+	std::vector<probe> timers(3000);
+	queue.expire(base);
+	for(auto& t : timers) {
+		const uint64_t range = ranges[random(x) % 6];
+		/* a few are already past due									*/
+		queue.schedule(t, base - range / 16 + random(x) % range);
+	}
+	expect(queue.next() == earliest(timers), "next", queue.next(),
+			earliest(timers));
+	uint64_t now = base, last = base;
+	while( queue.next() != timer_queue::never ) {
+		now += random(x) % (random(x) & 1 ? 200000 : 50000000000ull);
+		for(unsigned i = random(x) % 4; i; --i) {
+			probe& t(timers[random(x) % timers.size()]);
+			if( ! t.armed() ) continue;
+			queue.cancel(t);
+			t.cancelled = true;
+			expect(! t.armed(), "cancel disarms");
+		}
+		probe::order.clear();
+		queue.expire(now);
+		uint64_t tick = 0;
+		for(auto t : probe::order) {
+			expect(t->deadline <= now, "fired early", t->deadline, now);
+			expect(t->deadline > last || t->deadline <= base, "fired late",
+					t->deadline, last);
+			const uint64_t tt = t->deadline >> timer_queue::tick_bits;
+			expect(tt >= tick || t->deadline <= base, "fired out of order",
+					tt, tick);
+			if( tt > tick ) tick = tt;
+		}
+		for(auto& t : timers)
+			if( t.armed() )
+				expect(t.deadline > now, "not fired", t.deadline, now);
+		expect(queue.next() == earliest(timers), "next", queue.next(),
+				earliest(timers));
+		last = now;
+	}
+	for(auto& t : timers) {
+		if( t.cancelled ) expect(t.fired == 0, "cancelled fired", t.fired);
+		else expect(t.fired == 1, "fired once", t.fired, t.deadline);
+	}
+}
+
+/* callbacks may cancel and arm timers, including the ones being fired	*/
+void callbacks() {
+	timer_queue queue;
+	probe a, b, c, d, e;
+	const uint64_t tick = 1ull << timer_queue::tick_bits;
+	queue.expire(base);
+	a.queue = b.queue = d.queue = e.queue = &queue;
+	/* a and b share a slot, order within a slot is not defined, the first
+	 * to fire takes the other off the local list being fired			*/
+	a.other = &b;
+	b.other = &a;
+	a.action = b.action = [](probe& t, uint64_t) {
+		t.queue->cancel(*t.other);
+	};
+	queue.schedule(a, base + 10);
+	queue.schedule(b, base + 20);
+	/* c is in a later slot reached by the same expire					*/
+	queue.schedule(c, base + 3 * tick);
+	/* d, due in the last slot, re-arms itself for the same time, it fires
+	 * on the next expire, not in this one								*/
+	d.action = [](probe& t, uint64_t now) {
+		if( t.fired == 1 ) t.queue->schedule(t, now);
+	};
+	queue.schedule(d, base + 4 * tick);
+	/* e cancels c before its slot is reached							*/
+	e.other = &c;
+	e.action = [](probe& t, uint64_t) { t.queue->cancel(*t.other); };
+	queue.schedule(e, base + 2 * tick);
+	probe::order.clear();
+	queue.expire(base + 4 * tick);
+	expect(a.fired + b.fired == 1 && ! a.armed() && ! b.armed(),
+			"cancel same slot", a.fired, b.fired);
+	expect(c.fired == 0 && ! c.armed(), "cancel later slot", c.fired);
+	expect(d.fired == 1 && d.armed(), "rearm in callback", d.fired);
+	expect(probe::order.size() == 3 && probe::order[1] == &e &&
+			probe::order[2] == &d, "callback order", probe::order.size());
+	queue.expire(base + 4 * tick);
+	expect(d.fired == 2 && ! d.armed(), "rearmed fired", d.fired);
+	expect(queue.next() == timer_queue::never, "callbacks drained",
+			queue.next());
+	/* rescheduling moves an armed timer								*/
+	const unsigned fired = a.fired;
+	queue.schedule(a, base + 100 * tick);
+	queue.schedule(a, base + 200 * tick);
+	expect(queue.next() == base + 200 * tick, "reschedule", queue.next());
+	queue.expire(base + 150 * tick);
+	expect(a.fired == fired, "rescheduled early", a.fired);
+	{
+		probe f;
+		queue.schedule(f, base + 160 * tick);
+		expect(queue.next() == base + 160 * tick, "scoped", queue.next());
+	}
+	/* the destructor of a timer disarms it								*/
+	expect(queue.next() == base + 200 * tick, "destroyed", queue.next());
+	queue.expire(base + 200 * tick);
+	expect(a.fired == fired + 1, "rescheduled", a.fired);
+}
+
+}
+
+int main() {
+	spread();
+	callbacks();
+	return report();
+}
@@ -0,0 +1,132 @@
+/** @brief Behavior test of request/response transactions
+ *  @file  transact-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: transact-test
+ * Runs transactions on a loopback, which answers each request with the
+ * request itself, and checks matching by terminator and by length, that
+ * bytes past the match reach fd_write, that a response never matched
+ * times out and that queued transactions complete in order.			*/
+
+#include <cstring>
+#include <mutex>
+#include "loopback.hpp"
+#include "check.hpp"
+
+namespace {
+
+struct outcome {
+	int status;
+	std::string response;
+	uint64_t time;
+};
+
+struct journal {
+	std::mutex lock;
+	std::vector<outcome> entries;
+	static void cb(void* user, channel, int status, const uint8_t* data,
+			unsigned size) {
+		journal& j(*static_cast<journal*>(user));
+		std::lock_guard<std::mutex> guard(j.lock);
+		j.entries.push_back({ status, std::string((const char*)data, size),
+			now_ns() });
+	}
+	std::size_t size() {
+		std::lock_guard<std::mutex> guard(lock);
+		return entries.size();
+	}
+};
+
+void terminated(rig& r, channel ch) {
+	journal j;
+	const match_spec match { 0, '\n' };
+	expect(r.ctx.transact(ch, "ping\nrest", 9, match, 0, journal::cb, &j) ==
+			0, "terminator queued");
+	expect(rig::wait([&j]() { return j.size() == 1; }, 1000),
+			"terminator completed", j.size());
+	if( j.size() != 1 ) return;
+	expect(j.entries[0].status == 0, "terminator status", -j.entries[0].status);
+	expect(j.entries[0].response == "ping\n", "terminator response",
+			j.entries[0].response.size());
+	/* the rest of the echo is not a part of the response				*/
+	expect(r.read(ch, 4, 1000) == "rest", "terminator rest");
+}
+
+void counted(rig& r, channel ch) {
+	journal j;
+	const match_spec match { 6, -1 };
+	expect(r.ctx.transact(ch, "0123456789", 10, match, 0, journal::cb, &j) ==
+			0, "length queued");
+	expect(rig::wait([&j]() { return j.size() == 1; }, 1000),
+			"length completed", j.size());
+	if( j.size() != 1 ) return;
+	expect(j.entries[0].status == 0, "length status", -j.entries[0].status);
+	expect(j.entries[0].response == "012345", "length response",
+			j.entries[0].response.size());
+	expect(r.read(ch, 4, 1000) == "6789", "length rest");
+}
+
+void unmatched(rig& r, channel ch) {
+	journal j;
+	const match_spec match { 0, '!' };
+	const uint64_t start = now_ns();
+	expect(r.ctx.transact(ch, "no end", 6, match, 50, journal::cb, &j) == 0,
+			"timeout queued");
+	expect(rig::wait([&j]() { return j.size() == 1; }, 1000),
+			"timeout completed", j.size());
+	if( j.size() != 1 ) return;
+	expect(j.entries[0].status == -usbuart::error_t::timed_out, "timeout status",
+			-j.entries[0].status);
+	expect(j.entries[0].time - start >= 50000000ull, "timeout early",
+			(j.entries[0].time - start) / 1000);
+	/* the response collected so far is reported						*/
+	expect(j.entries[0].response == "no end", "timeout response",
+			j.entries[0].response.size());
+}
+
+void queued(rig& r, channel ch) {
+	journal j;
+	const match_spec match { 0, '\n' };
+	static const char* const requests[] = { "first\n", "second\n", "third\n" };
+	for(auto request : requests)
+		expect(r.ctx.transact(ch, request, strlen(request), match, 0,
+				journal::cb, &j) == 0, "queue queued");
+	expect(rig::wait([&j]() { return j.size() == 3; }, 1000),
+			"queue completed", j.size());
+	if( j.size() != 3 ) return;
+	for(unsigned i = 0; i < 3; ++i) {
+		expect(j.entries[i].status == 0, "queue status", i);
+		expect(j.entries[i].response == requests[i], "queue order", i);
+	}
+}
+
+}
+
+int main() {
+	rig r;
+	const channel ch = r.open(_115200_8N1n);
+	expect(ch.fd_read >= 0, "open");
+	if( ch.fd_read < 0 ) return report();
+	terminated(r, ch);
+	counted(r, ch);
+	unmatched(r, ch);
+	queued(r, ch);
+	return report();
+}
@@ -0,0 +1,67 @@
+/** @brief Behavior test of software XON/XOFF flow control
+ *  @file  xonxoff-test.cpp
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: xonxoff-test
+ * Sends DC3 to a loopback attached with xon_xoff, the echo pauses sending,
+ * data written meanwhile is held until DC1, sent with send_at as it passes
+ * XOFF, comes back. Checks that DC3/DC1 are stripped from received data,
+ * or kept when stripping is off.										*/
+
+#include "loopback.hpp"
+#include "check.hpp"
+
+namespace {
+
+constexpr char xon = 0x11, xoff = 0x13;
+
+void paused(rig& r, channel ch) {
+	expect(::write(ch.fd_write, &xoff, 1) == 1, "xoff write");
+	/* the echoed DC3 is stripped, nothing comes back					*/
+	expect(r.read(ch, 1, 100).empty(), "xoff stripped");
+	expect(::write(ch.fd_write, "held", 4) == 4, "held write");
+	const std::string early = r.read(ch, 4, 200);
+	expect(early.empty(), "sent while paused", early.size());
+	/* send_at bypasses XOFF, its echo resumes sending					*/
+	expect(r.ctx.send_at(ch, &xon, 1, now_ns()) == 0, "xon send_at");
+	expect(r.read(ch, 4, 1000) == "held", "resumed");
+	expect(r.read(ch, 1, 100).empty(), "xon stripped");
+}
+
+void kept(rig& r, channel ch) {
+	expect(r.ctx.xonxoff(ch, false) == 0, "strip off");
+	/* DC1 while not paused has no effect, but stays in the data		*/
+	const char data[] = { 'x', xon, 'y' };
+	expect(::write(ch.fd_write, data, 3) == 3, "kept write");
+	expect(r.read(ch, 3, 1000) == std::string(data, 3), "kept");
+}
+
+}
+
+int main() {
+	rig r;
+	const eia_tia_232_info pi { 115200, 8, none, one, xon_xoff };
+	const channel ch = r.open(pi);
+	expect(ch.fd_read >= 0, "open");
+	if( ch.fd_read < 0 ) return report();
+	paused(r, ch);
+	kept(r, ch);
+	return report();
+}
@@ -0,0 +1,118 @@
+/** @brief live view of USBUART Library stats page
+ *  @file  usbuart-top.c
+ */
+/* This file is part of USBUART Library. http://usbuart.info/
+ *
+ * Copyright (C) 2016 Eugene Hutorny <eugene@hutorny.in.ua>
+ *
+ * The USBUART Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License v2
+ * as published by the Free Software Foundation;
+ *
+ * The USBUART Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the USBUART Library; if not, see
+ * <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+
+/* Usage: usbuart-top <stats page> [interval, s]
+ * Reads the page published with usbuart_publish and shows per-port rates
+ * and error counters. The page is mapped read-only, the publishing
+ * process is not affected in any way.										*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "usbuart_shm.h"
+
+/** copies a slot consistently, returns 0 if it is being written too often */
+static int snapshot(const struct usbuart_shm_slot* s,
+		struct usbuart_shm_slot* copy) {
+	int retry;
+	for(retry = 0; retry < 1000; ++retry) {
+		uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if( seq & 1 ) continue;
+		memcpy(copy, s, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if( __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq ) return 1;
+	}
+	return 0;
+}
+
+static double rate(uint64_t now, uint64_t was, double seconds) {
+	return seconds > 0 && now >= was ? (now - was) / seconds : 0;
+}
+
+int main(int argc, char** argv) {
+	if( argc < 2 ) {
+		fprintf(stderr, "usage: %s <stats page> [interval, s]\n", argv[0]);
+		return 1;
+	}
+	const unsigned interval = argc > 2 ? atoi(argv[2]) : 1;
+	int fd = open(argv[1], O_RDONLY);
+	struct stat st;
+	if( fd < 0 || fstat(fd, &st) ) {
+		perror(argv[1]);
+		return 1;
+	}
+	const struct usbuart_shm_header* header = (st.st_size < (off_t)
+		sizeof(*header)) ? MAP_FAILED :
+		mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if( header == MAP_FAILED ||
+		__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != USBUART_SHM_MAGIC ||
+		header->version < 1 ||
+		/* slots are copied whole, a smaller layout would be over-read	*/
+		header->header_size < sizeof(*header) ||
+		header->slot_size < sizeof(struct usbuart_shm_slot) ||
+		header->header_size + (uint64_t) header->slot_size * header->slots
+			> (uint64_t) st.st_size ) {
+		fprintf(stderr, "%s: not a usbuart stats page\n", argv[1]);
+		return 1;
+	}
+	const unsigned slots = header->slots;
+	struct usbuart_shm_slot* prev = calloc(slots, sizeof(*prev));
+	struct usbuart_shm_slot cur;
+	for(;;) {
+		printf("\033[H\033[J" "usbuart pid %u, %u slots, updated every %u ms\n\n",
+			header->pid, slots, header->interval);
+		printf("%-8s %-9s %8s %11s %11s %8s %8s %7s %7s %7s %7s\n",
+			"port", "vid:pid", "baud", "rx B/s", "tx B/s", "rx xfr/s",
+			"tx xfr/s", "lineerr", "dropped", "badcrc", "status");
+		for(unsigned i = 0; i < slots; ++i) {
+			const struct usbuart_shm_slot* s = (const void*)
+				((const char*) header + header->header_size +
+					(size_t) i * header->slot_size);
+			if( ! snapshot(s, &cur) || ! cur.active ) {
+				prev[i].active = 0;
+				continue;
+			}
+			const double dt = prev[i].active && cur.updated > prev[i].updated
+				? (cur.updated - prev[i].updated) / 1e9 : 0;
+			printf("%03u/%03u  %04x:%04x %8u %11.0f %11.0f %8.0f %8.0f "
+				"%7u %7u %7u %s%s%s\n",
+				cur.busid, cur.devid, cur.vid, cur.pid, cur.baudrate,
+				rate(cur.stats.rx_bytes, prev[i].stats.rx_bytes, dt),
+				rate(cur.stats.tx_bytes, prev[i].stats.tx_bytes, dt),
+				rate(cur.stats.rx_transfers, prev[i].stats.rx_transfers, dt),
+				rate(cur.stats.tx_transfers, prev[i].stats.tx_transfers, dt),
+				cur.stats.line_errors, cur.stats.dropped, cur.frames.bad_crc,
+				cur.status & usb_dev_ok    ? "u" : "-",
+				cur.status & read_pipe_ok  ? "r" : "-",
+				cur.status & write_pipe_ok ? "w" : "-");
+			if( dt > 0 || ! prev[i].active ) prev[i] = cur;
+		}
+		fflush(stdout);
+		sleep(interval ? interval : 1);
+	}
+	return 0;
+}